@@ -1,539 +1,8762 @@
-#include <iostream>
-#include <fstream>
-#include <string>
-#include <unordered_map> // For efficient data storage and retrieval
-#include <iomanip>       // For setw, setfill
-#include <limits>        // For numeric_limits
-
-// Structure to hold individual room/customer data
-struct RoomData {
-    int room_no;
-    std::string name;
-    std::string address;
-    std::string phone;
-    long days;
-    long cost;
-    std::string rtype; // Room type (Deluxe, Executive, Presidential)
-    long food_bill;    // Cost for food items
-
-    // Default constructor for RoomData
-    RoomData() : room_no(0), days(0), cost(0), food_bill(0) {}
-
-    // Parameterized constructor for RoomData
-    RoomData(int r_no, const std::string& n, const std::string& addr, const std::string& ph,
-             long d, long c, const std::string& rt, long fb)
-        : room_no(r_no), name(n), address(addr), phone(ph), days(d), cost(c), rtype(rt), food_bill(fb) {}
-};
-
-// Class to manage all hotel operations using an unordered_map
-class HotelManager {
-private:
-    // Unordered map to store RoomData objects, using room_no as key for O(1) average time complexity
-    std::unordered_map<int, RoomData> rooms_map;
-    const std::string DATA_FILE = "Record.DAT"; // File to persist data
-
-    // Private helper functions for restaurant menu calculations
-    void calculateBreakfastCost(RoomData& room, int num_people);
-    void calculateLunchCost(RoomData& room, int num_people);
-    void calculateDinnerCost(RoomData& room, int num_people);
-
-    // Helper to clear input buffer
-    void clearInputBuffer();
-
-public:
-    HotelManager();  // Constructor to load data
-    ~HotelManager(); // Destructor to save data
-
-    void load_data();  // Loads data from file into the unordered_map
-    void save_data();  // Saves data from the unordered_map to file
-
-    void main_menu();    // Displays the main menu and handles user choices
-    void add_room();     // Books a room and adds customer details
-    void display_room(); // Displays specific customer information
-    void display_all_rooms(); // Displays all allotted rooms
-    void edit_customer_details(); // Allows modification or checkout
-    int check_room_status(int r_no); // Checks if a room is booked or invalid
-    void modify_customer_info(); // Modifies customer details
-    void delete_customer_record(); // Checks out a customer and deletes record
-    void order_food();   // Handles food ordering for a room
-
-    // Specific modification functions
-    void modify_name(int r_no);
-    void modify_address(int r_no);
-    void modify_phone(int r_no);
-    void modify_days(int r_no);
-};
-
-// Constructor: Loads data when HotelManager object is created
-HotelManager::HotelManager() {
-    load_data();
-}
-
-// Destructor: Saves data when HotelManager object is destroyed
-HotelManager::~HotelManager() {
-    save_data();
-}
-
-// Helper to clear input buffer after numeric input
-void HotelManager::clearInputBuffer() {
-    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-}
-
-// Function to load data from file into the unordered_map
-void HotelManager::load_data() {
-    std::ifstream fin(DATA_FILE, std::ios::in | std::ios::binary);
-    if (!fin.is_open()) {
-        std::cout << "\n No existing record file found. Starting with empty data." << std::endl;
-        return;
-    }
-
-    RoomData temp_room;
-    while (fin.read(reinterpret_cast<char*>(&temp_room), sizeof(RoomData))) {
-        // For string members, we need to handle them carefully if directly reading binary
-        // A safer way would be to read fixed-size char arrays and convert to string,
-        // or serialize/deserialize strings explicitly.
-        // For simplicity, assuming direct binary read works for std::string if it's POD-like
-        // or if the strings are always short and fit.
-        // A robust solution would involve writing string lengths then string data.
-        // For this example, we'll assume basic binary compatibility for small strings.
-        rooms_map[temp_room.room_no] = temp_room;
-    }
-    fin.close();
-    std::cout << "\n Data loaded successfully from " << DATA_FILE << std::endl;
-}
-
-// Function to save data from the unordered_map to file
-void HotelManager::save_data() {
-    std::ofstream fout(DATA_FILE, std::ios::out | std::ios::binary | std::ios::trunc); // trunc to overwrite
-    if (!fout.is_open()) {
-        std::cerr << "\n Error: Could not open file for saving data." << std::endl;
-        return;
-    }
-
-    for (const auto& pair : rooms_map) {
-        fout.write(reinterpret_cast<const char*>(&pair.second), sizeof(RoomData));
-    }
-    fout.close();
-    std::cout << "\n Data saved successfully to " << DATA_FILE << std::endl;
-}
-
-// Function to display the main menu of the hotel management system
-void HotelManager::main_menu() {
-    int choice;
-    do {
-        system("clear"); 
-        std::cout << "\n\t\t\t +---------------------------------+" << std::endl;
-        std::cout << "\n\t\t\t |          THE HOTEL            |" << std::endl;
-        std::cout << "\n\t\t\t +---------------------------------+" << std::endl;
-        std::cout << "\n\n\t\t\t ********* MAIN MENU *********" << std::endl;
-        std::cout << "\n\n\t\t\t 1. Book A Room" << std::endl;
-        std::cout << "\n\t\t\t 2. Customer Information" << std::endl;
-        std::cout << "\n\t\t\t 3. Rooms Allotted" << std::endl;
-        std::cout << "\n\t\t\t 4. Edit Customer Details" << std::endl;
-        std::cout << "\n\t\t\t 5. Order Food from Restaurant" << std::endl;
-        std::cout << "\n\t\t\t 6. Exit" << std::endl;
-        std::cout << "\n\t\t\t Enter Your Choice: ";
-        std::cin >> choice;
-        clearInputBuffer(); 
-
-        switch(choice) {
-            case 1:
-                add_room();
-                break;
-            case 2:
-                display_room();
-                break;
-            case 3:
-                display_all_rooms();
-                break;
-            case 4:
-                edit_customer_details();
-                break;
-            case 5:
-                order_food();
-                break;
-            case 6:
-                std::cout << "\n Exiting Hotel Management System. Goodbye!" << std::endl;
-                break;
-            default:
-                std::cout << "\n\n\t\t\t Wrong choice. Please try again." << std::endl;
-                std::cout << "\n\t\t\t Press Enter to continue. ";
-                std::cin.get(); 
-        }
-    } while (choice != 6);
-}
-
-// Function to add a new customer and book a room
-void HotelManager::add_room() {
-    system("clear");
-    int r_no;
-    std::cout << "\n\t\t\t +---------------------------------+" << std::endl;
-    std::cout << "\n\t\t\t | Rooms | Room Type |" << std::endl;
-    std::cout << "\n\t\t\t +---------------------------------+" << std::endl;
-    std::cout << "\n\t\t\t | 1-50 | Deluxe |" << std::endl;
-    std::cout << "\n\t\t\t | 51-80 | Executive |" << std::endl;
-    std::cout << "\n\t\t\t | 81-100 | Presidential |" << std::endl;
-    std::cout << "\n\t\t\t +---------------------------------+" << std::endl;
-    std::cout << "\n\n ENTER CUSTOMER DETAILS";
-    std::cout << "\n -----------------------";
-    std::cout << "\n\n Room Number (1-100): ";
-    std::cin >> r_no;
-    clearInputBuffer();
-
-    int status = check_room_status(r_no);
-
-    if (status == 1) {
-        std::cout << "\n Sorry, Room " << r_no << " is already booked." << std::endl;
-    } else if (status == 2) {
-        std::cout << "\n Sorry, Room " << r_no << " does not exist (valid range 1-100)." << std::endl;
-    } else {
-        RoomData new_room;
-        new_room.room_no = r_no;
-        std::cout << " Name: ";
-        std::getline(std::cin, new_room.name);
-        std::cout << " Address: ";
-        std::getline(std::cin, new_room.address);
-        std::cout << " Phone Number: ";
-        std::getline(std::cin, new_room.phone);
-        std::cout << " Number of Days: ";
-        std::cin >> new_room.days;
-        clearInputBuffer();
-
-        if (new_room.room_no >= 1 && new_room.room_no <= 50) {
-            new_room.rtype = "Deluxe";
-            new_room.cost = new_room.days * 10000;
-        } else if (new_room.room_no >= 51 && new_room.room_no <= 80) {
-            new_room.rtype = "Executive";
-            new_room.cost = new_room.days * 12500;
-        } else if (new_room.room_no >= 81 && new_room.room_no <= 100) {
-            new_room.rtype = "Presidential";
-            new_room.cost = new_room.days * 15000;
-        }
-        new_room.food_bill = 0; // Initialize food bill
-
-        rooms_map[new_room.room_no] = new_room; // Add to unordered_map
-        std::cout << "\n Room " << new_room.room_no << " has been booked for " << new_room.name << "." << std::endl;
-    }
-    std::cout << "\n Press Enter to continue.";
-    std::cin.get();
-}
-
-// Function to display specific customer information
-void HotelManager::display_room() {
-    system("clear");
-    int r_no;
-    std::cout << "\n Enter Room Number to display: ";
-    std::cin >> r_no;
-    clearInputBuffer();
-
-    auto it = rooms_map.find(r_no); // Use find for O(1) average lookup
-
-    if (it != rooms_map.end()) {
-        // Room found
-        const RoomData& room = it->second;
-        system("clear");
-        std::cout << "\n Customer Details" << std::endl;
-        std::cout << "------------------" << std::endl;
-        std::cout << "\n Room Number: " << room.room_no << std::endl;
-        std::cout << " Name: " << room.name << std::endl;
-        std::cout << " Address: " << room.address << std::endl;
-        std::cout << " Phone Number: " << room.phone << std::endl;
-        std::cout << " Staying for: " << room.days << " days." << std::endl;
-        std::cout << " Room Type: " << room.rtype << std::endl;
-        std::cout << " Total Room Cost: " << room.cost << std::endl;
-        std::cout << " Total Food Bill: " << room.food_bill << std::endl;
-        std::cout << " Grand Total: " << (room.cost + room.food_bill) << std::endl;
-    } else {
-        std::cout << "\n Room " << r_no << " is Vacant or does not exist." << std::endl;
-    }
-    std::cout << "\n Press Enter to continue.";
-    std::cin.get();
-}
-
-// Function to display all allotted rooms in a formatted table
-void HotelManager::display_all_rooms() {
-    system("clear");
-    char separator = ' ';
-    const int NoWidth = 8;
-    const int GuestWidth = 17;
-    const int AddressWidth = 16;
-    const int RoomTypeWidth = 13;
-    const int ContactNoWidth = 13;
-    const int DaysWidth = 5;
-    const int CostWidth = 10;
-
-    std::cout << "\n\t\t\t LIST OF ALLOTTED ROOMS" << std::endl;
-    std::cout << "\n\t\t\t +--------+-----------------+----------------+-------------+-------------+-----+----------+" << std::endl;
-    std::cout << "\n\t\t\t | Room No| Guest Name      | Address        | Room Type   | Contact No. |Days | Total    |" << std::endl;
-    std::cout << "\n\t\t\t +--------+-----------------+----------------+-------------+-------------+-----+----------+" << std::endl;
-
-    if (rooms_map.empty()) {
-        std::cout << "\n\t\t\t No rooms currently allotted." << std::endl;
-    } else {
-        for (const auto& pair : rooms_map) {
-            const RoomData& room = pair.second;
-            std::cout << "\n\t\t\t |" << std::setw(NoWidth) << std::setfill(separator) << room.room_no << "|"
-                      << std::setw(GuestWidth) << std::setfill(separator) << room.name << "|"
-                      << std::setw(AddressWidth) << std::setfill(separator) << room.address << "|"
-                      << std::setw(RoomTypeWidth) << std::setfill(separator) << room.rtype << "|"
-                      << std::setw(ContactNoWidth) << std::setfill(separator) << room.phone << "|"
-                      << std::setw(DaysWidth) << std::setfill(separator) << room.days << "|"
-                      << std::setw(CostWidth) << std::setfill(separator) << (room.cost + room.food_bill) << "|" << std::endl;
-        }
-    }
-    std::cout << "\n\t\t\t +--------+-----------------+----------------+-------------+-------------+-----+----------+" << std::endl;
-    std::cout << "\n\n\n\t\t\t Press Enter to continue.";
-    std::cin.get();
-}
-
-// Function to edit customer details (modify or delete)
-void HotelManager::edit_customer_details() {
-    system("clear");
-    int choice;
-    std::cout << "\n EDIT MENU:" << std::endl;
-    std::cout << "------------" << std::endl;
-    std::cout << "\n 1. Modify Customer Information." << std::endl;
-    std::cout << "\n 2. Customer Check Out." << std::endl;
-    std::cout << "\n Enter your choice: ";
-    std::cin >> choice;
-    clearInputBuffer();
-
-    system("clear");
-
-    switch(choice) {
-        case 1:
-            modify_customer_info();
-            break;
-        case 2:
-            delete_customer_record();
-            break;
-        default:
-            std::cout << "\n Wrong Choice. Please try again." << std::endl;
-            break;
-    }
-    std::cout << "\n Press Enter to continue.";
-    std::cin.get();
-}
-
-// Function to check room status (booked, vacant, or invalid)
-// Returns 0 if vacant, 1 if booked, 2 if invalid room number
-int HotelManager::check_room_status(int r_no) {
-    if (r_no < 1 || r_no > 100) {
-        return 2; // Invalid room number
-    }
-    auto it = rooms_map.find(r_no);
-    if (it != rooms_map.end()) {
-        return 1; // Room is booked
-    }
-    return 0; // Room is vacant
-}
-
-// Function to modify customer information
-void HotelManager::modify_customer_info() {
-    system("clear");
-    int ch, r_no;
-    std::cout << "\n MODIFY MENU:" << std::endl;
-    std::cout << "-------------" << std::endl;
-    std::cout << "\n 1. Modify Name" << std::endl;
-    std::cout << "\n 2. Modify Address" << std::endl;
-    std::cout << "\n 3. Modify Phone Number" << std::endl;
-    std::cout << "\n 4. Modify Number of Days of Stay" << std::endl;
-    std::cout << "\n Enter Your Choice: ";
-    std::cin >> ch;
-    clearInputBuffer();
-
-    system("clear");
-    std::cout << "\n Enter Room Number to modify: ";
-    std::cin >> r_no;
-    clearInputBuffer();
-
-    auto it = rooms_map.find(r_no);
-    if (it == rooms_map.end()) {
-        std::cout << "\n Sorry, Room " << r_no << " is vacant or does not exist." << std::endl;
-        return;
-    }
-
-    switch(ch) {
-        case 1:
-            modify_name(r_no);
-            break;
-        case 2:
-            modify_address(r_no);
-            break;
-        case 3:
-            modify_phone(r_no);
-            break;
-        case 4:
-            modify_days(r_no);
-            break;
-        default:
-            std::cout << "\n Wrong Choice. Please try again." << std::endl;
-            break;
-    }
-}
-
-// Function to modify the name of a guest
-void HotelManager::modify_name(int r_no) {
-    auto it = rooms_map.find(r_no);
-    if (it != rooms_map.end()) {
-        std::cout << "\n Enter New Name: ";
-        std::getline(std::cin, it->second.name);
-        std::cout << "\n Customer Name has been modified." << std::endl;
-    } else {
-        std::cout << "\n Sorry, Room is vacant." << std::endl;
-    }
-}
-
-// Function to modify the address of a guest
-void HotelManager::modify_address(int r_no) {
-    auto it = rooms_map.find(r_no);
-    if (it != rooms_map.end()) {
-        std::cout << "\n Enter New Address: ";
-        std::getline(std::cin, it->second.address);
-        std::cout << "\n Customer Address has been modified." << std::endl;
-    } else {
-        std::cout << "\n Sorry, Room is vacant." << std::endl;
-    }
-}
-
-// Function to modify the phone number of a guest
-void HotelManager::modify_phone(int r_no) {
-    auto it = rooms_map.find(r_no);
-    if (it != rooms_map.end()) {
-        std::cout << "\n Enter New Phone Number: ";
-        std::getline(std::cin, it->second.phone);
-        std::cout << "\n Customer Phone Number has been modified." << std::endl;
-    } else {
-        std::cout << "\n Sorry, Room is vacant." << std::endl;
-    }
-}
-
-// Function to modify the number of days of stay for a guest
-void HotelManager::modify_days(int r_no) {
-    auto it = rooms_map.find(r_no);
-    if (it != rooms_map.end()) {
-        std::cout << "\n Enter New Number of Days of Stay: ";
-        std::cin >> it->second.days;
-        clearInputBuffer();
-
-        // Recalculate cost based on new days
-        if (it->second.room_no >= 1 && it->second.room_no <= 50) {
-            it->second.cost = it->second.days * 10000;
-        } else if (it->second.room_no >= 51 && it->second.room_no <= 80) {
-            it->second.cost = it->second.days * 12500;
-        } else if (it->second.room_no >= 81 && it->second.room_no <= 100) {
-            it->second.cost = it->second.days * 15000;
-        }
-        std::cout << "\n Customer information is modified." << std::endl;
-    } else {
-        std::cout << "\n Sorry, Room is vacant." << std::endl;
-    }
-}
-
-// Function to delete a customer record (check out)
-void HotelManager::delete_customer_record() {
-    int r_no;
-    char confirm_char;
-    std::cout << "\n Enter Room Number to check out: ";
-    std::cin >> r_no;
-    clearInputBuffer();
-
-    auto it = rooms_map.find(r_no);
-    if (it != rooms_map.end()) {
-        // Room found, display details before checkout
-        const RoomData& room = it->second;
-        std::cout << "\n Name: " << room.name << std::endl;
-        std::cout << "\n Address: " << room.address << std::endl;
-        std::cout << "\n Phone Number: " << room.phone << std::endl;
-        std::cout << "\n Your total bill is: Rs. " << (room.cost + room.food_bill) << std::endl;
-        std::cout << "\n Do you want to check out this customer (y/n): ";
-        std::cin >> confirm_char;
-        clearInputBuffer();
-
-        if (confirm_char == 'y' || confirm_char == 'Y') {
-            rooms_map.erase(it); 
-            std::cout << "\n Customer Checked Out. Room " << r_no << " is now vacant." << std::endl;
-        } else {
-            std::cout << "\n Checkout cancelled." << std::endl;
-        }
-    } else {
-        std::cout << "\n Sorry, Room " << r_no << " is vacant or does not exist." << std::endl;
-    }
-    std::cout << "\n Press Enter to continue.";
-    std::cin.get();
-}
-
-// Function to handle restaurant food orders
-void HotelManager::order_food() {
-    system("clear");
-    int r_no, meal_choice, num_people;
-    std::cout << "\n RESTAURANT MENU:" << std::endl;
-    std::cout << "------------------" << std::endl;
-    std::cout << "\n 1. Order Breakfast" << std::endl;
-    std::cout << " 2. Order Lunch" << std::endl;
-    std::cout << " 3. Order Dinner" << std::endl;
-    std::cout << "\n Enter your choice: ";
-    std::cin >> meal_choice;
-    clearInputBuffer();
-
-    system("clear");
-    std::cout << " Enter Room Number for the order: ";
-    std::cin >> r_no;
-    clearInputBuffer();
-
-    auto it = rooms_map.find(r_no);
-    if (it == rooms_map.end()) {
-        std::cout << "\n Sorry, Room " << r_no << " is vacant or does not exist." << std::endl;
-        std::cout << "\n Press Enter to continue.";
-        std::cin.get();
-        return;
-    }
-    std::cout << " Enter number of people: ";
-    std::cin >> num_people;
-    clearInputBuffer();
-    switch(meal_choice) {
-        case 1:
-            calculateBreakfastCost(it->second, num_people);
-            break;
-        case 2:
-            calculateLunchCost(it->second, num_people);
-            break;
-        case 3:
-            calculateDinnerCost(it->second, num_people);
-            break;
-        default:
-            std::cout << "\n Invalid choice for meal." << std::endl;
-            break;
-    }
-    std::cout << "\n Press Enter to continue.";
-    std::cin.get();
-}
-
-// Private helper functions for food cost calculation
-void HotelManager::calculateBreakfastCost(RoomData& room, int num_people) {
-    long cost_per_person = 500;
-    long added_cost = cost_per_person * num_people;
-    room.food_bill += added_cost;
-    std::cout << "\n Rs. " << added_cost << " added to the bill for breakfast." << std::endl;
-}
-
-void HotelManager::calculateLunchCost(RoomData& room, int num_people) {
-    long cost_per_person = 1000;
-    long added_cost = cost_per_person * num_people;
-    room.food_bill += added_cost;
-    std::cout << "\n Rs. " << added_cost << " added to the bill for lunch." << std::endl;
-}
-
-void HotelManager::calculateDinnerCost(RoomData& room, int num_people) {
-    long cost_per_person = 1200;
-    long added_cost = cost_per_person * num_people;
-    room.food_bill += added_cost;
-    std::cout << "\n Rs. " << added_cost << " added to the bill for dinner." << std::endl;
-}
-
-// Main function to run the hotel management system
-int main() {
-    HotelManager hotel_system; // Create an object of HotelManager class
-    hotel_system.main_menu();  // Call the main menu function
-    return 0;
-}
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <unordered_map> // For efficient data storage and retrieval
+#include <iomanip>       // For setw, setfill
+#include <limits>        // For numeric_limits
+#include <vector>
+#include <thread>        // For the parallel night audit pass
+#include <algorithm>
+#include <ctime>
+#include <filesystem>    // For the invoice output directory
+#include <cstdint>
+#include <cstdlib>       // For getenv
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <new>           // For align_val_t (cache-line aligned index blocks)
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <sys/resource.h> // For getrusage in the startup report
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>      // For ttyname (audit terminal id)
+#include <fcntl.h>       // For shm_open flags
+#include <sys/mman.h>    // For the shared-memory room snapshot
+#include <sys/wait.h>    // For reaping background snapshot children
+#include <signal.h>      // For kill (is the snapshot owner still running)
+#include <pthread.h>     // For pinning partition threads to cores
+#include <deque>
+#include <condition_variable>
+#include <unordered_set>
+
+// Subsystems whose heap usage is accounted separately
+enum MemorySubsystem {
+    MEM_ROOM_TABLE,     // rooms_map nodes and buckets, room types, group codes and channel references
+    MEM_GUEST_STRINGS,  // Heap parts of guest names, addresses and phone numbers
+    MEM_INDEXES,        // Audit index and string table, loyalty ledger, group accounts
+    MEM_FOLIOS,         // Folios, their payers and charge lines with their descriptions
+    MEM_AUDIT_BUFFER,   // Audit record being encoded and the rooms it mentions
+    MEM_SUBSYSTEM_COUNT
+};
+
+static const char* const MEM_SUBSYSTEM_NAMES[MEM_SUBSYSTEM_COUNT] = {
+    "Room Table", "Guest Strings", "Indexes", "Folios", "Audit Buffer"
+};
+
+// Live/peak byte counters per subsystem, updated by TrackingAllocator
+struct MemoryCounters {
+    std::atomic<long> live_bytes;
+    std::atomic<long> peak_bytes;
+    std::atomic<long> allocations;
+};
+
+static MemoryCounters memory_counters[MEM_SUBSYSTEM_COUNT];
+
+// Standard allocator that charges every allocation to a subsystem
+template <typename T, int Subsystem>
+struct TrackingAllocator {
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind {
+        typedef TrackingAllocator<U, Subsystem> other;
+    };
+
+    TrackingAllocator() noexcept {}
+    template <typename U>
+    TrackingAllocator(const TrackingAllocator<U, Subsystem>&) noexcept {}
+
+    T* allocate(size_t n) {
+        T* ptr = alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__
+                     ? static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))))
+                     : static_cast<T*>(::operator new(n * sizeof(T)));
+        MemoryCounters& counters = memory_counters[Subsystem];
+        long live = counters.live_bytes.fetch_add(static_cast<long>(n * sizeof(T))) + static_cast<long>(n * sizeof(T));
+        long peak = counters.peak_bytes.load(std::memory_order_relaxed);
+        while (live > peak && !counters.peak_bytes.compare_exchange_weak(peak, live)) {
+        }
+        counters.allocations++;
+        return ptr;
+    }
+    void deallocate(T* ptr, size_t n) noexcept {
+        memory_counters[Subsystem].live_bytes.fetch_sub(static_cast<long>(n * sizeof(T)));
+        if (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            ::operator delete(ptr, std::align_val_t(alignof(T)));
+        } else {
+            ::operator delete(ptr);
+        }
+    }
+};
+
+template <typename T, typename U, int S>
+bool operator==(const TrackingAllocator<T, S>&, const TrackingAllocator<U, S>&) { return true; }
+template <typename T, typename U, int S>
+bool operator!=(const TrackingAllocator<T, S>&, const TrackingAllocator<U, S>&) { return false; }
+
+template <typename T, int Subsystem>
+using TrackedVector = std::vector<T, TrackingAllocator<T, Subsystem>>;
+
+template <typename K, typename V, int Subsystem>
+using TrackedMap = std::unordered_map<K, V, std::hash<K>, std::equal_to<K>,
+                                      TrackingAllocator<std::pair<const K, V>, Subsystem>>;
+
+template <int Subsystem>
+using TrackedString = std::basic_string<char, std::char_traits<char>, TrackingAllocator<char, Subsystem>>;
+
+typedef TrackedString<MEM_GUEST_STRINGS> GuestString;
+typedef TrackedString<MEM_ROOM_TABLE> RoomString; // Room type, group code and channel reference
+typedef TrackedString<MEM_FOLIOS> FolioString;    // Payers and charge descriptions
+
+// Converts a tracked string to a plain std::string
+template <int Subsystem>
+static std::string to_std_string(const TrackedString<Subsystem>& str) {
+    return std::string(str.data(), str.size());
+}
+
+// Categories used to route charges to folios
+enum ChargeCategory {
+    CHARGE_ROOM = 0,
+    CHARGE_FOOD = 1,
+    CHARGE_CATEGORY_COUNT
+};
+
+static const char* const CHARGE_CATEGORY_NAMES[CHARGE_CATEGORY_COUNT] = { "Room", "Food" };
+
+// A single posted charge
+struct ChargeLine {
+    long date;          // Business date the charge was posted
+    int category;       // ChargeCategory
+    long amount;
+    FolioString description;
+};
+
+// A bill within a stay, paid by one party (the guest or a company)
+struct Folio {
+    FolioString payer;
+    long total;                                    // Running total of all lines
+    long category_totals[CHARGE_CATEGORY_COUNT];   // Running totals per category
+    TrackedVector<ChargeLine, MEM_FOLIOS> lines;
+
+    Folio() : total(0), category_totals() {}
+    explicit Folio(const std::string& p) : payer(p.c_str()), total(0), category_totals() {}
+};
+
+// Room types, the room numbers they cover and their nightly rates, in room number order
+struct RoomTypeRange {
+    const char* name;
+    int first;
+    int last;
+    long rate;
+};
+static const int ROOM_TYPE_COUNT = 3;
+static const RoomTypeRange ROOM_TYPE_RANGES[ROOM_TYPE_COUNT] = {
+    {"Deluxe", 1, 50, 10000}, {"Executive", 51, 80, 12500}, {"Presidential", 81, 100, 15000}};
+
+// Returns the index of a room type name in ROOM_TYPE_RANGES, or -1
+static int room_type_index(const std::string& name) {
+    for (int t = 0; t < ROOM_TYPE_COUNT; ++t) {
+        if (name == ROOM_TYPE_RANGES[t].name) {
+            return t;
+        }
+    }
+    return -1;
+}
+
+// Returns the index in ROOM_TYPE_RANGES of the type of a room, or -1
+static int room_type_of(int r_no) {
+    for (int t = 0; t < ROOM_TYPE_COUNT; ++t) {
+        if (r_no >= ROOM_TYPE_RANGES[t].first && r_no <= ROOM_TYPE_RANGES[t].last) {
+            return t;
+        }
+    }
+    return -1;
+}
+
+// The room table carries no floor plan, so floors and wings follow the room
+// numbering: ten rooms to a floor, 1-5 of each floor in the east wing, 6-10 in the west
+static const int ROOMS_PER_FLOOR = 10;
+static const int WING_COUNT = 2;
+static const char* const WING_NAMES[WING_COUNT] = { "East", "West" };
+
+// Returns the floor of a room (1 for rooms 1-10)
+static int room_floor(int r_no) {
+    return (r_no - 1) / ROOMS_PER_FLOOR + 1;
+}
+
+// Returns the index in WING_NAMES of the wing of a room
+static int room_wing(int r_no) {
+    return (r_no - 1) % ROOMS_PER_FLOOR < ROOMS_PER_FLOOR / WING_COUNT ? 0 : 1;
+}
+
+// Company account for a group, accumulated from the company folios of its rooms
+struct GroupAccount {
+    std::string company;
+    long total;
+    long category_totals[CHARGE_CATEGORY_COUNT];
+    std::unordered_map<int, long> room_totals;     // Amount billed per room number
+
+    GroupAccount() : total(0), category_totals() {}
+};
+
+// Structure to hold individual room/customer data
+struct RoomData {
+    int room_no;
+    GuestString name;
+    GuestString address;
+    GuestString phone;
+    long days;
+    long cost;
+    RoomString rtype;  // Room type (Deluxe, Executive, Presidential)
+    long food_bill;    // Cost for food items
+    long arrival_date;  // Business date on which the stay starts
+    long nights_posted; // Nights already accrued by the night audit
+    long room_charges;  // Room charges accrued so far (nights_posted * nightly rate)
+    bool arrived;       // False until the guest is in house
+    bool due_out;       // Set by the night audit once every booked night is accrued
+    bool no_show;       // Set by the night audit if the guest never arrived
+    bool from_allotment; // Drawn from an agent's allotment block (restored at checkout)
+    RoomString group_code;       // Group/company booking code, empty for individual guests
+    RoomString channel_ref;      // "<channel>:<booking id>" for channel manager bookings, else empty
+    TrackedVector<Folio, MEM_FOLIOS> folios;   // Folio 0 is always the guest's own folio
+    int routing[CHARGE_CATEGORY_COUNT]; // Folio index each charge category is posted to
+
+    // Default constructor for RoomData
+    RoomData() : room_no(0), days(0), cost(0), food_bill(0), arrival_date(0), nights_posted(0),
+                 room_charges(0), arrived(false), due_out(false), no_show(false), from_allotment(false),
+                 folios(1, Folio("Guest")), routing() {}
+
+    // Parameterized constructor for RoomData
+    RoomData(int r_no, const std::string& n, const std::string& addr, const std::string& ph,
+             long d, long c, const std::string& rt, long fb)
+        : room_no(r_no), name(n.c_str()), address(addr.c_str()), phone(ph.c_str()), days(d), cost(c), rtype(rt.c_str()), food_bill(fb),
+          arrival_date(0), nights_posted(0), room_charges(0), arrived(false), due_out(false), no_show(false),
+          from_allotment(false), folios(1, Folio("Guest")), routing() {}
+};
+
+// Channel bookings whose arrival date is still ahead. They hold their room
+// for [arrival, arrival + days) without occupying it, so the desk can sell the
+// room until then, and move into the room table on their arrival date.
+class ReservationBook {
+private:
+    TrackedMap<int, TrackedVector<RoomData, MEM_ROOM_TABLE>, MEM_ROOM_TABLE> by_room; // Each in arrival order
+    size_t count;
+
+public:
+    ReservationBook() : count(0) {}
+
+    void add(const RoomData& room);
+    // Arrival of the room's first reservation still running after the night from, or -1
+    long next_arrival(int r_no, long from) const;
+    // True if a reservation of the room covers any of the nights [from, to)
+    bool conflicts(int r_no, long from, long to) const;
+    const RoomData* arriving(int r_no, long date) const;
+    const RoomData* departing(int r_no, long date) const;
+    // Removes the room's first reservation into out if it arrives by today
+    bool take_due(int r_no, long today, RoomData& out);
+    size_t size() const { return count; }
+
+    template <typename Fn>
+    void for_each(Fn fn) const {
+        for (const auto& pair : by_room) {
+            for (const RoomData& room : pair.second) {
+                fn(room);
+            }
+        }
+    }
+};
+
+// Output formats supported by the invoice generator
+enum InvoiceFormat {
+    INVOICE_TEXT,
+    INVOICE_HTML
+};
+
+// A charge posted to a company folio, to be applied to the group account
+struct GroupPosting {
+    std::string group_code;
+    int room_no;
+    int category;
+    long amount;
+};
+
+// Totals produced by one run of the night audit
+struct NightAuditResult {
+    long closed_date;            // Business date that was closed
+    long rooms_processed;
+    long nights_accrued;
+    long amount_accrued;
+    std::vector<int> due_outs;   // Rooms whose stay ends on the new business date
+    std::vector<int> no_shows;   // Rooms whose guest never arrived
+    std::vector<GroupPosting> group_postings; // Company-billed accruals, applied after the pass
+    std::vector<int> accrued_rooms; // Rooms charged a night, added to the occupancy cube after the pass
+    std::vector<int> still_absent;  // Earlier no-shows that missed this night too, taken off the cube after the pass
+
+    long allotment_released;     // Unsold allotment room-nights given back to general sale
+    long accrued_by_type[ROOM_TYPE_COUNT]; // Room charges accrued per room type
+
+    NightAuditResult()
+        : closed_date(0), rooms_processed(0), nights_accrued(0), amount_accrued(0), allotment_released(0),
+          accrued_by_type() {}
+};
+
+// Outcome of a fork-based background snapshot. The child reports what it
+// wrote and how much memory copy-on-write had duplicated by then through a pipe.
+struct BgsaveResult {
+    bool ok;
+    long rooms;
+    long bytes;         // Size of the snapshot file
+    long cow_kb;        // Child's Private_Dirty: pages copied since the fork
+    double save_ms;     // Serialization time in the child
+    double fork_ms;     // Time the parent spent in fork()
+    double total_ms;    // Fork to reap
+
+    BgsaveResult() : ok(false), rooms(0), bytes(0), cow_kb(0), save_ms(0), fork_ms(0), total_ms(0) {}
+};
+
+// Loyalty tiers, recomputed from points earned over the last 12 months
+enum LoyaltyTier {
+    TIER_MEMBER,
+    TIER_SILVER,
+    TIER_GOLD,
+    TIER_PLATINUM
+};
+
+static const char* const LOYALTY_TIER_NAMES[] = { "Member", "Silver", "Gold", "Platinum" };
+
+// Per-guest loyalty account. Monthly earnings are kept in a 12-slot ring so the
+// rolling 12-month total and tier are updated in O(1) as months pass.
+struct LoyaltyAccount {
+    static const int WINDOW_MONTHS = 12;
+
+    long points_balance;              // Lifetime points not yet redeemed
+    long month_points[WINDOW_MONTHS]; // Points earned per month; slot = month % 12
+    long head_month;                  // Latest month held in the ring
+    long rolling_points;              // Sum of month_points
+    int tier;                         // LoyaltyTier for rolling_points
+    long stays;
+
+    LoyaltyAccount() : points_balance(0), month_points(), head_month(0), rolling_points(0),
+                       tier(TIER_MEMBER), stays(0) {}
+};
+
+// Sequence counter helpers (seqlock). A writer makes the counter odd while it
+// updates the guarded data; a reader copies the data and retries if the counter
+// was odd or changed meanwhile, so readers never block or take a lock.
+static inline void seqlock_write_begin(std::atomic<uint64_t>& seq) {
+    seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+static inline void seqlock_write_end(std::atomic<uint64_t>& seq) {
+    seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+template <typename T>
+static inline T seqlock_read(const std::atomic<uint64_t>& seq, const T& data) {
+    T copy;
+    uint64_t before, after;
+    do {
+        before = seq.load(std::memory_order_acquire);
+        std::memcpy(static_cast<void*>(&copy), static_cast<const void*>(&data), sizeof(T));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = seq.load(std::memory_order_relaxed);
+    } while ((before & 1) != 0 || before != after);
+    return copy;
+}
+
+// Fixed-size room record published to shared memory for sibling processes
+// (key-card encoder, phone switch). Index in the table is the room number.
+struct SharedRoomRecord {
+    int32_t room_no;
+    int32_t occupied;
+    int64_t days;
+    char rtype[16];
+    char name[48];  // Truncated guest name
+};
+
+// Free rooms of each type for every night of the booking window. Rows are
+// nights, so any run of nights is one contiguous block.
+static const int AVAILABILITY_NIGHTS = 90;
+static const long MAX_STAY_NIGHTS = 90; // Longest stay taken at the desk or from a channel
+struct AvailabilityWindow {
+    int64_t first_night; // Business date of row 0
+    int32_t free[AVAILABILITY_NIGHTS][ROOM_TYPE_COUNT];
+};
+
+// Layout of the shared-memory segment
+struct SharedRoomSnapshot {
+    static const uint64_t MAGIC = 0x48534d534e415033ULL; // "HMSSNAP3"
+    static const int MAX_ROOMS = 100;
+
+    uint64_t magic;
+    int64_t owner_pid;                // Desk that created the segment and removes it at exit
+    std::atomic<uint64_t> sequence;   // Seqlock guarding everything below
+    int64_t published_at;             // Unix time of the last refresh
+    int64_t business_date;
+    SharedRoomRecord rooms[MAX_ROOMS + 1];
+    AvailabilityWindow availability;
+};
+
+// Type x night counters of free rooms over the next AVAILABILITY_NIGHTS
+// nights, kept up to date by bookings, extensions and checkouts so the
+// booking site never scans rooms. A stay takes its booked nights
+// [arrival, arrival + days). Nights live in a ring indexed by business date
+// modulo the window; closing a day recycles its row as the new last night.
+class AvailabilityMatrix {
+private:
+    int32_t ring[AVAILABILITY_NIGHTS][ROOM_TYPE_COUNT];
+    long first_night;
+
+    int32_t* row(long night) { return ring[night % AVAILABILITY_NIGHTS]; }
+    void fill_night(long night, const TrackedMap<int, RoomData, MEM_ROOM_TABLE>& rooms, const ReservationBook& reservations);
+
+public:
+    AvailabilityMatrix() : ring(), first_night(0) {}
+
+    void rebuild(long today, const TrackedMap<int, RoomData, MEM_ROOM_TABLE>& rooms, const ReservationBook& reservations);
+    // Moves the window to start at today, filling the new nights from the rooms and reservations
+    void advance(long today, const TrackedMap<int, RoomData, MEM_ROOM_TABLE>& rooms, const ReservationBook& reservations);
+    // Adds delta free rooms of a room's type on the nights [from, to) inside the window
+    void adjust(int r_no, long from, long to, int delta);
+    void book(const RoomData& room) { adjust(room.room_no, room.arrival_date, room.arrival_date + room.days, -1); }
+    long first() const { return first_night; }
+    // Copies the rows of nights [from, from + nights) clipped to the window
+    // into out (at most two memcpys); returns the first night copied and sets
+    // nights to the number of rows
+    long copy(long from, int& nights, int32_t (*out)[ROOM_TYPE_COUNT]) const;
+    void snapshot(AvailabilityWindow& out) const {
+        int nights = AVAILABILITY_NIGHTS;
+        out.first_night = copy(first_night, nights, out.free);
+    }
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "seqlock counter must be lock-free in shared memory");
+
+// Publishes the room table to POSIX shared memory. The front desk refreshes it
+// each time it returns to the main menu, i.e. after every operation.
+class SnapshotPublisher {
+private:
+    SharedRoomSnapshot* snapshot;
+    int fd;
+    bool owner; // This process created the segment (or took over a dead desk's)
+
+public:
+    static const char* const SHM_NAME;
+
+    SnapshotPublisher() : snapshot(nullptr), fd(-1), owner(false) {}
+    ~SnapshotPublisher();
+
+    bool open();
+    void publish(const TrackedMap<int, RoomData, MEM_ROOM_TABLE>& rooms, long business_date,
+                 const AvailabilityMatrix& availability);
+};
+
+const char* const SnapshotPublisher::SHM_NAME = "/hms_room_snapshot";
+
+// Epoch-based memory reclamation.
+//
+// Lock-free readers pin the current global epoch while they dereference shared
+// pointers. Writers unlink an object and retire it into the limbo list of the
+// epoch it was retired in; the object is freed once the global epoch has moved
+// two steps on, which can only happen after every reader pinned in that epoch
+// has unpinned. Backlog is bounded: once it passes MAX_BACKLOG_BYTES, every
+// retire tries to advance the epoch and reclaim before returning.
+class EpochManager {
+public:
+    static const int MAX_THREADS = 64;
+    static const size_t MAX_BACKLOG_BYTES = 1 << 20;
+
+    struct Stats {
+        uint64_t global_epoch;
+        uint64_t retired;          // Objects retired since start
+        uint64_t freed;            // Objects reclaimed since start
+        uint64_t backlog_objects;  // Retired but not yet freed
+        uint64_t backlog_bytes;
+        uint64_t peak_backlog_bytes;
+        uint64_t advances;         // Successful epoch advances
+        uint64_t stalled;          // Advance attempts blocked by a pinned reader
+    };
+
+private:
+    static const uint64_t INACTIVE = ~0ULL;
+
+    struct alignas(64) ThreadSlot {
+        std::atomic<uint64_t> epoch;   // Pinned epoch, or INACTIVE
+        std::atomic<bool> in_use;
+        ThreadSlot() : epoch(INACTIVE), in_use(false) {}
+    };
+
+    struct Retired {
+        void* ptr;
+        void (*deleter)(void*);
+        size_t bytes;
+    };
+
+    std::atomic<uint64_t> global_epoch;
+    ThreadSlot slots[MAX_THREADS];
+    std::mutex limbo_mutex;            // Guards the limbo lists and counters (writers only)
+    std::vector<Retired> limbo[3];     // Indexed by retire epoch % 3
+    Stats stats;
+
+    // Per-thread record of the slot a thread claimed, released when the thread exits.
+    // Threads that pin must not outlive the manager.
+    struct Registration {
+        EpochManager* owner = nullptr;
+        int index = -1;
+        ~Registration() {
+            if (owner != nullptr) {
+                owner->slots[index].in_use.store(false, std::memory_order_release);
+            }
+        }
+    };
+    static Registration& registration() {
+        thread_local Registration reg;
+        return reg;
+    }
+
+    int slot_index();                  // Slot of the calling thread, claimed on first use
+    bool try_advance_locked();
+    void reclaim_locked(uint64_t epoch);
+
+public:
+    EpochManager() : global_epoch(0), stats() {}
+    ~EpochManager();
+
+    void pin();
+    void unpin();
+
+    template <typename T>
+    void retire(const T* ptr, size_t bytes = sizeof(T)) {
+        retire_raw(const_cast<T*>(ptr), [](void* p) { delete static_cast<T*>(p); }, bytes);
+    }
+    void retire_raw(void* ptr, void (*deleter)(void*), size_t bytes);
+    void collect();                    // Advances and reclaims as far as readers allow
+    Stats get_stats();
+};
+
+// Pins an epoch manager (if any) for the lifetime of a scope
+class EpochGuard {
+private:
+    EpochManager* epochs;
+
+public:
+    explicit EpochGuard(EpochManager* e) : epochs(e) {
+        if (epochs != nullptr) {
+            epochs->pin();
+        }
+    }
+    ~EpochGuard() {
+        if (epochs != nullptr) {
+            epochs->unpin();
+        }
+    }
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+};
+
+int EpochManager::slot_index() {
+    Registration& reg = registration();
+    if (reg.owner == this) {
+        return reg.index;
+    }
+    for (int i = 0; i < MAX_THREADS; ++i) {
+        bool expected = false;
+        if (slots[i].in_use.compare_exchange_strong(expected, true)) {
+            if (reg.owner != nullptr) {
+                reg.owner->slots[reg.index].in_use.store(false, std::memory_order_release);
+            }
+            reg.owner = this;
+            reg.index = i;
+            return i;
+        }
+    }
+    std::cerr << "EpochManager: more than " << MAX_THREADS << " threads" << std::endl;
+    std::abort();
+}
+
+void EpochManager::pin() {
+    ThreadSlot& slot = slots[slot_index()];
+    slot.epoch.store(global_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst); // Publish the pin before any shared read
+}
+
+void EpochManager::unpin() {
+    slots[slot_index()].epoch.store(INACTIVE, std::memory_order_release);
+}
+
+// Advances the global epoch if every pinned thread has seen the current one
+bool EpochManager::try_advance_locked() {
+    uint64_t current = global_epoch.load(std::memory_order_acquire);
+    for (int i = 0; i < MAX_THREADS; ++i) {
+        uint64_t pinned = slots[i].epoch.load(std::memory_order_acquire);
+        if (pinned != INACTIVE && pinned != current) {
+            stats.stalled++;
+            return false;
+        }
+    }
+    global_epoch.store(current + 1, std::memory_order_release);
+    stats.advances++;
+    // Objects retired two epochs ago can no longer be reachable by any reader
+    if (current + 1 >= 2) {
+        reclaim_locked(current + 1 - 2);
+    }
+    return true;
+}
+
+void EpochManager::reclaim_locked(uint64_t epoch) {
+    std::vector<Retired>& list = limbo[epoch % 3];
+    for (const Retired& item : list) {
+        item.deleter(item.ptr);
+        stats.freed++;
+        stats.backlog_objects--;
+        stats.backlog_bytes -= item.bytes;
+    }
+    list.clear();
+}
+
+void EpochManager::retire_raw(void* ptr, void (*deleter)(void*), size_t bytes) {
+    std::lock_guard<std::mutex> lock(limbo_mutex);
+    uint64_t epoch = global_epoch.load(std::memory_order_acquire);
+    limbo[epoch % 3].push_back({ptr, deleter, bytes});
+    stats.retired++;
+    stats.backlog_objects++;
+    stats.backlog_bytes += bytes;
+    stats.peak_backlog_bytes = std::max(stats.peak_backlog_bytes, stats.backlog_bytes);
+    if (stats.backlog_bytes > MAX_BACKLOG_BYTES) {
+        // Two advances move this epoch's list out of reach
+        if (try_advance_locked()) {
+            try_advance_locked();
+        }
+    }
+}
+
+void EpochManager::collect() {
+    std::lock_guard<std::mutex> lock(limbo_mutex);
+    for (int i = 0; i < 3 && stats.backlog_objects > 0; ++i) {
+        if (!try_advance_locked()) {
+            break;
+        }
+    }
+}
+
+EpochManager::Stats EpochManager::get_stats() {
+    std::lock_guard<std::mutex> lock(limbo_mutex);
+    Stats copy = stats;
+    copy.global_epoch = global_epoch.load();
+    return copy;
+}
+
+// No readers can outlive the manager, so everything left is freed
+EpochManager::~EpochManager() {
+    if (registration().owner == this) {
+        registration().owner = nullptr;
+    }
+    for (auto& list : limbo) {
+        for (const Retired& item : list) {
+            item.deleter(item.ptr);
+        }
+        list.clear();
+    }
+}
+
+// Full guest strings of an occupied room, published through an atomic pointer.
+// Immutable once published: a change publishes a new object and retires the old one.
+struct GuestStrings {
+    GuestString name;
+    GuestString address;
+    GuestString phone;
+};
+
+// Fixed-size copy of the fields point reads need, so a reader can copy it
+// under a seqlock without touching any heap-allocated string
+struct HotRoomRecord {
+    int32_t room_no;   // 0 when the room is vacant
+    int32_t flags;     // 1 = arrived, 2 = due out, 4 = no show
+    int64_t days;
+    int64_t cost;
+    int64_t food_bill;
+    int64_t arrival_date;
+    int64_t nights_posted;
+    int64_t room_charges;
+    int64_t folio_totals[2];   // Guest folio and company folio
+    char rtype[16];
+    char name[64];
+    char address[64];
+    char phone[24];
+    char company[32];          // Payer of the company folio, empty if none
+};
+
+// Per-room seqlocked copies of the hot record, one cache-line aligned slot per room.
+// Writers (the front desk) refresh a slot after every change; readers such as
+// display_room and check_room_status copy it and retry only on a concurrent write.
+// The guest strings are the only heap objects readers reach, so they are the
+// only ones reclaimed through epochs; rooms_map and the indexes are used by
+// the desk thread alone and are freed directly.
+class HotRoomTable {
+public:
+    static const int MAX_ROOMS = 100;
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> sequence;
+        std::atomic<const GuestStrings*> guest; // Reclaimed through the EpochManager
+        HotRoomRecord record;
+
+        Slot() : sequence(0), guest(nullptr), record() {}
+    };
+    Slot slots[MAX_ROOMS + 1];
+    EpochManager* epochs;
+
+public:
+    explicit HotRoomTable(EpochManager* e = nullptr) : epochs(e) {}
+    ~HotRoomTable() {
+        for (auto& slot : slots) {
+            delete slot.guest.load();
+        }
+    }
+
+    // Replaces the guest strings of a room; the old copy is retired, not freed,
+    // because a concurrent reader may still be copying it
+    void store_guest(int r_no, const GuestStrings* guest) {
+        const GuestStrings* old = slots[r_no].guest.exchange(guest, std::memory_order_acq_rel);
+        if (old != nullptr) {
+            if (epochs != nullptr) {
+                epochs->retire(old, sizeof(GuestStrings) + old->name.capacity() +
+                                    old->address.capacity() + old->phone.capacity());
+            } else {
+                delete old;
+            }
+        }
+    }
+    // Returns the published guest strings of a room, or nullptr. Readers hold
+    // an EpochGuard from pin() while they use them; the desk, the only writer,
+    // may look without one.
+    const GuestStrings* guest(int r_no) const {
+        return slots[r_no].guest.load(std::memory_order_acquire);
+    }
+    EpochManager* pin() const { return epochs; }
+    void store(int r_no, const HotRoomRecord& record) {
+        Slot& slot = slots[r_no];
+        seqlock_write_begin(slot.sequence);
+        std::memcpy(static_cast<void*>(&slot.record), &record, sizeof(record));
+        seqlock_write_end(slot.sequence);
+    }
+    HotRoomRecord load(int r_no) const {
+        return seqlock_read(slots[r_no].sequence, slots[r_no].record);
+    }
+    void clear(int r_no) {
+        store(r_no, HotRoomRecord());
+        store_guest(r_no, nullptr);
+    }
+};
+
+// Fields tracked by the audit trail
+enum AuditField {
+    AUDIT_NAME = 1,
+    AUDIT_ADDRESS = 2,
+    AUDIT_PHONE = 3,
+    AUDIT_DAYS = 4
+};
+
+static const char* const AUDIT_FIELD_NAMES[] = { "?", "Name", "Address", "Phone", "Days" };
+
+// LEB128 varint helpers shared by the audit trail and the stay archive
+template <typename Str>
+static void put_varint(Str& buf, uint64_t value) {
+    while (value >= 0x80) {
+        buf += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    buf += static_cast<char>(value);
+}
+
+static bool get_varint(const std::string& buf, size_t& pos, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && pos < buf.size(); shift += 7) {
+        unsigned char byte = static_cast<unsigned char>(buf[pos++]);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// A decoded audit record
+struct AuditEntry {
+    long timestamp;
+    std::string terminal;
+    int room_no;
+    int field;
+    std::string old_value;
+    std::string new_value;
+};
+
+// Append-only audit trail of field-level changes.
+//
+// Records are varint encoded and every string (terminal, old and new value) is
+// written once and referred to by id afterwards. Each committed edit is written
+// as one block ("block marker, varint length, payload") before record returns,
+// so a crash cannot lose an edit the desk has already confirmed. A sparse index
+// maps each room to the offsets of the blocks that mention it, so a query reads
+// only those blocks.
+class AuditTrail {
+private:
+    enum { OP_STRING = 0, OP_CHANGE = 1 };
+    static const unsigned char BLOCK_MARKER = 0xB1;
+
+    std::string path;
+    TrackedString<MEM_AUDIT_BUFFER> pending;                 // Encoded edit not yet written
+    TrackedVector<int, MEM_AUDIT_BUFFER> pending_rooms;      // Rooms mentioned in pending
+    TrackedMap<std::string, uint64_t, MEM_INDEXES> string_ids;
+    TrackedVector<std::string, MEM_INDEXES> strings;     // id -> string
+    TrackedMap<int, TrackedVector<long, MEM_INDEXES>, MEM_INDEXES> room_blocks; // Sparse index: room -> block offsets
+    long file_size;
+
+    uint64_t intern(const std::string& str);
+    bool decode_block(const std::string& payload, long offset, int room_filter, std::vector<AuditEntry>* out);
+
+public:
+    AuditTrail() : file_size(0) {}
+    ~AuditTrail() { flush(); }
+
+    void open(const std::string& file);   // Scans the log to rebuild strings and index
+    void record(int room_no, int field, const std::string& old_value, const std::string& new_value,
+                const std::string& terminal);
+    void flush();                          // Writes the pending edit as one block
+    std::vector<AuditEntry> query(int room_no);
+};
+
+// Returns the id of a string, emitting its definition on first use
+uint64_t AuditTrail::intern(const std::string& str) {
+    auto it = string_ids.find(str);
+    if (it != string_ids.end()) {
+        return it->second;
+    }
+    uint64_t id = strings.size();
+    strings.push_back(str);
+    string_ids[str] = id;
+    put_varint(pending, OP_STRING);
+    put_varint(pending, str.size());
+    pending += str;
+    return id;
+}
+
+// Decodes one block. String definitions are always applied; change records
+// for room_filter (or every room if room_filter is 0) are appended to out,
+// and the block offset is added to the sparse index when out is null.
+bool AuditTrail::decode_block(const std::string& payload, long offset, int room_filter, std::vector<AuditEntry>* out) {
+    size_t pos = 0;
+    while (pos < payload.size()) {
+        uint64_t op;
+        if (!get_varint(payload, pos, op)) {
+            return false;
+        }
+        if (op == OP_STRING) {
+            uint64_t len;
+            if (!get_varint(payload, pos, len) || pos + len > payload.size()) {
+                return false;
+            }
+            std::string str = payload.substr(pos, len);
+            pos += len;
+            if (string_ids.find(str) == string_ids.end()) {
+                string_ids[str] = strings.size();
+                strings.push_back(str);
+            }
+        } else if (op == OP_CHANGE) {
+            uint64_t ts, term, room, field, old_id, new_id;
+            if (!get_varint(payload, pos, ts) || !get_varint(payload, pos, term) || !get_varint(payload, pos, room) ||
+                !get_varint(payload, pos, field) || !get_varint(payload, pos, old_id) ||
+                !get_varint(payload, pos, new_id) || term >= strings.size() || old_id >= strings.size() ||
+                new_id >= strings.size()) {
+                return false;
+            }
+            if (out == nullptr) {
+                TrackedVector<long, MEM_INDEXES>& blocks = room_blocks[static_cast<int>(room)];
+                if (blocks.empty() || blocks.back() != offset) {
+                    blocks.push_back(offset);
+                }
+            } else if (room_filter == 0 || static_cast<int>(room) == room_filter) {
+                out->push_back({static_cast<long>(ts), strings[term], static_cast<int>(room),
+                                static_cast<int>(field), strings[old_id], strings[new_id]});
+            }
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Function to open the audit log and rebuild the string table and sparse index
+void AuditTrail::open(const std::string& file) {
+    path = file;
+    std::ifstream fin(path, std::ios::in | std::ios::binary);
+    if (!fin.is_open()) {
+        return;
+    }
+    std::string data((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+    size_t pos = 0;
+    while (pos < data.size()) {
+        long offset = static_cast<long>(pos);
+        uint64_t len;
+        if (static_cast<unsigned char>(data[pos]) != BLOCK_MARKER) {
+            break;
+        }
+        pos++;
+        if (!get_varint(data, pos, len) || pos + len > data.size()) {
+            break;
+        }
+        if (!decode_block(data.substr(pos, len), offset, 0, nullptr)) {
+            break;
+        }
+        pos += len;
+    }
+    if (pos < data.size()) {
+        // New blocks are appended, so the tail is cut off rather than skipped
+        std::cerr << "\n Warning: " << path << " has a damaged tail; it is dropped." << std::endl;
+        std::error_code ec;
+        std::filesystem::resize_file(path, pos, ec);
+    }
+    file_size = static_cast<long>(pos);
+}
+
+// Function to record one field change: it is encoded together with any new
+// strings and written as one block
+void AuditTrail::record(int room_no, int field, const std::string& old_value, const std::string& new_value,
+                        const std::string& terminal) {
+    uint64_t term_id = intern(terminal);
+    uint64_t old_id = intern(old_value);
+    uint64_t new_id = intern(new_value);
+    put_varint(pending, OP_CHANGE);
+    put_varint(pending, static_cast<uint64_t>(std::time(nullptr)));
+    put_varint(pending, term_id);
+    put_varint(pending, static_cast<uint64_t>(room_no));
+    put_varint(pending, static_cast<uint64_t>(field));
+    put_varint(pending, old_id);
+    put_varint(pending, new_id);
+    pending_rooms.push_back(room_no);
+    flush();
+}
+
+// Function to write the pending records as one block and index it
+void AuditTrail::flush() {
+    if (pending.empty() || path.empty()) {
+        return;
+    }
+    std::string header(1, static_cast<char>(BLOCK_MARKER));
+    put_varint(header, pending.size());
+    std::ofstream fout(path, std::ios::out | std::ios::binary | std::ios::app);
+    if (!fout.write(header.data(), header.size()) || !fout.write(pending.data(), pending.size())) {
+        std::cerr << "\n Error: Could not write to " << path << std::endl;
+        return;
+    }
+    for (int room_no : pending_rooms) {
+        TrackedVector<long, MEM_INDEXES>& blocks = room_blocks[room_no];
+        if (blocks.empty() || blocks.back() != file_size) {
+            blocks.push_back(file_size);
+        }
+    }
+    file_size += static_cast<long>(header.size() + pending.size());
+    pending.clear();
+    pending_rooms.clear();
+}
+
+// Function to return every change recorded for a room, oldest first
+std::vector<AuditEntry> AuditTrail::query(int room_no) {
+    flush();
+    std::vector<AuditEntry> result;
+    auto it = room_blocks.find(room_no);
+    if (it == room_blocks.end()) {
+        return result;
+    }
+    std::ifstream fin(path, std::ios::in | std::ios::binary);
+    for (long offset : it->second) {
+        fin.seekg(offset + 1); // Skip the block marker
+        std::string len_bytes;
+        char byte;
+        while (fin.get(byte)) {
+            len_bytes += byte;
+            if ((static_cast<unsigned char>(byte) & 0x80) == 0) {
+                break;
+            }
+        }
+        size_t pos = 0;
+        uint64_t len;
+        if (!get_varint(len_bytes, pos, len)) {
+            break;
+        }
+        std::string payload(len, '\0');
+        if (!fin.read(&payload[0], len)) {
+            break;
+        }
+        decode_block(payload, offset, room_no, &result);
+    }
+    return result;
+}
+
+// 64-bit string hash with well mixed high bits (std::hash may be the identity
+// on some inputs, so its result goes through the splitmix64 finalizer)
+static uint64_t hash_string64(const std::string& key) {
+    uint64_t h = std::hash<std::string>()(key) + 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+// Blocked Bloom filter over guest keys. Each key maps to one cache-line sized
+// block of eight 64-bit words and sets one bit in every word, so a probe
+// touches a single cache line. The eight bit positions are derived from the
+// key hash with eight odd multipliers and tested together with vector
+// operations (GCC vector extensions, lowered to SSE2/AVX as available).
+class GuestBloomFilter {
+public:
+    typedef uint64_t BlockLanes __attribute__((vector_size(64)));
+    typedef uint32_t HashLanes __attribute__((vector_size(32)));
+
+    struct alignas(64) Block {
+        BlockLanes words;
+    };
+
+    static const size_t BITS_PER_KEY = 16;   // ~0.1% false positives with 8 bits per key set
+    static const size_t MIN_BLOCKS = 64;
+
+private:
+    TrackedVector<Block, MEM_INDEXES> blocks;
+    size_t keys;
+
+    static void key_mask(uint32_t hash, BlockLanes& mask) {
+        const HashLanes SALT = { 0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+                                 0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U };
+        HashLanes bit = (hash * SALT) >> 26; // Top 6 bits: bit position within each word
+        BlockLanes ones = BlockLanes{} + 1;
+        mask = ones << __builtin_convertvector(bit, BlockLanes);
+    }
+    // Maps the high half of the hash onto the block range without a division
+    size_t block_index(uint64_t hash) const {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(hash >> 32)) * blocks.size()) >> 32;
+    }
+
+public:
+    GuestBloomFilter() : blocks(MIN_BLOCKS, Block()), keys(0) {}
+
+    static uint64_t hash_key(const std::string& key) { return hash_string64(key); }
+
+    // Clears the filter and sizes it for the given number of keys
+    void reset(size_t expected_keys) {
+        size_t wanted = expected_keys * BITS_PER_KEY / 512 + 1;
+        if (wanted < MIN_BLOCKS) {
+            wanted = MIN_BLOCKS;
+        }
+        blocks.assign(wanted, Block());
+        keys = 0;
+    }
+    void add(uint64_t hash) {
+        BlockLanes mask;
+        key_mask(static_cast<uint32_t>(hash), mask);
+        blocks[block_index(hash)].words |= mask;
+        keys++;
+    }
+    bool may_contain(uint64_t hash) const {
+        BlockLanes mask;
+        key_mask(static_cast<uint32_t>(hash), mask);
+        BlockLanes missing = mask & ~blocks[block_index(hash)].words;
+        uint64_t any = 0;
+        for (int i = 0; i < 8; ++i) {
+            any |= missing[i];
+        }
+        return any == 0;
+    }
+    // True once the filter holds more keys than it was sized for
+    bool overfull() const { return keys * BITS_PER_KEY > blocks.size() * 512; }
+    size_t key_count() const { return keys; }
+    size_t bytes() const { return blocks.size() * sizeof(Block); }
+};
+
+// Bounded, time-expiring table of request results keyed by idempotency key,
+// so a retried mutation returns its original result instead of running twice.
+//
+// Keys are not stored: a 64-bit hash picks a bucket of eight slots (one cache
+// line of 32-bit fingerprints and expiry times) and its high half is the
+// fingerprint. Two keys collide only if both hashes agree on the bucket and
+// the fingerprint. A full bucket evicts with the clock algorithm: the hand
+// skips (and clears) recently hit slots and never evicts a request still in
+// progress. Entries expire after the TTL.
+class IdempotencyTable {
+public:
+    enum Status { MISS, PENDING, DONE };
+    static const int WAYS = 8;
+
+    struct Stats {
+        long hits;
+        long misses;
+        long evictions;
+        long expirations;
+    };
+
+private:
+    struct alignas(64) Bucket {
+        uint32_t fingerprints[WAYS]; // 0 = empty
+        uint32_t expires[WAYS];      // Seconds since the table was created
+    };
+
+    TrackedVector<Bucket, MEM_INDEXES> buckets;
+    TrackedVector<std::string, MEM_INDEXES> results; // bucket * WAYS + way
+    TrackedVector<uint8_t, MEM_INDEXES> referenced;  // Clock bits, one per way
+    TrackedVector<uint8_t, MEM_INDEXES> pending;     // Started but not completed, one bit per way
+    TrackedVector<uint8_t, MEM_INDEXES> hands;       // Clock hand per bucket
+    uint32_t ttl_seconds;
+    std::chrono::steady_clock::time_point origin;
+    Stats stats;
+    std::ofstream log; // Completed results, so retries after a restart are still answered
+
+    uint32_t now() const {
+        return static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - origin).count());
+    }
+    static uint32_t fingerprint(uint64_t hash) {
+        uint32_t fp = static_cast<uint32_t>(hash >> 32);
+        return fp == 0 ? 1 : fp;
+    }
+    size_t bucket_of(uint64_t hash) const { return static_cast<size_t>(hash) & (buckets.size() - 1); }
+    int find(size_t b, uint32_t fp, uint32_t t);
+    int claim(size_t b, uint32_t t); // Free, expired or clock-evicted way, or -1
+    void store(const std::string& key, const std::string& result, uint32_t expires);
+
+public:
+    // capacity is rounded up to a power-of-two number of buckets
+    IdempotencyTable(size_t capacity, uint32_t ttl)
+        : ttl_seconds(ttl), origin(std::chrono::steady_clock::now()), stats() {
+        size_t count = 1;
+        while (count * WAYS < capacity) {
+            count <<= 1;
+        }
+        buckets.assign(count, Bucket());
+        results.resize(count * WAYS);
+        referenced.assign(count, 0);
+        pending.assign(count, 0);
+        hands.assign(count, 0);
+    }
+
+    // Looks a key up; on DONE, result holds the original result
+    Status lookup(const std::string& key, std::string& result);
+    void begin(const std::string& key);                            // Marks a request in progress
+    void complete(const std::string& key, const std::string& result);
+    void forget(const std::string& key);                           // The request never ran; a retry may
+    // Loads the unexpired results logged in path, compacts it, and logs every later completion to it
+    void open(const std::string& path);
+    Stats get_stats() const { return stats; }
+    size_t capacity() const { return buckets.size() * WAYS; }
+};
+
+static const uint32_t DEFAULT_IDEMPOTENCY_TTL = 86400; // Seconds a request key is remembered
+
+// Parses HMS_IDEMPOTENCY_TTL (seconds); an invalid value warns and falls back to the default
+static uint32_t parse_idempotency_ttl() {
+    const char* ttl = std::getenv("HMS_IDEMPOTENCY_TTL");
+    if (ttl == nullptr) {
+        return DEFAULT_IDEMPOTENCY_TTL;
+    }
+    char* end = nullptr;
+    errno = 0;
+    long seconds = std::strtol(ttl, &end, 10);
+    if (end == ttl || *end != '\0' || errno == ERANGE || seconds < 0 || seconds > UINT32_MAX) {
+        std::cerr << " Warning: HMS_IDEMPOTENCY_TTL=" << ttl << " is not a number of seconds; using "
+                  << DEFAULT_IDEMPOTENCY_TTL << "." << std::endl;
+        return DEFAULT_IDEMPOTENCY_TTL;
+    }
+    return static_cast<uint32_t>(seconds);
+}
+
+// TTL of the request key tables. Shared by the desk and the partitioned server
+// (which also loads a desk), and parsed once so a bad value is reported once.
+static uint32_t idempotency_ttl_from_env() {
+    static const uint32_t ttl = parse_idempotency_ttl();
+    return ttl;
+}
+
+int IdempotencyTable::find(size_t b, uint32_t fp, uint32_t t) {
+    Bucket& bucket = buckets[b];
+    for (int w = 0; w < WAYS; ++w) {
+        if (bucket.fingerprints[w] != fp) {
+            continue;
+        }
+        if (bucket.expires[w] <= t && !(pending[b] & (1 << w))) {
+            bucket.fingerprints[w] = 0;
+            results[b * WAYS + w].clear();
+            stats.expirations++;
+            return -1;
+        }
+        return w;
+    }
+    return -1;
+}
+
+int IdempotencyTable::claim(size_t b, uint32_t t) {
+    Bucket& bucket = buckets[b];
+    for (int w = 0; w < WAYS; ++w) {
+        if (bucket.fingerprints[w] == 0 || (bucket.expires[w] <= t && !(pending[b] & (1 << w)))) {
+            return w;
+        }
+    }
+    for (int step = 0; step < 2 * WAYS; ++step) {
+        int w = hands[b];
+        hands[b] = static_cast<uint8_t>((w + 1) % WAYS);
+        if (pending[b] & (1 << w)) {
+            continue;
+        }
+        if (referenced[b] & (1 << w)) {
+            referenced[b] &= static_cast<uint8_t>(~(1 << w));
+            continue;
+        }
+        stats.evictions++;
+        return w;
+    }
+    return -1; // Every way is in progress
+}
+
+IdempotencyTable::Status IdempotencyTable::lookup(const std::string& key, std::string& result) {
+    uint64_t hash = hash_string64(key);
+    size_t b = bucket_of(hash);
+    int w = find(b, fingerprint(hash), now());
+    if (w < 0) {
+        stats.misses++;
+        return MISS;
+    }
+    stats.hits++;
+    referenced[b] |= static_cast<uint8_t>(1 << w);
+    if (pending[b] & (1 << w)) {
+        return PENDING;
+    }
+    result = results[b * WAYS + w];
+    return DONE;
+}
+
+void IdempotencyTable::begin(const std::string& key) {
+    uint64_t hash = hash_string64(key);
+    size_t b = bucket_of(hash);
+    uint32_t t = now();
+    int w = find(b, fingerprint(hash), t);
+    if (w < 0 && (w = claim(b, t)) < 0) {
+        return; // Bucket full of requests in progress: run without protection
+    }
+    buckets[b].fingerprints[w] = fingerprint(hash);
+    buckets[b].expires[w] = t + ttl_seconds;
+    results[b * WAYS + w].clear();
+    pending[b] |= static_cast<uint8_t>(1 << w);
+    referenced[b] &= static_cast<uint8_t>(~(1 << w));
+}
+
+void IdempotencyTable::complete(const std::string& key, const std::string& result) {
+    store(key, result, now() + ttl_seconds);
+    if (log.is_open()) {
+        // "<expiry (Unix time)> <key length> <key> <result length> <result>", flushed before the
+        // reply goes out; the lengths let a key or result hold any byte, newlines included
+        log << (std::time(nullptr) + ttl_seconds) << ' ' << key.size() << ' ' << key << ' ' << result.size() << ' '
+            << result << std::endl;
+    }
+}
+
+void IdempotencyTable::store(const std::string& key, const std::string& result, uint32_t expires) {
+    uint64_t hash = hash_string64(key);
+    size_t b = bucket_of(hash);
+    uint32_t t = now();
+    int w = find(b, fingerprint(hash), t);
+    if (w < 0 && (w = claim(b, t)) < 0) {
+        return;
+    }
+    buckets[b].fingerprints[w] = fingerprint(hash);
+    buckets[b].expires[w] = expires;
+    results[b * WAYS + w] = result;
+    pending[b] &= static_cast<uint8_t>(~(1 << w));
+}
+
+// Reads one "<length> <bytes>" field of a request log record and the separator after it
+static bool read_logged_field(std::istream& in, std::string& field, char separator) {
+    static const size_t MAX_FIELD = 1 << 20; // Guards against a damaged length
+    size_t size;
+    if (!(in >> size) || size > MAX_FIELD || in.get() != ' ') {
+        return false;
+    }
+    field.assign(size, '\0');
+    return (size == 0 || in.read(&field[0], static_cast<std::streamsize>(size))) && in.get() == separator;
+}
+
+void IdempotencyTable::open(const std::string& path) {
+    long wall_now = std::time(nullptr);
+    std::vector<std::pair<long, std::pair<std::string, std::string>>> kept; // Unexpired records, rewritten in order
+    long skipped = 0;
+    {
+        std::ifstream fin(path, std::ios::binary);
+        while (fin.peek() != std::ifstream::traits_type::eof()) {
+            long expires;
+            std::string key, result;
+            if (!(fin >> expires) || fin.get() != ' ' || !read_logged_field(fin, key, ' ') ||
+                !read_logged_field(fin, result, '\n')) {
+                ++skipped; // A record cut short by a crash, or damaged: resume at the next line
+                fin.clear();
+                fin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                continue;
+            }
+            if (expires > wall_now) {
+                store(key, result, now() + static_cast<uint32_t>(std::min<long>(expires - wall_now, ttl_seconds)));
+                kept.emplace_back(expires, std::make_pair(key, result));
+            }
+        }
+    }
+    if (skipped > 0) {
+        std::cerr << "\n Warning: Skipped " << skipped << " unreadable record(s) in " << path
+                  << "; those requests run again if retried." << std::endl;
+    }
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream fout(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+        for (const auto& entry : kept) {
+            const std::string& key = entry.second.first;
+            const std::string& result = entry.second.second;
+            fout << entry.first << ' ' << key.size() << ' ' << key << ' ' << result.size() << ' ' << result << '\n';
+        }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::cerr << "\n Warning: Could not compact " << path << "." << std::endl;
+    }
+    log.open(path, std::ios::out | std::ios::app);
+    if (!log.is_open()) {
+        std::cerr << "\n Warning: Could not open " << path << "; request keys will not survive a restart."
+                  << std::endl;
+    }
+}
+
+void IdempotencyTable::forget(const std::string& key) {
+    uint64_t hash = hash_string64(key);
+    size_t b = bucket_of(hash);
+    int w = find(b, fingerprint(hash), now());
+    if (w >= 0) {
+        buckets[b].fingerprints[w] = 0;
+        results[b * WAYS + w].clear();
+        pending[b] &= static_cast<uint8_t>(~(1 << w));
+    }
+}
+
+// One stay as written to the archive at checkout
+struct ArchivedStay {
+    long checkout_date;
+    long arrival_date;
+    int room_no;
+    long nights;
+    long room_charges;
+    long food_bill;
+    long total;
+    std::string name;
+    std::string address;
+    std::string phone;
+    std::string group_code;
+};
+
+// Per-month totals kept for stays older than the cold tier
+struct MonthlyStayAggregate {
+    long month; // Months since 1970-01
+    long stays;
+    long nights;
+    long room_charges;
+    long food_bill;
+    long total;
+
+    MonthlyStayAggregate() : month(0), stays(0), nights(0), room_charges(0), food_bill(0), total(0) {}
+};
+
+// Paces background archive I/O to a byte rate (token bucket refilled from the
+// wall clock) so compaction never competes with the front desk for the disk
+class IoThrottle {
+private:
+    long bytes_per_second;
+    std::chrono::steady_clock::time_point start;
+    long bytes_done;
+    const std::atomic<bool>* stop;
+
+public:
+    IoThrottle(long rate, const std::atomic<bool>* stop_flag)
+        : bytes_per_second(rate), start(std::chrono::steady_clock::now()), bytes_done(0), stop(stop_flag) {}
+
+    // Accounts for bytes about to be transferred, sleeping until the rate allows
+    // it; returns false if the owner asked the transfer to stop
+    bool pace(size_t bytes);
+    long bytes() const { return bytes_done; }
+};
+
+// Tiered archive of checked-out stays.
+//
+// Hot tier: stays checked out in the last HOT_DAYS days, in full detail in an
+// append-only file. Cold tier: older stays compacted into immutable segments
+// (sorted by checkout, delta and varint encoded, strings stored once per
+// segment). Ancient tier: stays older than ANCIENT_DAYS survive only as
+// monthly aggregates. Compaction runs on a background thread with throttled
+// I/O and takes the archive lock only to swap the result in.
+//
+// Every compaction bumps the archive generation. Segment and aggregate files
+// are named after the generation that created them and the hot file header
+// records the current one, so files left behind by an interrupted compaction
+// are recognised and removed on open.
+//
+// An in-memory index maps each guest key (the digits of the phone number) to
+// the locations of that guest's hot and cold stays, and a blocked Bloom filter
+// in front of it answers "has this guest ever stayed" for the common new-guest
+// case without a hash lookup or a disk read.
+class StayArchive {
+public:
+    static const long HOT_DAYS = 90;      // Full-detail retention
+    static const long ANCIENT_DAYS = 730; // Beyond this only monthly aggregates remain
+
+    // Result of the most recent compaction, for the retention report
+    struct CompactionStats {
+        long generation;
+        long stays_compacted;
+        long stays_aggregated;
+        long bytes_in;
+        long bytes_out;
+        double seconds;
+        double lock_ms; // Time the archive lock was held to swap the result in
+
+        CompactionStats() : generation(0), stays_compacted(0), stays_aggregated(0), bytes_in(0), bytes_out(0),
+                            seconds(0), lock_ms(0) {}
+    };
+
+private:
+    static const long FILE_MAGIC = 0x32414d48;        // "HMA2": magic, generation, records
+    static const long LEGACY_FILE_MAGIC = 0x41534d48; // "HMSA": magic, records
+    static const long SEGMENT_MAGIC = 0x43534d48;     // "HMSC"
+    static const long AGGREGATE_MAGIC = 0x47534d48;   // "HMSG"
+    static const long HOT_SEGMENT = 0;                // Location segment id of the hot file
+
+    // Where a stay lives: the hot file (position = byte offset) or a cold
+    // segment (segment = its generation, position = record ordinal)
+    struct StayLocation {
+        long segment;
+        long position;
+    };
+    struct SegmentInfo {
+        long stays;
+        long first_checkout;
+        long last_checkout;
+        long bytes;
+    };
+
+    std::string path;
+    std::string segment_dir;
+    long header_size;
+    long file_size;
+    long generation;
+    long aggregate_generation; // Generation of the aggregate file in use, -1 if none
+    GuestBloomFilter filter;
+    TrackedMap<std::string, TrackedVector<StayLocation, MEM_INDEXES>, MEM_INDEXES> guest_index; // Guest key -> stays
+    TrackedMap<long, SegmentInfo, MEM_INDEXES> segments;              // Cold segments by generation
+    TrackedMap<long, MonthlyStayAggregate, MEM_INDEXES> monthly;      // Ancient tier by month
+    size_t probes, filtered, false_positives;
+    long compact_rate; // Bytes per second for background compaction I/O
+    CompactionStats last_compaction;
+    mutable std::mutex mutex; // Guards all of the above against the compactor
+    std::thread compactor;
+    std::atomic<bool> compacting;
+    std::atomic<bool> stop_compaction;
+
+    std::string segment_file(long gen) const;
+    std::string aggregate_file(long gen) const;
+    void index_stay(const std::string& key, StayLocation location);
+    void rebuild_filter();
+    bool load_segment(long gen, std::vector<ArchivedStay>& stays, SegmentInfo* info) const;
+    void compact(long today);
+
+public:
+    StayArchive()
+        : header_size(0), file_size(0), generation(0), aggregate_generation(-1), probes(0), filtered(0), false_positives(0),
+          compact_rate(2 << 20), compacting(false), stop_compaction(false) {}
+    ~StayArchive();
+
+    template <typename Str>
+    static std::string guest_key(const Str& phone); // Digits of a phone number
+
+    // Opens the hot file and the tier directory, rebuilding the index and filter
+    void open(const std::string& file, const std::string& tier_dir);
+    void append(const RoomData& room, long checkout_date);
+    // Returns whether the guest has stayed before, reading their stays into out if given
+    bool lookup(const std::string& phone, std::vector<ArchivedStay>* out);
+    // Starts a background compaction as of the given business date unless one is running
+    bool start_compaction(long today);
+    bool compaction_running() const { return compacting; }
+    void print_stats(std::ostream& out) const;
+    void print_retention(std::ostream& out) const;
+};
+
+// Rooms of one type held for a travel agent or corporate over a range of
+// nights. Each night's unsold count is its own atomic, so bookings draw and
+// restore from any thread without a lock on the room table.
+struct AllotmentBlock {
+    std::string agent; // Channel name or group / company code
+    int room_type;     // Index into ROOM_TYPE_RANGES
+    long first_night;
+    long last_night;   // Inclusive
+    long count;        // Rooms contracted per night
+    long release_days; // Unsold rooms go back to general sale this many days before each night
+    long released_through; // Last night already released (first_night - 1 if none); desk thread only
+    long released_rooms;   // Unsold room-nights given back so far
+    std::unique_ptr<std::atomic<long>[]> remaining; // Unsold rooms, one counter per night
+
+    long nights() const { return last_night - first_night + 1; }
+};
+
+// The allotment blocks on contract. Blocks are appended by the desk thread
+// into a fixed array and published through an atomic count, so other threads
+// (the channel validator) can scan them without a lock; blocks are never
+// removed while the process runs.
+class AllotmentBook {
+public:
+    static const int MAX_BLOCKS = 256;
+
+private:
+    std::unique_ptr<AllotmentBlock> blocks[MAX_BLOCKS];
+    std::atomic<int> published;
+
+    // Index of the agent's block of a type covering a night, or -1
+    int find(const std::string& agent, int room_type, long night) const;
+
+public:
+    AllotmentBook() : published(0) {}
+
+    // Adds a block (desk thread); false with a reason if it is invalid, overlaps
+    // another block of the same agent and type, or the book is full
+    bool add(const std::string& agent, int room_type, long first_night, long last_night, long count,
+             long release_days, std::string& error);
+    // Takes one room on each night of a stay from the agent's block: all nights
+    // or none. False if there is no block covering the stay or a night is sold out.
+    bool draw(const std::string& agent, int room_type, long arrival, long nights);
+    // Gives back the nights [from, to) of a stay drawn from the agent's block;
+    // nights already released stay released
+    void restore(const std::string& agent, int room_type, long from, long to);
+    // Unsold rooms of a type held back from general sale on a night
+    long held(int room_type, long night) const;
+    // Release-back job: returns unsold rooms of every night within its block's
+    // release window to general sale. Returns the room-nights released; summary
+    // lists "<agent> <type> <from>..<to> rooms=<n>" for each block, comma separated.
+    long release_due(long today, std::string& summary);
+    bool load(const std::string& file, long today);
+    void save(const std::string& file) const;
+    void print(std::ostream& out, long today) const;
+};
+
+// Outcome of loading a saved aggregate. A missing file is rebuilt from the
+// room table; a damaged one is left alone and the desk refuses to start.
+enum AggregateLoad {
+    AGGREGATE_LOADED,
+    AGGREGATE_MISSING,
+    AGGREGATE_DAMAGED
+};
+
+// Revenue posted per business date for each room type and charge category,
+// held in Fenwick (binary indexed) trees: the total between any two dates is
+// the difference of two prefix sums, O(log D) however long the history. Dates
+// are offsets from an origin; when a date falls outside the trees they are
+// rebuilt, doubled, from the daily amounts kept beside them.
+class RevenueIndex {
+private:
+    long origin; // Business date at offset 0, -1 while empty
+    TrackedVector<long, MEM_INDEXES> daily[ROOM_TYPE_COUNT][CHARGE_CATEGORY_COUNT];
+    TrackedVector<long, MEM_INDEXES> trees[ROOM_TYPE_COUNT][CHARGE_CATEGORY_COUNT];
+
+    size_t size() const { return daily[0][0].size(); }
+    void rebuild(long new_origin, size_t new_size);
+    long prefix(int type, int category, long date) const; // Sum over dates before date
+
+public:
+    RevenueIndex() : origin(-1) {}
+
+    void post(int type, int category, long date, long amount);
+    // Revenue of a room type (-1 for all) and category on the dates [from, to]
+    long range(int type, int category, long from, long to) const;
+    long first_date() const { return origin; }
+    AggregateLoad load(const std::string& file);
+    void save(const std::string& file) const;
+};
+
+// Measures of one cell of the occupancy cube
+struct CubeMeasures {
+    long room_nights;
+    long revenue;      // All charges
+    long food_revenue;
+
+    CubeMeasures() : room_nights(0), revenue(0), food_revenue(0) {}
+};
+
+// Rollup cube of room-nights and revenue by room type, floor, wing, channel
+// and business date (the stay night for room-nights, the posting date for
+// revenue). Each fact is added to all 32 group-bys of the five dimensions, so
+// a slice that fixes any of them and leaves the rest as ALL is one hash lookup;
+// a date range costs one lookup per day with facts. Only base cells are saved.
+class OccupancyCube {
+public:
+    enum { ALL = -1 };
+
+private:
+    static const int MAX_CHANNELS = 64; // Channel ids fit the key; the last one collects the overflow
+    TrackedMap<uint64_t, CubeMeasures, MEM_INDEXES> cells;
+    std::vector<std::string> channels; // Channel id -> name; 0 is the front desk
+    long first_date; // Earliest and latest dates with facts, -1 while empty
+    long last_date;
+
+    static uint64_t key(int type, int floor, int wing, int channel, long date);
+    void add(int type, int floor, int wing, int channel, long date, const CubeMeasures& delta);
+
+public:
+    OccupancyCube() : channels(1, "Desk"), first_date(-1), last_date(-1) {}
+
+    int channel_id(const std::string& name); // Interns a channel name
+    int find_channel(const std::string& name) const; // -1 if unknown
+    int channel_of(const RoomData& room);
+    const std::vector<std::string>& channel_names() const { return channels; }
+    size_t cell_count() const { return cells.size(); }
+
+    // Adds (sign 1) or removes (sign -1) the booked nights [from, to) of a room
+    void add_nights(const RoomData& room, long from, long to, int sign);
+    void add_charge(const RoomData& room, int category, long date, long amount);
+    // Totals of the cells matching each dimension (ALL for any) on the dates [from, to]; from ALL for all dates
+    CubeMeasures slice(int type, int floor, int wing, int channel, long from, long to) const;
+    AggregateLoad load(const std::string& file);
+    void save(const std::string& file) const;
+};
+
+// Rooms expected to arrive and to depart, bucketed by business date, so a
+// day's lists cost O(rooms listed) rather than a scan of the room table. A
+// room departs on arrival_date + days; buckets are kept in room number order
+// and dropped once empty. The version changes with every update.
+class MovementIndex {
+private:
+    typedef TrackedMap<long, TrackedVector<int, MEM_INDEXES>, MEM_INDEXES> Buckets;
+    Buckets arrivals;
+    Buckets departures;
+    uint64_t changes;
+
+    static void insert(Buckets& buckets, long date, int r_no);
+    static void erase(Buckets& buckets, long date, int r_no);
+    static const TrackedVector<int, MEM_INDEXES>* find(const Buckets& buckets, long date);
+
+public:
+    MovementIndex() : changes(0) {}
+
+    void add(const RoomData& room);
+    void remove(const RoomData& room);
+    void move_departure(int r_no, long from, long to);
+    const TrackedVector<int, MEM_INDEXES>* arriving(long date) const { return find(arrivals, date); } // nullptr if none
+    const TrackedVector<int, MEM_INDEXES>* departing(long date) const { return find(departures, date); }
+    uint64_t version() const { return changes; }
+};
+
+// Bounded blocking hand-off between two pipeline stages. A full queue stalls
+// the producer (backpressure); close() releases both sides for shutdown.
+template <typename T>
+class StageQueue {
+private:
+    std::mutex mutex;
+    std::condition_variable not_empty, not_full;
+    std::deque<T> items;
+    size_t capacity;
+    bool closed;
+
+public:
+    explicit StageQueue(size_t cap) : capacity(cap), closed(false) {}
+
+    // Waits for room; false if the queue was closed
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this]() { return closed || items.size() < capacity; });
+        if (closed) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+        return true;
+    }
+    // Waits for an item; false once the queue is closed and drained
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this]() { return closed || !items.empty(); });
+        return take(item);
+    }
+    bool try_pop(T& item) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return take(item);
+    }
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+private:
+    bool take(T& item) {
+        if (items.empty()) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+};
+
+// One reservation from a channel manager drop file
+struct ChannelBooking {
+    int line_no;
+    std::string booking_id; // The channel's reference, unique within the channel
+    std::string channel;
+    std::string rtype;
+    long arrival_date;
+    long nights;
+    std::string name;
+    std::string phone;
+    std::string address;
+    bool duplicate;    // Its reference was already taken
+    bool claimed;      // Its reference was added to the dedupe set by validation
+    bool from_allotment; // Drawn from the channel's allotment block by validation
+    int room_no;       // Allocated room, 0 if none
+    std::string error; // Why it was not booked
+
+    ChannelBooking()
+        : line_no(0), arrival_date(0), nights(0), duplicate(false), claimed(false), from_allotment(false), room_no(0) {}
+    std::string ref() const { return channel + ":" + booking_id; }
+};
+
+// A drop file on its way through the pipeline
+struct ChannelBatch {
+    std::string file; // Name of the file, now under the processing directory
+    std::vector<ChannelBooking> bookings;
+    double parse_ms;
+    double validate_ms;
+
+    ChannelBatch() : parse_ms(0), validate_ms(0) {}
+};
+
+// Channel manager ingestion. Travel agencies drop reservation files into a
+// directory; a scanner thread claims and parses them, a validator thread
+// dedupes them against every reservation already taken (a hash set of
+// "<channel>:<booking id>", seeded from the ledger and the room table) and
+// validates them, and the desk thread allocates rooms and commits each file
+// as one group. The three stages overlap across files, with bounded queues
+// between them. Each file moves from the drop directory to processing/, then
+// done/ once committed; a crash leaves it in processing/ and it is replayed
+// (and deduped) on the next start.
+class ChannelIngestor {
+public:
+    struct Stats {
+        long files;
+        long bookings;
+        long accepted;
+        long duplicates;
+        long invalid;
+        long unallocated;
+        double parse_ms;
+        double validate_ms;
+        double commit_ms;
+    };
+
+private:
+    std::string drop_dir;
+    std::string ledger_file; // "<ref> <room> <arrival>" per committed booking
+    std::atomic<long> today; // Business date for validation
+    AllotmentBook* allotments; // Blocks that channel bookings draw from
+    std::unordered_set<std::string> known_refs;
+    std::mutex refs_mutex; // Guards known_refs (validator claims, desk releases)
+    StageQueue<ChannelBatch> parsed;
+    StageQueue<ChannelBatch> ready;
+    std::thread scanner;
+    std::thread validator;
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    bool stopping;
+    long scans_requested, scans_done; // Guarded by wake_mutex
+    std::atomic<long> in_pipeline; // Files claimed but not yet finished
+    mutable std::mutex stats_mutex;
+    Stats stats;
+    std::deque<std::string> recent; // One-line summaries of the last files
+
+    std::string subdir(const char* name) const { return drop_dir + "/" + name; }
+    void scan_loop();
+    void validate_loop();
+    bool parse_file(const std::string& path, ChannelBatch& batch) const;
+    void validate(ChannelBooking& booking);
+
+public:
+    ChannelIngestor()
+        : today(0), allotments(nullptr), parsed(4), ready(4), stopping(false), scans_requested(0), scans_done(0),
+          in_pipeline(0), stats() {}
+    ~ChannelIngestor() { stop(); }
+
+    // Starts watching dir; existing_refs are the channel bookings in the room table
+    void start(const std::string& dir, const std::string& ledger, const std::vector<std::string>& existing_refs,
+               long business_date, AllotmentBook* book);
+    void stop();
+    bool running() const { return scanner.joinable(); }
+    void set_business_date(long day) { today = day; }
+    // Scans the drop directory now; returns once the scan has claimed what it found
+    void scan_now();
+    long pending() const { return in_pipeline; }
+    // Takes the next validated file for allocation, if one is ready
+    bool take_ready(ChannelBatch& batch) { return ready.try_pop(batch); }
+    // Records a committed file: ledger lines, rejects report, move to done/
+    void finish(const ChannelBatch& batch, double commit_ms);
+    Stats get_stats() const;
+    void print_status(std::ostream& out) const;
+};
+
+// Measures wall time, CPU time and page faults of named startup phases
+class StartupProfiler {
+private:
+    struct Phase {
+        std::string name;
+        double wall_ms;
+        double cpu_ms;
+        long minor_faults;
+        long major_faults;
+    };
+    std::vector<Phase> phases;
+    std::string current;
+    std::chrono::steady_clock::time_point wall_start;
+    struct rusage usage_start;
+
+    static double cpu_ms_of(const struct rusage& ru) {
+        return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000.0 +
+               (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000.0;
+    }
+
+public:
+    StartupProfiler() : usage_start() {}
+
+    // Ends the running phase (if any) and starts the named one; nullptr just ends
+    void phase(const char* name) {
+        if (!current.empty()) {
+            struct rusage now;
+            getrusage(RUSAGE_SELF, &now);
+            double wall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wall_start).count();
+            phases.push_back({current, wall, cpu_ms_of(now) - cpu_ms_of(usage_start),
+                              now.ru_minflt - usage_start.ru_minflt, now.ru_majflt - usage_start.ru_majflt});
+            current.clear();
+        }
+        if (name != nullptr) {
+            current = name;
+            getrusage(RUSAGE_SELF, &usage_start);
+            wall_start = std::chrono::steady_clock::now();
+        }
+    }
+
+    // Prints the phase table and returns true if total wall time is within budget
+    bool report(std::ostream& out, double budget_ms) {
+        phase(nullptr);
+        double total_wall = 0, total_cpu = 0;
+        long total_minor = 0, total_major = 0;
+        out << "\n STARTUP REPORT" << std::endl;
+        out << " " << std::left << std::setw(18) << "Phase" << std::right << std::setw(12) << "Wall ms"
+            << std::setw(12) << "CPU ms" << std::setw(12) << "Minor PF" << std::setw(12) << "Major PF" << std::endl;
+        out << std::fixed << std::setprecision(3);
+        for (const auto& ph : phases) {
+            out << " " << std::left << std::setw(18) << ph.name << std::right << std::setw(12) << ph.wall_ms
+                << std::setw(12) << ph.cpu_ms << std::setw(12) << ph.minor_faults << std::setw(12) << ph.major_faults << std::endl;
+            total_wall += ph.wall_ms;
+            total_cpu += ph.cpu_ms;
+            total_minor += ph.minor_faults;
+            total_major += ph.major_faults;
+        }
+        out << " " << std::left << std::setw(18) << "TOTAL" << std::right << std::setw(12) << total_wall
+            << std::setw(12) << total_cpu << std::setw(12) << total_minor << std::setw(12) << total_major << std::endl;
+        bool within = total_wall <= budget_ms;
+        out << "\n Budget: " << budget_ms << " ms -> " << (within ? "OK" : "EXCEEDED") << std::endl;
+        out.unsetf(std::ios::fixed);
+        return within;
+    }
+};
+
+// Prints live and peak bytes per subsystem, bytes per room, and (if target_rooms > 0)
+// the projected footprint at that room count. Room-proportional subsystems are
+// scaled linearly from the current per-room figure; the audit buffer is fixed.
+static void print_memory_report(std::ostream& out, size_t rooms, long target_rooms) {
+    long total_live = 0, total_peak = 0, projected_total = 0;
+    out << " " << std::left << std::setw(15) << "Subsystem" << std::right << std::setw(12) << "Live"
+        << std::setw(12) << "Peak" << std::setw(12) << "Per Room";
+    if (target_rooms > 0) {
+        out << std::setw(16) << ("@" + std::to_string(target_rooms));
+    }
+    out << std::endl;
+    for (int sub = 0; sub < MEM_SUBSYSTEM_COUNT; ++sub) {
+        long live = memory_counters[sub].live_bytes.load();
+        long peak = memory_counters[sub].peak_bytes.load();
+        long per_room = rooms > 0 ? live / static_cast<long>(rooms) : 0;
+        long projected = (sub == MEM_AUDIT_BUFFER || rooms == 0) ? live : per_room * target_rooms;
+        total_live += live;
+        total_peak += peak;
+        projected_total += projected;
+        out << " " << std::left << std::setw(15) << MEM_SUBSYSTEM_NAMES[sub] << std::right << std::setw(12) << live
+            << std::setw(12) << peak << std::setw(12) << per_room;
+        if (target_rooms > 0) {
+            out << std::setw(16) << projected;
+        }
+        out << std::endl;
+    }
+    out << " " << std::left << std::setw(15) << "TOTAL" << std::right << std::setw(12) << total_live
+        << std::setw(12) << total_peak << std::setw(12) << (rooms > 0 ? total_live / static_cast<long>(rooms) : 0);
+    if (target_rooms > 0) {
+        out << std::setw(16) << projected_total;
+    }
+    out << " bytes (" << rooms << " room(s))" << std::endl;
+}
+
+// Class to manage all hotel operations using an unordered_map
+class HotelManager {
+private:
+    // Unordered map to store RoomData objects, using room_no as key for O(1) average time complexity
+    TrackedMap<int, RoomData, MEM_ROOM_TABLE> rooms_map;
+    ReservationBook reservations; // Channel bookings not yet due, moved into rooms_map on their arrival date
+    // Dense room number -> record directory over rooms_map nodes (node addresses
+    // are stable), used by batch_lookup to prefetch ahead of bulk operations
+    std::vector<RoomData*> room_directory;
+    const std::string DATA_FILE = "Record.DAT"; // File to persist data
+    const std::string JOURNAL_FILE = "Journal.LOG"; // Append-only log of batch jobs
+    const std::string REQUEST_FILE = "Requests.LOG"; // Results of keyed requests, for retries after a restart
+    const std::string INVOICE_DIR = "invoices";     // Published invoices
+    std::string invoice_buffer; // Reused by the front desk to render checkout invoices
+    long business_date; // Current business date (days since 1970-01-01)
+    TrackedMap<std::string, GroupAccount, MEM_INDEXES> group_accounts; // Keyed by group code
+    const std::string LOYALTY_FILE = "Loyalty.DAT";
+    TrackedMap<std::string, LoyaltyAccount, MEM_INDEXES> loyalty_ledger; // Keyed by guest phone number
+    const std::string AUDIT_FILE = "Audit.LOG";
+    AuditTrail audit_trail;
+    IdempotencyTable request_results; // Results of keyed add_room/order_food requests, for retries
+    const std::string ARCHIVE_FILE = "Stays.DAT"; // Hot tier of the stay archive
+    const std::string ARCHIVE_DIR = "archive";    // Cold segments and monthly aggregates
+    StayArchive stay_archive; // Checked-out stays, indexed by guest
+    const std::string ALLOTMENT_FILE = "Allotments.DAT";
+    AllotmentBook allotments; // Agent and corporate room blocks (outlives channel_ingest, which draws on it)
+    const std::string CHANNEL_DIR = "channel";        // Channel manager drop directory
+    const std::string CHANNEL_LEDGER = "Channel.LOG"; // Channel bookings taken, for dedupe
+    ChannelIngestor channel_ingest;
+    std::string terminal_id; // Identifies this front desk terminal in the audit trail
+    SnapshotPublisher snapshot_publisher; // Read-only room table for sibling processes
+    AvailabilityMatrix availability; // Free rooms per type per night, published with the snapshot
+    const std::string REVENUE_FILE = "Revenue.DAT";
+    RevenueIndex revenue; // Charges by business date, room type and category
+    const std::string CUBE_FILE = "Cube.DAT";
+    OccupancyCube cube; // Room-nights and revenue by type, floor, wing, channel and date
+    MovementIndex movements;   // Expected arrivals and departures by business date
+    std::string movement_sheet; // Today's arrivals and departures, rendered ahead of the morning rush
+    long movement_sheet_date;   // Business date movement_sheet was rendered for
+    uint64_t movement_sheet_version; // movements.version() at that time
+    EpochManager epochs;    // Deferred frees for lock-free readers (declared before its users)
+    HotRoomTable hot_rooms; // Seqlocked per-room copies for lock-free point reads
+    StartupProfiler* profiler; // Set only for --startup-report
+    bool save_on_exit;
+    bool data_file_rejected; // DATA_FILE (or a saved aggregate) could not be read; it is left untouched
+    pid_t bgsave_pid;  // Running snapshot child, or 0
+    int bgsave_pipe;   // Read end of the child's report pipe
+    std::chrono::steady_clock::time_point bgsave_started;
+    BgsaveResult last_bgsave;
+
+    // Marks the start of a startup phase when profiling
+    void startup_phase(const char* name) {
+        if (profiler != nullptr) {
+            profiler->phase(name);
+        }
+    }
+
+    // Private helper functions for restaurant menu calculations
+    void calculateBreakfastCost(RoomData& room, int num_people);
+    void calculateLunchCost(RoomData& room, int num_people);
+    void calculateDinnerCost(RoomData& room, int num_people);
+
+    // Helper to clear input buffer
+    void clearInputBuffer();
+
+    // Appends a single line to the journal file
+    void append_journal(const std::string& entry);
+
+    // Posts a charge to the folio its category is routed to and updates running totals
+    void post_charge(RoomData& room, int category, long amount, const std::string& description);
+    void apply_group_posting(const GroupPosting& posting);
+
+    // Refreshes the seqlocked hot copy of a room after it changed
+    void refresh_hot_room(const RoomData& room);
+
+    // Reads an optional request key; true if it already ran (its result is replayed)
+    bool replay_keyed_request(std::string& key);
+
+    // Writes the room table and group accounts in the Record.DAT layout
+    void write_room_table(std::ostream& fout);
+    bool commit_room_table(); // Durable write of DATA_FILE (temporary file and rename)
+    void ingest_channel_batches(); // Allocates rooms to validated channel files and commits them
+    void admit_due_reservations(); // Moves reservations due by today into their rooms, if vacant
+    bool held_for_allotments(int type, long from, long to) const; // Would a stay take a held room?
+    // Fork-based background snapshot of the room table
+    bool start_bgsave();
+    void reap_bgsave(bool wait);
+    void cancel_bgsave(); // Stops a running child and discards its snapshot
+    std::string bgsave_file(pid_t pid) const { return DATA_FILE + ".bgsave." + std::to_string(pid); }
+
+    // Loyalty ledger persistence and updates
+    void load_loyalty();
+    void save_loyalty();
+    void award_loyalty_points(const RoomData& room);
+    const LoyaltyAccount* loyalty_lookup(const std::string& phone); // O(1) tier lookup
+
+public:
+    // Constructor to load data; a profiler or read_only makes the instance
+    // read-only (no save on exit, no shared snapshot)
+    explicit HotelManager(StartupProfiler* startup_profiler = nullptr, bool read_only = false);
+    ~HotelManager(); // Destructor to save data
+
+    void load_data();  // Loads data from file into the unordered_map
+    void reject_data_file(const std::string& reason); // Refuses to run on an unreadable DATA_FILE
+    void reject_aggregate_file(const std::string& file); // Refuses to run on a damaged Revenue.DAT or Cube.DAT
+    bool usable() const { return !data_file_rejected; }
+    // Journals of the partitioned server (Journal-p<N>.LOG), folded into the room table
+    void recover_partition_fold();  // Completes a fold interrupted after its journals were renamed
+    int fold_partition_journals();  // Entries replayed, or -1 if the fold could not be committed
+    bool apply_partition_entry(const std::string& entry); // Replays one journal line
+    void build_indexes_and_aggregates(); // Rebuilds derived in-memory state after loading
+    void save_data();  // Saves data from the unordered_map to file
+
+    void main_menu();    // Displays the main menu and handles user choices
+    void print_main_menu(std::ostream& out); // Draws the main menu
+    void add_room();     // Books a room and adds customer details
+    void display_room(); // Displays specific customer information
+    void display_all_rooms(); // Displays all allotted rooms
+    void edit_customer_details(); // Allows modification or checkout
+    int check_room_status(int r_no); // Checks if a room is booked or invalid
+    void back_office_menu(); // Displays the back office (batch jobs) menu
+    void night_audit();  // Runs the night rollover and prints its report
+    NightAuditResult run_night_rollover(); // Accrues one night and advances the business date
+    void group_invoice(); // Prints (and optionally settles) a consolidated group invoice
+    void batch_invoices(); // Renders invoices for every in-house room
+    void loyalty_statement(); // Shows a guest's loyalty tier and points
+    void audit_report();     // Shows the field changes recorded for a room
+    void reclamation_stats(); // Shows deferred-free backlog of the epoch manager
+    void memory_usage();      // Shows per-subsystem memory and a footprint projection
+    void guest_history();     // Shows a guest's archived stays
+    void archive_retention(); // Shows the archive tiers and runs compaction on demand
+    void background_snapshot(); // Starts a BGSAVE-style snapshot and shows the last result
+    void channel_ingestion();   // Pulls in dropped channel files and shows ingestion status
+    void allotment_blocks();    // Lists, adds and releases agent allotment blocks
+    void availability_report(); // Shows free rooms per type for the booking window
+    void revenue_report();      // Shows revenue between two business dates
+    void cube_report();         // Slices occupancy and revenue by any of the cube dimensions
+    void movements_report();    // Shows the arrivals and departures of a business date
+    void render_movements(long date, std::string& buf); // Renders the arrivals and departures of a date
+    const std::string& todays_movements(); // Today's sheet, re-rendered only if bookings changed
+    // Renders invoices in parallel into a staging directory, then publishes them
+    size_t render_invoice_batch(const std::vector<const RoomData*>& rooms, const std::vector<InvoiceFormat>& formats);
+    void modify_customer_info(); // Modifies customer details
+    void delete_customer_record(); // Checks out a customer and deletes record
+    void order_food();   // Handles food ordering for a room
+
+    // Front-desk steps without their prompts, shared by the menus and the
+    // simulation harness. Each re-validates the room in the step that acts.
+    bool commit_booking(const RoomData& room); // False if the room is no longer free
+    long checkout_quote(int r_no) const;       // Bill shown before checkout, or -1 if vacant
+    long check_out(int r_no);                  // Settles and archives the stay: amount billed, or -1 if vacant
+    long post_meal(int r_no, int meal, int num_people); // Amount posted, 0 for a bad order, -1 if vacant
+    const RoomData* find_room(int r_no) const;
+    long today() const { return business_date; }
+    long reserved_from(int r_no) const { return reservations.next_arrival(r_no, business_date); } // -1 if none
+    long posted_total() const;     // Every charge ever posted, from the revenue index
+    long in_house_balance() const; // Sum of the folio balances of the rooms in house
+    // Compares the derived state (directory, hot copies, availability, cube) with the room table
+    void check_consistency(std::vector<std::string>& problems);
+
+    // Specific modification functions
+    void modify_name(int r_no);
+    void modify_address(int r_no);
+    void modify_phone(int r_no);
+    void modify_days(int r_no);
+};
+
+// Function to create (or reuse) the shared-memory segment. The process that
+// creates it owns it and is the only one that removes it; a segment left by a
+// desk that is no longer running is taken over.
+bool SnapshotPublisher::open() {
+    fd = shm_open(SHM_NAME, O_CREAT | O_EXCL | O_RDWR, 0644);
+    owner = fd >= 0;
+    if (fd < 0 && errno == EEXIST) {
+        fd = shm_open(SHM_NAME, O_RDWR, 0644);
+    }
+    if (fd < 0) {
+        std::cerr << "\n Warning: Could not create shared snapshot " << SHM_NAME << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    if (ftruncate(fd, sizeof(SharedRoomSnapshot)) != 0) {
+        std::cerr << "\n Warning: Could not size shared snapshot: " << std::strerror(errno) << std::endl;
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    void* addr = mmap(nullptr, sizeof(SharedRoomSnapshot), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        std::cerr << "\n Warning: Could not map shared snapshot: " << std::strerror(errno) << std::endl;
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    snapshot = static_cast<SharedRoomSnapshot*>(addr);
+    if (!owner && (snapshot->magic != SharedRoomSnapshot::MAGIC ||
+                   (kill(static_cast<pid_t>(snapshot->owner_pid), 0) != 0 && errno == ESRCH))) {
+        owner = true; // Stale segment: its desk exited without removing it
+    }
+    if (owner) {
+        snapshot->owner_pid = getpid();
+    }
+    snapshot->magic = SharedRoomSnapshot::MAGIC;
+    return true;
+}
+
+// Function to unmap and remove the segment so readers never see stale data
+SnapshotPublisher::~SnapshotPublisher() {
+    if (snapshot != nullptr) {
+        // A forked BGSAVE child inherits the mapping but is not the owner
+        bool remove = owner && snapshot->owner_pid == getpid();
+        munmap(snapshot, sizeof(SharedRoomSnapshot));
+        if (remove) {
+            shm_unlink(SHM_NAME);
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+// Function to copy the room table into the segment under the seqlock
+void SnapshotPublisher::publish(const TrackedMap<int, RoomData, MEM_ROOM_TABLE>& rooms, long business_date,
+                                const AvailabilityMatrix& availability) {
+    if (snapshot == nullptr) {
+        return;
+    }
+    seqlock_write_begin(snapshot->sequence);
+    std::memset(snapshot->rooms, 0, sizeof(snapshot->rooms));
+    for (const auto& pair : rooms) {
+        const RoomData& room = pair.second;
+        if (room.room_no < 1 || room.room_no > SharedRoomSnapshot::MAX_ROOMS) {
+            continue;
+        }
+        SharedRoomRecord& rec = snapshot->rooms[room.room_no];
+        rec.room_no = room.room_no;
+        rec.occupied = room.arrived ? 1 : 0;
+        rec.days = room.days;
+        std::strncpy(rec.rtype, room.rtype.c_str(), sizeof(rec.rtype) - 1);
+        std::strncpy(rec.name, room.name.c_str(), sizeof(rec.name) - 1);
+    }
+    availability.snapshot(snapshot->availability);
+    snapshot->published_at = std::time(nullptr);
+    snapshot->business_date = business_date;
+    seqlock_write_end(snapshot->sequence);
+}
+
+void AvailabilityMatrix::fill_night(long night, const TrackedMap<int, RoomData, MEM_ROOM_TABLE>& rooms,
+                                    const ReservationBook& reservations) {
+    int32_t* counts = row(night);
+    for (int t = 0; t < ROOM_TYPE_COUNT; ++t) {
+        counts[t] = ROOM_TYPE_RANGES[t].last - ROOM_TYPE_RANGES[t].first + 1;
+    }
+    auto count_room = [counts, night](const RoomData& room) {
+        int t = room_type_of(room.room_no);
+        if (t >= 0 && night >= room.arrival_date && night < room.arrival_date + room.days) {
+            counts[t]--;
+        }
+    };
+    for (const auto& pair : rooms) {
+        count_room(pair.second);
+    }
+    reservations.for_each(count_room);
+}
+
+void AvailabilityMatrix::rebuild(long today, const TrackedMap<int, RoomData, MEM_ROOM_TABLE>& rooms,
+                                 const ReservationBook& reservations) {
+    first_night = today;
+    for (int n = 0; n < AVAILABILITY_NIGHTS; ++n) {
+        int32_t* counts = row(today + n);
+        for (int t = 0; t < ROOM_TYPE_COUNT; ++t) {
+            counts[t] = ROOM_TYPE_RANGES[t].last - ROOM_TYPE_RANGES[t].first + 1;
+        }
+    }
+    for (const auto& pair : rooms) {
+        book(pair.second);
+    }
+    reservations.for_each([this](const RoomData& room) { book(room); });
+}
+
+void AvailabilityMatrix::advance(long today, const TrackedMap<int, RoomData, MEM_ROOM_TABLE>& rooms,
+                                 const ReservationBook& reservations) {
+    if (today - first_night >= AVAILABILITY_NIGHTS) {
+        rebuild(today, rooms, reservations);
+        return;
+    }
+    for (; first_night < today; ++first_night) {
+        fill_night(first_night + AVAILABILITY_NIGHTS, rooms, reservations); // Reuses the row of the closed night
+    }
+}
+
+void AvailabilityMatrix::adjust(int r_no, long from, long to, int delta) {
+    int t = room_type_of(r_no);
+    if (t < 0) {
+        return;
+    }
+    from = std::max(from, first_night);
+    to = std::min(to, first_night + AVAILABILITY_NIGHTS);
+    for (long night = from; night < to; ++night) {
+        row(night)[t] += delta;
+    }
+}
+
+long AvailabilityMatrix::copy(long from, int& nights, int32_t (*out)[ROOM_TYPE_COUNT]) const {
+    from = std::max(from, first_night);
+    long end = std::min(from + std::max(nights, 0), first_night + AVAILABILITY_NIGHTS);
+    nights = static_cast<int>(std::max(0L, end - from));
+    int start = static_cast<int>(from % AVAILABILITY_NIGHTS);
+    int head = std::min(nights, AVAILABILITY_NIGHTS - start); // Rows before the ring wraps
+    std::memcpy(out, ring[start], sizeof(ring[0]) * head);
+    std::memcpy(out + head, ring[0], sizeof(ring[0]) * (nights - head));
+    return from;
+}
+
+// Reader side for sibling processes: prints the occupancy published by a
+// running front desk without any IPC round trip. Returns a process exit code.
+static int read_shared_snapshot(int room_filter) {
+    if (room_filter < 0 || room_filter > SharedRoomSnapshot::MAX_ROOMS) {
+        std::cerr << "Usage: HMS --snapshot-read [room_no], with 1 <= room_no <= " << SharedRoomSnapshot::MAX_ROOMS
+                  << std::endl;
+        return 2;
+    }
+    int fd = shm_open(SnapshotPublisher::SHM_NAME, O_RDONLY, 0);
+    if (fd < 0) {
+        std::cerr << "No room snapshot published (is HMS running?)" << std::endl;
+        return 1;
+    }
+    void* addr = mmap(nullptr, sizeof(SharedRoomSnapshot), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        std::cerr << "Could not map room snapshot: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    const SharedRoomSnapshot* snapshot = static_cast<const SharedRoomSnapshot*>(addr);
+    if (snapshot->magic != SharedRoomSnapshot::MAGIC) {
+        std::cerr << "Room snapshot has an unknown layout" << std::endl;
+        munmap(addr, sizeof(SharedRoomSnapshot));
+        return 1;
+    }
+
+    int occupied = 0;
+    for (int r_no = 1; r_no <= SharedRoomSnapshot::MAX_ROOMS; ++r_no) {
+        if (room_filter != 0 && r_no != room_filter) {
+            continue;
+        }
+        SharedRoomRecord rec = seqlock_read(snapshot->sequence, snapshot->rooms[r_no]);
+        if (rec.room_no == 0) {
+            if (room_filter != 0) {
+                std::cout << "Room " << r_no << ": vacant" << std::endl;
+            }
+            continue;
+        }
+        occupied++;
+        std::cout << "Room " << rec.room_no << ": " << (rec.occupied ? "occupied" : "booked") << " | "
+                  << rec.name << " | " << rec.rtype << " | " << rec.days << " days" << std::endl;
+    }
+    if (room_filter == 0) {
+        std::cout << occupied << " room(s) booked, snapshot published at " << snapshot->published_at << std::endl;
+    }
+    munmap(addr, sizeof(SharedRoomSnapshot));
+    return 0;
+}
+
+// Runs reader threads doing random point reads against a HotRoomTable for the
+// given time, with the given number of writer threads rewriting random rooms.
+// Returns total reads per second across all readers.
+static double run_seqlock_phase(HotRoomTable& table, int readers, int writers, double seconds) {
+    std::atomic<bool> stop(false);
+    std::vector<uint64_t> reads(readers, 0);
+    std::vector<std::thread> threads;
+
+    for (int r = 0; r < readers; ++r) {
+        threads.emplace_back([&table, &stop, &reads, r]() {
+            uint64_t x = 0x9E3779B97F4A7C15ULL * (r + 1);
+            uint64_t count = 0, checksum = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                x ^= x << 13; x ^= x >> 7; x ^= x << 17; // xorshift64
+                HotRoomRecord rec = table.load(1 + static_cast<int>(x % HotRoomTable::MAX_ROOMS));
+                checksum += rec.days + rec.food_bill;
+                count++;
+            }
+            reads[r] = count + (checksum == 42 ? 1 : 0); // Keep the reads observable
+        });
+    }
+    for (int w = 0; w < writers; ++w) {
+        threads.emplace_back([&table, &stop, w]() {
+            uint64_t x = 0xD1B54A32D192ED03ULL * (w + 1);
+            HotRoomRecord rec = HotRoomRecord();
+            std::strncpy(rec.name, "Benchmark Guest", sizeof(rec.name) - 1);
+            while (!stop.load(std::memory_order_relaxed)) {
+                x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+                rec.room_no = 1 + static_cast<int>(x % HotRoomTable::MAX_ROOMS);
+                rec.days = static_cast<int64_t>(x & 0xF);
+                rec.food_bill += 500;
+                table.store(rec.room_no, rec);
+                std::this_thread::yield(); // A few writers, not a write storm
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop.store(true);
+    for (auto& t : threads) {
+        t.join();
+    }
+    uint64_t total = 0;
+    for (uint64_t count : reads) {
+        total += count;
+    }
+    return total / seconds;
+}
+
+// Benchmark: HMS --bench-seqlock [readers] [writers] [seconds]
+// Measures reader throughput without writers, then with writers running.
+static int bench_seqlock(int readers, int writers, double seconds) {
+    if (readers < 1 || writers < 1 || !(seconds > 0)) { // Also rejects a seconds of nan
+        std::cerr << "Usage: HMS --bench-seqlock [readers] [writers] [seconds], with readers >= 1, writers >= 1"
+                  << " and seconds > 0" << std::endl;
+        return 2;
+    }
+    std::unique_ptr<HotRoomTable> table(new HotRoomTable());
+    for (int r_no = 1; r_no <= HotRoomTable::MAX_ROOMS; ++r_no) {
+        HotRoomRecord rec = HotRoomRecord();
+        rec.room_no = r_no;
+        rec.days = 3;
+        table->store(r_no, rec);
+    }
+
+    std::cout << "Seqlock room reads: " << readers << " reader(s), " << seconds << "s per phase, "
+              << std::thread::hardware_concurrency() << " hardware thread(s)" << std::endl;
+    double baseline = run_seqlock_phase(*table, readers, 0, seconds);
+    double contended = run_seqlock_phase(*table, readers, writers, seconds);
+    std::cout << std::fixed << std::setprecision(0);
+    std::cout << "  0 writer(s): " << baseline << " reads/s" << std::endl;
+    std::cout << "  " << writers << " writer(s): " << contended << " reads/s ("
+              << std::setprecision(1) << (baseline > 0 ? 100.0 * contended / baseline : 0.0)
+              << "% of baseline)" << std::endl;
+    return 0;
+}
+
+// Returns the nightly rate of a room, or 0 for an invalid room number
+static long nightly_rate(int r_no) {
+    int type = room_type_of(r_no);
+    return type < 0 ? 0 : ROOM_TYPE_RANGES[type].rate;
+}
+
+// Page backing requested for large arenas
+enum HugePageMode {
+    HUGEPAGE_OFF,          // Regular 4 KiB pages (transparent huge pages disabled for the range)
+    HUGEPAGE_TRANSPARENT,  // madvise(MADV_HUGEPAGE) on a 2 MiB aligned mapping
+    HUGEPAGE_EXPLICIT      // MAP_HUGETLB from the reserved pool, falling back to transparent
+};
+
+static const char* const HUGEPAGE_MODE_NAMES[] = { "4k pages", "transparent huge pages", "explicit huge pages" };
+
+// Bump-pointer arena over one large anonymous mapping. Used for tables that
+// span gigabytes in million-room mode, where TLB misses dominate random access:
+// backing them with 2 MiB pages cuts the number of TLB entries needed by 512x.
+// Memory is only returned when the arena is destroyed.
+class HugePageArena {
+public:
+    static const size_t HUGE_PAGE_SIZE = 2 << 20;
+
+private:
+    char* base;
+    size_t mapped;      // Bytes mapped (rounded up to the huge page size)
+    size_t used;
+    HugePageMode backing;
+
+public:
+    HugePageArena(size_t bytes, HugePageMode mode) : base(nullptr), mapped(0), used(0), backing(HUGEPAGE_OFF) {
+        mapped = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        if (mode == HUGEPAGE_EXPLICIT) {
+#ifdef MAP_HUGETLB
+            void* addr = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (addr != MAP_FAILED) {
+                base = static_cast<char*>(addr);
+                backing = HUGEPAGE_EXPLICIT;
+                return;
+            }
+#endif
+            mode = HUGEPAGE_TRANSPARENT; // No reserved huge pages: fall back
+        }
+
+        // Over-map by one huge page so the arena can start on a 2 MiB boundary
+        size_t span = mapped + HUGE_PAGE_SIZE;
+        void* addr = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        uintptr_t raw = reinterpret_cast<uintptr_t>(addr);
+        uintptr_t aligned = (raw + HUGE_PAGE_SIZE - 1) & ~(static_cast<uintptr_t>(HUGE_PAGE_SIZE) - 1);
+        if (aligned > raw) {
+            munmap(addr, aligned - raw);
+        }
+        if (raw + span > aligned + mapped) {
+            munmap(reinterpret_cast<void*>(aligned + mapped), raw + span - (aligned + mapped));
+        }
+        base = reinterpret_cast<char*>(aligned);
+#ifdef MADV_HUGEPAGE
+        if (mode == HUGEPAGE_TRANSPARENT && madvise(base, mapped, MADV_HUGEPAGE) == 0) {
+            backing = HUGEPAGE_TRANSPARENT;
+        }
+#endif
+#ifdef MADV_NOHUGEPAGE
+        if (backing == HUGEPAGE_OFF) {
+            madvise(base, mapped, MADV_NOHUGEPAGE); // Keep the 4k baseline honest under THP=always
+        }
+#endif
+    }
+
+    ~HugePageArena() {
+        if (base != nullptr) {
+            munmap(base, mapped);
+        }
+    }
+
+    HugePageArena(const HugePageArena&) = delete;
+    HugePageArena& operator=(const HugePageArena&) = delete;
+
+    void* allocate(size_t bytes, size_t align = 64) {
+        size_t offset = (used + align - 1) & ~(align - 1);
+        if (offset + bytes > mapped) {
+            throw std::bad_alloc();
+        }
+        used = offset + bytes;
+        return base + offset;
+    }
+
+    HugePageMode mode() const { return backing; }
+    size_t capacity() const { return mapped; }
+};
+
+// Returns the AnonHugePages of this process in KiB (0 if unavailable)
+static long anon_hugepages_kb() {
+    std::ifstream smaps("/proc/self/smaps_rollup");
+    std::string key;
+    long value;
+    while (smaps >> key) {
+        if (key == "AnonHugePages:" && smaps >> value) {
+            return value;
+        }
+        smaps.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+    return 0;
+}
+
+// Looks up a batch of room numbers in a dense directory (room number -> record
+// pointer) and calls fn(i, record) for each, in order; record is null for a
+// vacant or invalid room. Each key goes through a software pipeline: its
+// directory slot is prefetched 2*DISTANCE iterations ahead and the record it
+// points to DISTANCE iterations ahead, so the dependent cache misses of many
+// lookups overlap instead of being paid one after another.
+template <typename Record, typename Fn>
+static void batch_lookup(Record* const* directory, size_t directory_size, const int* keys, size_t n, Fn fn) {
+    const size_t DISTANCE = 8;
+    auto valid = [directory_size](int key) {
+        return key >= 0 && static_cast<size_t>(key) < directory_size;
+    };
+    for (size_t i = 0; i < n && i < 2 * DISTANCE; ++i) {
+        if (valid(keys[i])) {
+            __builtin_prefetch(&directory[keys[i]]);
+        }
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (i + 2 * DISTANCE < n && valid(keys[i + 2 * DISTANCE])) {
+            __builtin_prefetch(&directory[keys[i + 2 * DISTANCE]]);
+        }
+        if (i + DISTANCE < n && valid(keys[i + DISTANCE])) {
+            Record* ahead = directory[keys[i + DISTANCE]];
+            if (ahead != nullptr) {
+                __builtin_prefetch(ahead);
+            }
+        }
+        fn(i, valid(keys[i]) ? directory[keys[i]] : nullptr);
+    }
+}
+
+// Compact room record used by the million-room benchmark; names live in a
+// separate string arena so a lookup makes two dependent random accesses
+struct ArenaRoomRecord {
+    int64_t cost;
+    int64_t food_bill;
+    int32_t room_no;
+    int32_t days;
+    uint32_t name_offset;
+    uint32_t name_length;
+};
+
+static const size_t ARENA_NAME_BYTES = 24; // Arena bytes per guest name
+// Largest table whose name offsets still fit the 32-bit name_offset
+static const long ARENA_MAX_ROOMS = static_cast<long>(std::numeric_limits<uint32_t>::max() / ARENA_NAME_BYTES);
+
+// Benchmark: HMS --bench-hugepages [rooms] [lookups]
+// Builds a room table and name arena of the given size with each backing and
+// measures random lookup latency and full-scan throughput.
+static int bench_hugepages(long rooms, long lookups) {
+    if (rooms <= 0 || rooms > ARENA_MAX_ROOMS || lookups <= 0) {
+        std::cerr << "Usage: HMS --bench-hugepages [rooms] [lookups], with 1 <= rooms <= " << ARENA_MAX_ROOMS
+                  << " and lookups >= 1" << std::endl;
+        return 2;
+    }
+    std::cout << "Million-room arena benchmark: " << rooms << " rooms, " << lookups << " random lookups" << std::endl;
+    const HugePageMode modes[] = { HUGEPAGE_OFF, HUGEPAGE_TRANSPARENT, HUGEPAGE_EXPLICIT };
+    for (HugePageMode requested : modes) {
+        long huge_before = anon_hugepages_kb();
+        HugePageArena table_arena(rooms * sizeof(ArenaRoomRecord), requested);
+        HugePageArena string_arena(rooms * ARENA_NAME_BYTES, requested);
+        ArenaRoomRecord* table = static_cast<ArenaRoomRecord*>(table_arena.allocate(rooms * sizeof(ArenaRoomRecord)));
+        char* names = static_cast<char*>(string_arena.allocate(rooms * ARENA_NAME_BYTES, 1));
+
+        for (long i = 0; i < rooms; ++i) {
+            ArenaRoomRecord& rec = table[i];
+            rec.room_no = static_cast<int32_t>(i + 1);
+            rec.days = static_cast<int32_t>(1 + i % 7);
+            rec.cost = rec.days * nightly_rate(1 + static_cast<int>(i % 100));
+            rec.food_bill = (i % 5) * 500;
+            rec.name_offset = static_cast<uint32_t>(i * ARENA_NAME_BYTES);
+            rec.name_length = static_cast<uint32_t>(std::snprintf(names + i * ARENA_NAME_BYTES, ARENA_NAME_BYTES, "Guest %ld", i + 1));
+        }
+        long huge_kb = anon_hugepages_kb() - huge_before;
+
+        uint64_t x = 0x9E3779B97F4A7C15ULL, checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (long n = 0; n < lookups; ++n) {
+            x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+            const ArenaRoomRecord& rec = table[x % rooms];
+            checksum += rec.cost + static_cast<unsigned char>(names[rec.name_offset + rec.name_length - 1]);
+        }
+        double lookup_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / lookups;
+
+        const int SCAN_PASSES = 5;
+        start = std::chrono::steady_clock::now();
+        for (int pass = 0; pass < SCAN_PASSES; ++pass) {
+            for (long i = 0; i < rooms; ++i) {
+                checksum += table[i].cost + table[i].food_bill;
+            }
+        }
+        double scan_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double scan_gbs = SCAN_PASSES * rooms * sizeof(ArenaRoomRecord) / scan_s / 1e9;
+
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << "  requested " << std::left << std::setw(24) << HUGEPAGE_MODE_NAMES[requested]
+                  << " got " << std::setw(24) << HUGEPAGE_MODE_NAMES[table_arena.mode()] << std::right
+                  << " huge=" << std::setw(7) << huge_kb / 1024 << " MiB"
+                  << "  lookup " << std::setw(7) << lookup_ns << " ns"
+                  << "  scan " << std::setw(6) << scan_gbs << " GB/s"
+                  << (checksum == 42 ? " " : "") << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+    }
+    return 0;
+}
+
+// Benchmark: HMS --bench-batch-lookup [rooms]
+// Compares one-by-one std::unordered_map finds (how rooms_map is used today),
+// one-by-one directory loads, and prefetching batch lookups over random batches.
+static int bench_batch_lookup(long rooms) {
+    if (rooms <= 0 || rooms > std::numeric_limits<int32_t>::max()) {
+        std::cerr << "Usage: HMS --bench-batch-lookup [rooms], with 1 <= rooms <= "
+                  << std::numeric_limits<int32_t>::max() << std::endl;
+        return 2;
+    }
+    std::unordered_map<int, ArenaRoomRecord> table;
+    table.reserve(rooms);
+    std::vector<ArenaRoomRecord*> directory(rooms + 1, nullptr);
+    for (long i = 1; i <= rooms; ++i) {
+        ArenaRoomRecord rec = ArenaRoomRecord();
+        rec.room_no = static_cast<int32_t>(i);
+        rec.cost = i % 1000;
+        table[static_cast<int>(i)] = rec;
+    }
+    for (auto& pair : table) {
+        directory[pair.first] = &pair.second; // Node addresses are stable
+    }
+
+    std::cout << "Batched room lookups over " << rooms << " rooms (ns per lookup)" << std::endl;
+    std::cout << std::setw(8) << "batch" << std::setw(14) << "map.find" << std::setw(14) << "directory"
+              << std::setw(14) << "prefetched" << std::setw(12) << "vs map" << std::setw(12) << "vs dir" << std::endl;
+    std::mt19937_64 rng(42);
+    const long TOTAL_LOOKUPS = 4000000;
+    for (size_t batch : {64, 256, 1024, 4096}) {
+        std::vector<int> keys(batch);
+        size_t batches = TOTAL_LOOKUPS / batch;
+        std::vector<std::vector<int>> all(batches, keys);
+        for (auto& b : all) {
+            for (auto& k : b) {
+                k = 1 + static_cast<int>(rng() % rooms);
+            }
+        }
+        long checksum = 0;
+        auto time_ns = [&](auto&& body) {
+            auto start = std::chrono::steady_clock::now();
+            for (const auto& b : all) {
+                body(b);
+            }
+            return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+                   (batches * batch);
+        };
+        double map_ns = time_ns([&](const std::vector<int>& b) {
+            for (int k : b) {
+                checksum += table.find(k)->second.cost;
+            }
+        });
+        double dir_ns = time_ns([&](const std::vector<int>& b) {
+            for (int k : b) {
+                checksum += directory[k]->cost;
+            }
+        });
+        double batch_ns = time_ns([&](const std::vector<int>& b) {
+            batch_lookup(directory.data(), directory.size(), b.data(), b.size(),
+                         [&checksum](size_t, ArenaRoomRecord* rec) { checksum += rec->cost; });
+        });
+        std::cout << std::fixed << std::setprecision(2) << std::setw(8) << batch << std::setw(14) << map_ns
+                  << std::setw(14) << dir_ns << std::setw(14) << batch_ns << std::setw(11) << map_ns / batch_ns << "x"
+                  << std::setw(11) << dir_ns / batch_ns << "x" << (checksum == 42 ? " " : "") << std::endl;
+    }
+    std::cout.unsetf(std::ios::fixed);
+    return 0;
+}
+
+// Formats a business date (days since 1970-01-01) as YYYY-MM-DD
+static std::string format_date(long day) {
+    std::time_t t = static_cast<std::time_t>(day) * 86400;
+    std::tm tm_utc = *std::gmtime(&t);
+    char buf[16];
+    std::strftime(buf, sizeof(buf), "%Y-%m-%d", &tm_utc);
+    return buf;
+}
+
+// Parses YYYY-MM-DD into a business date; false if it is not a valid date
+static bool parse_date(const std::string& text, long& day) {
+    std::tm tm_utc = std::tm();
+    char rest;
+    if (std::sscanf(text.c_str(), "%4d-%2d-%2d%c", &tm_utc.tm_year, &tm_utc.tm_mon, &tm_utc.tm_mday, &rest) != 3) {
+        return false;
+    }
+    int year = tm_utc.tm_year, mon = tm_utc.tm_mon, mday = tm_utc.tm_mday;
+    tm_utc.tm_year -= 1900;
+    tm_utc.tm_mon -= 1;
+    std::time_t t = timegm(&tm_utc);
+    // timegm normalizes out-of-range fields (2024-02-30), so check the round trip
+    if (t == static_cast<std::time_t>(-1) || tm_utc.tm_year != year - 1900 || tm_utc.tm_mon != mon - 1 ||
+        tm_utc.tm_mday != mday) {
+        return false;
+    }
+    day = static_cast<long>(t / 86400);
+    return true;
+}
+
+// Helpers to write and read record fields explicitly instead of dumping raw objects
+static void write_long(std::ostream& out, long value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename Alloc>
+static void write_string(std::ostream& out, const std::basic_string<char, std::char_traits<char>, Alloc>& str) {
+    write_long(out, static_cast<long>(str.size()));
+    out.write(str.data(), str.size());
+}
+
+static bool read_long(std::istream& in, long& value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+template <typename Alloc>
+static bool read_string(std::istream& in, std::basic_string<char, std::char_traits<char>, Alloc>& str) {
+    long len;
+    if (!read_long(in, len) || len < 0 || len > (1L << 20)) {
+        return false;
+    }
+    str.resize(len);
+    return static_cast<bool>(in.read(&str[0], len));
+}
+
+static const long RECORD_FILE_MAGIC = 0x35534d48;    // "HMS5"
+static const long RECORD_FILE_MAGIC_V4 = 0x34534d48; // "HMS4": no reservation section
+static const long RECORD_FILE_MAGIC_V3 = 0x33534d48; // "HMS3": no channel references
+static const long RECORD_FILE_MAGIC_V2 = 0x32534d48; // "HMS2": no folios, group accounts or counts
+
+static void write_record(std::ostream& out, const RoomData& room) {
+    write_long(out, room.room_no);
+    write_string(out, room.name);
+    write_string(out, room.address);
+    write_string(out, room.phone);
+    write_long(out, room.days);
+    write_long(out, room.cost);
+    write_string(out, room.rtype);
+    write_long(out, room.food_bill);
+    write_long(out, room.arrival_date);
+    write_long(out, room.nights_posted);
+    write_long(out, room.room_charges);
+    write_long(out, (room.arrived ? 1 : 0) | (room.due_out ? 2 : 0) | (room.no_show ? 4 : 0) |
+                        (room.from_allotment ? 8 : 0));
+    write_string(out, room.group_code);
+    write_string(out, room.channel_ref);
+    for (int c = 0; c < CHARGE_CATEGORY_COUNT; ++c) {
+        write_long(out, room.routing[c]);
+    }
+    write_long(out, static_cast<long>(room.folios.size()));
+    for (const auto& folio : room.folios) {
+        write_string(out, folio.payer);
+        write_long(out, static_cast<long>(folio.lines.size()));
+        for (const auto& line : folio.lines) {
+            write_long(out, line.date);
+            write_long(out, line.category);
+            write_long(out, line.amount);
+            write_string(out, line.description);
+        }
+    }
+}
+
+// magic selects the layout: HMS3 records predate channel bookings, and HMS2
+// records end after the flags, with their charges kept only as totals
+static bool read_record(std::istream& in, RoomData& room, long magic) {
+    long r_no, flags;
+    if (!read_long(in, r_no) || !read_string(in, room.name) || !read_string(in, room.address) ||
+        !read_string(in, room.phone) || !read_long(in, room.days) || !read_long(in, room.cost) ||
+        !read_string(in, room.rtype) || !read_long(in, room.food_bill) ||
+        !read_long(in, room.arrival_date) || !read_long(in, room.nights_posted) ||
+        !read_long(in, room.room_charges) || !read_long(in, flags)) {
+        return false;
+    }
+    if (r_no < 1 || r_no > HotRoomTable::MAX_ROOMS) {
+        return false; // Room numbers index the directory and hot table
+    }
+    room.room_no = static_cast<int>(r_no);
+    room.arrived = (flags & 1) != 0;
+    room.due_out = (flags & 2) != 0;
+    room.no_show = (flags & 4) != 0;
+    room.from_allotment = (flags & 8) != 0;
+    if (magic == RECORD_FILE_MAGIC_V2) {
+        return true;
+    }
+
+    long routing, folio_count;
+    if (!read_string(in, room.group_code) ||
+        (magic != RECORD_FILE_MAGIC_V3 && !read_string(in, room.channel_ref))) {
+        return false;
+    }
+    for (int c = 0; c < CHARGE_CATEGORY_COUNT; ++c) {
+        if (!read_long(in, routing)) {
+            return false;
+        }
+        room.routing[c] = static_cast<int>(routing);
+    }
+    if (!read_long(in, folio_count) || folio_count < 1 || folio_count > 16) {
+        return false;
+    }
+    // Running totals are rebuilt from the lines as they are read
+    room.folios.assign(folio_count, Folio());
+    for (auto& folio : room.folios) {
+        long line_count;
+        if (!read_string(in, folio.payer) || !read_long(in, line_count) || line_count < 0) {
+            return false;
+        }
+        folio.lines.resize(line_count);
+        for (auto& line : folio.lines) {
+            long category;
+            if (!read_long(in, line.date) || !read_long(in, category) || !read_long(in, line.amount) ||
+                !read_string(in, line.description) || category < 0 || category >= CHARGE_CATEGORY_COUNT) {
+                return false;
+            }
+            line.category = static_cast<int>(category);
+            folio.total += line.amount;
+            folio.category_totals[line.category] += line.amount;
+        }
+    }
+    return true;
+}
+
+// Record.DAT files from before HMS2 are raw images of the original RoomData
+// (x86-64, libstdc++): room_no and padding, name, address, phone, days, cost,
+// rtype, food_bill. A std::string image is a pointer, a length and a 16-byte
+// inline buffer, so only strings that fit in the buffer can be recovered.
+static const size_t LEGACY_RECORD_SIZE = 160;
+
+template <typename Alloc>
+static bool read_legacy_string(const char* image, std::basic_string<char, std::char_traits<char>, Alloc>& str) {
+    uint64_t len;
+    std::memcpy(&len, image + 8, sizeof(len));
+    if (len > 15 || image[16 + len] != '\0') {
+        return false; // The characters were on the heap of the process that wrote the file
+    }
+    str.assign(image + 16, len);
+    return true;
+}
+
+static bool read_legacy_record(const char* image, RoomData& room) {
+    int32_t r_no;
+    int64_t days, cost, food_bill;
+    std::memcpy(&r_no, image, sizeof(r_no));
+    std::memcpy(&days, image + 104, sizeof(days));
+    std::memcpy(&cost, image + 112, sizeof(cost));
+    std::memcpy(&food_bill, image + 152, sizeof(food_bill));
+    if (room_type_of(r_no) < 0 || days < 1 || cost < 0 || food_bill < 0 || !read_legacy_string(image + 8, room.name) ||
+        !read_legacy_string(image + 40, room.address) || !read_legacy_string(image + 72, room.phone) ||
+        !read_legacy_string(image + 120, room.rtype)) {
+        return false;
+    }
+    room.room_no = r_no;
+    room.days = days;
+    room.cost = cost;
+    room.food_bill = food_bill;
+    return true;
+}
+
+// Returns the month index (years * 12 + month) of a business date
+static long month_of(long day) {
+    std::time_t t = static_cast<std::time_t>(day) * 86400;
+    std::tm tm_utc = *std::gmtime(&t);
+    return (tm_utc.tm_year + 1900) * 12L + tm_utc.tm_mon;
+}
+
+// Minimum rolling 12-month points for each tier above TIER_MEMBER
+static const long LOYALTY_TIER_THRESHOLDS[] = { 500, 2000, 5000 };
+static const long RUPEES_PER_POINT = 100;
+
+// Moves an account's ring forward to the given month, dropping months that
+// fell out of the window, and recomputes the tier. At most 12 slots are
+// touched, regardless of the gap.
+static void advance_loyalty_window(LoyaltyAccount& account, long month) {
+    if (month > account.head_month) {
+        long steps = std::min<long>(month - account.head_month, LoyaltyAccount::WINDOW_MONTHS);
+        for (long m = month - steps + 1; m <= month; ++m) {
+            long& slot = account.month_points[m % LoyaltyAccount::WINDOW_MONTHS];
+            account.rolling_points -= slot;
+            slot = 0;
+        }
+        account.head_month = month;
+    }
+
+    int tier = TIER_MEMBER;
+    while (tier < TIER_PLATINUM && account.rolling_points >= LOYALTY_TIER_THRESHOLDS[tier]) {
+        tier++;
+    }
+    account.tier = tier;
+}
+
+// Posts a charge to the routed folio of a room, touching only that room's data.
+// Returns the index of the folio the charge landed on.
+static int post_to_folio(RoomData& room, int category, long amount, long date, const std::string& description) {
+    int idx = room.routing[category];
+    if (idx < 0 || idx >= static_cast<int>(room.folios.size())) {
+        idx = 0; // Fall back to the guest folio
+    }
+    Folio& folio = room.folios[idx];
+    folio.lines.push_back({date, category, amount, FolioString(description.c_str())});
+    folio.total += amount;
+    folio.category_totals[category] += amount;
+    if (category == CHARGE_ROOM) {
+        room.room_charges += amount;
+    } else if (category == CHARGE_FOOD) {
+        room.food_bill += amount;
+    }
+    return idx;
+}
+
+// Moves the running totals of a record written before split folios onto its
+// guest folio, so that checkout and the invoice see them as charge lines
+static void bring_forward_totals(RoomData& room, long date) {
+    long room_charges = room.room_charges;
+    long food_bill = room.food_bill;
+    room.room_charges = 0;
+    room.food_bill = 0;
+    if (room_charges != 0) {
+        post_to_folio(room, CHARGE_ROOM, room_charges, date, "Room charges brought forward");
+    }
+    if (food_bill != 0) {
+        post_to_folio(room, CHARGE_FOOD, food_bill, date, "Food brought forward");
+    }
+}
+
+// Returns the sum of all folio totals of a room
+static long folio_balance(const RoomData& room) {
+    long sum = 0;
+    for (const auto& folio : room.folios) {
+        sum += folio.total;
+    }
+    return sum;
+}
+
+// Stay archive record layout: dates, room, nights and amounts, then strings
+static void write_archived_stay(std::ostream& out, const ArchivedStay& stay) {
+    write_long(out, stay.checkout_date);
+    write_long(out, stay.arrival_date);
+    write_long(out, stay.room_no);
+    write_long(out, stay.nights);
+    write_long(out, stay.room_charges);
+    write_long(out, stay.food_bill);
+    write_long(out, stay.total);
+    write_string(out, stay.name);
+    write_string(out, stay.address);
+    write_string(out, stay.phone);
+    write_string(out, stay.group_code);
+}
+
+static bool read_archived_stay(std::istream& in, ArchivedStay& stay) {
+    long room_no;
+    bool ok = read_long(in, stay.checkout_date) && read_long(in, stay.arrival_date) && read_long(in, room_no) &&
+              read_long(in, stay.nights) && read_long(in, stay.room_charges) && read_long(in, stay.food_bill) &&
+              read_long(in, stay.total) && read_string(in, stay.name) && read_string(in, stay.address) &&
+              read_string(in, stay.phone) && read_string(in, stay.group_code);
+    stay.room_no = static_cast<int>(room_no);
+    return ok;
+}
+
+// Zigzag mapping so small negative deltas stay small varints
+static uint64_t zigzag_encode(long value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+static long zigzag_decode(uint64_t value) {
+    return static_cast<long>((value >> 1) ^ (~(value & 1) + 1));
+}
+
+// Cold segment layout: magic, then varints: generation, stay count, first and
+// last checkout, string table, and per stay the checkout delta from the
+// previous stay, length of stay in days, room, nights, amounts and string ids
+static void encode_cold_segment(const std::vector<ArchivedStay>& stays, long generation, std::string& out) {
+    std::unordered_map<std::string, uint64_t> ids;
+    std::vector<const std::string*> strings;
+    auto intern = [&ids, &strings](const std::string& str) {
+        auto it = ids.find(str);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        ids[str] = strings.size();
+        strings.push_back(&str);
+        return static_cast<uint64_t>(strings.size() - 1);
+    };
+    std::string records;
+    long previous = stays.empty() ? 0 : stays.front().checkout_date;
+    for (const auto& stay : stays) {
+        put_varint(records, zigzag_encode(stay.checkout_date - previous));
+        put_varint(records, zigzag_encode(stay.checkout_date - stay.arrival_date));
+        put_varint(records, zigzag_encode(stay.room_no));
+        put_varint(records, zigzag_encode(stay.nights));
+        put_varint(records, zigzag_encode(stay.room_charges));
+        put_varint(records, zigzag_encode(stay.food_bill));
+        put_varint(records, zigzag_encode(stay.total));
+        put_varint(records, intern(stay.name));
+        put_varint(records, intern(stay.address));
+        put_varint(records, intern(stay.phone));
+        put_varint(records, intern(stay.group_code));
+        previous = stay.checkout_date;
+    }
+
+    long magic = 0x43534d48; // "HMSC"
+    out.assign(reinterpret_cast<const char*>(&magic), sizeof(magic));
+    put_varint(out, zigzag_encode(generation));
+    put_varint(out, stays.size());
+    put_varint(out, zigzag_encode(stays.empty() ? 0 : stays.front().checkout_date));
+    put_varint(out, zigzag_encode(stays.empty() ? 0 : stays.back().checkout_date));
+    put_varint(out, strings.size());
+    for (const std::string* str : strings) {
+        put_varint(out, str->size());
+        out += *str;
+    }
+    out += records;
+}
+
+static bool decode_cold_segment(const std::string& data, std::vector<ArchivedStay>& stays, long& first_checkout,
+                                long& last_checkout) {
+    long magic;
+    if (data.size() < sizeof(magic)) {
+        return false;
+    }
+    std::memcpy(&magic, data.data(), sizeof(magic));
+    size_t pos = sizeof(magic);
+    uint64_t generation, count, first, last, string_count;
+    if (magic != 0x43534d48 || !get_varint(data, pos, generation) || !get_varint(data, pos, count) ||
+        !get_varint(data, pos, first) || !get_varint(data, pos, last) || !get_varint(data, pos, string_count)) {
+        return false;
+    }
+    first_checkout = zigzag_decode(first);
+    last_checkout = zigzag_decode(last);
+    std::vector<std::string> strings;
+    for (uint64_t i = 0; i < string_count; ++i) {
+        uint64_t len;
+        if (!get_varint(data, pos, len) || pos + len > data.size()) {
+            return false;
+        }
+        strings.push_back(data.substr(pos, len));
+        pos += len;
+    }
+    long checkout = first_checkout;
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t v[11];
+        for (int f = 0; f < 11; ++f) {
+            if (!get_varint(data, pos, v[f])) {
+                return false;
+            }
+        }
+        if (v[7] >= strings.size() || v[8] >= strings.size() || v[9] >= strings.size() || v[10] >= strings.size()) {
+            return false;
+        }
+        ArchivedStay stay;
+        checkout += zigzag_decode(v[0]);
+        stay.checkout_date = checkout;
+        stay.arrival_date = checkout - zigzag_decode(v[1]);
+        stay.room_no = static_cast<int>(zigzag_decode(v[2]));
+        stay.nights = zigzag_decode(v[3]);
+        stay.room_charges = zigzag_decode(v[4]);
+        stay.food_bill = zigzag_decode(v[5]);
+        stay.total = zigzag_decode(v[6]);
+        stay.name = strings[v[7]];
+        stay.address = strings[v[8]];
+        stay.phone = strings[v[9]];
+        stay.group_code = strings[v[10]];
+        stays.push_back(stay);
+    }
+    return true;
+}
+
+static void fold_into_month(TrackedMap<long, MonthlyStayAggregate, MEM_INDEXES>& monthly, const ArchivedStay& stay) {
+    MonthlyStayAggregate& agg = monthly[month_of(stay.checkout_date)];
+    agg.month = month_of(stay.checkout_date);
+    agg.stays++;
+    agg.nights += stay.nights;
+    agg.room_charges += stay.room_charges;
+    agg.food_bill += stay.food_bill;
+    agg.total += stay.total;
+}
+
+bool IoThrottle::pace(size_t bytes) {
+    if (stop != nullptr && stop->load()) {
+        return false;
+    }
+    bytes_done += static_cast<long>(bytes);
+    if (bytes_per_second > 0) {
+        auto due = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                               std::chrono::duration<double>(static_cast<double>(bytes_done) / bytes_per_second));
+        std::this_thread::sleep_until(due);
+    }
+    return stop == nullptr || !stop->load();
+}
+
+static const size_t THROTTLE_CHUNK = 64 << 10;
+
+// Reads bytes [from, to) of a file in paced chunks
+static bool throttled_read(const std::string& file, long from, long to, std::string& data, IoThrottle& throttle) {
+    std::ifstream fin(file, std::ios::in | std::ios::binary);
+    if (!fin.is_open() || !fin.seekg(from)) {
+        return false;
+    }
+    data.resize(to - from);
+    for (size_t done = 0; done < data.size(); done += THROTTLE_CHUNK) {
+        size_t chunk = std::min(THROTTLE_CHUNK, data.size() - done);
+        if (!throttle.pace(chunk) || !fin.read(&data[done], chunk)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Writes a file in paced chunks and syncs it, so a later rename publishes complete data
+static bool throttled_write(const std::string& file, const std::string& data, IoThrottle& throttle) {
+    int fd = ::open(file.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = true;
+    for (size_t done = 0; ok && done < data.size(); done += THROTTLE_CHUNK) {
+        size_t chunk = std::min(THROTTLE_CHUNK, data.size() - done);
+        ok = throttle.pace(chunk) && ::write(fd, data.data() + done, chunk) == static_cast<ssize_t>(chunk);
+    }
+    ok = ok && fsync(fd) == 0;
+    close(fd);
+    if (!ok) {
+        std::remove(file.c_str());
+    }
+    return ok;
+}
+
+// Parses "<prefix><generation><suffix>", the naming of segment and aggregate files
+static bool parse_generation(const std::string& name, const std::string& prefix, const std::string& suffix, long& gen) {
+    if (name.size() <= prefix.size() + suffix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+        return false;
+    }
+    std::string digits = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+    if (digits.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    gen = std::atol(digits.c_str());
+    return true;
+}
+
+template <typename Str>
+std::string StayArchive::guest_key(const Str& phone) {
+    std::string key;
+    for (char c : phone) {
+        if (c >= '0' && c <= '9') {
+            key += c;
+        }
+    }
+    return key;
+}
+
+std::string StayArchive::segment_file(long gen) const {
+    return segment_dir + "/cold-" + std::to_string(gen) + ".seg";
+}
+
+std::string StayArchive::aggregate_file(long gen) const {
+    return segment_dir + "/monthly-" + std::to_string(gen) + ".agg";
+}
+
+// Adds one stay to the guest index, growing and rebuilding the filter when it fills up
+void StayArchive::index_stay(const std::string& key, StayLocation location) {
+    TrackedVector<StayLocation, MEM_INDEXES>& locations = guest_index[key];
+    locations.push_back(location);
+    if (locations.size() > 1) {
+        return; // Guest already in the filter
+    }
+    filter.add(GuestBloomFilter::hash_key(key));
+    if (filter.overfull()) {
+        rebuild_filter();
+    }
+}
+
+// Rebuilds the filter from the index, e.g. after compaction dropped guests
+void StayArchive::rebuild_filter() {
+    filter.reset(guest_index.size() * 2);
+    for (const auto& pair : guest_index) {
+        filter.add(GuestBloomFilter::hash_key(pair.first));
+    }
+}
+
+// Reads and decodes one cold segment
+bool StayArchive::load_segment(long gen, std::vector<ArchivedStay>& stays, SegmentInfo* info) const {
+    std::ifstream fin(segment_file(gen), std::ios::in | std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+    long first, last;
+    if (!fin.is_open() || !decode_cold_segment(data, stays, first, last)) {
+        return false;
+    }
+    if (info != nullptr) {
+        *info = {static_cast<long>(stays.size()), first, last, static_cast<long>(data.size())};
+    }
+    return true;
+}
+
+// Function to open the stay archive: the hot file, then the aggregates and
+// cold segments of the current generation, rebuilding the guest index and filter
+void StayArchive::open(const std::string& file, const std::string& tier_dir) {
+    path = file;
+    segment_dir = tier_dir;
+    if (const char* rate = std::getenv("HMS_COMPACT_KBPS")) {
+        compact_rate = std::atol(rate) * 1024;
+    }
+
+    std::ifstream fin(path, std::ios::in | std::ios::binary);
+    if (!fin.is_open()) {
+        std::ofstream fout(path, std::ios::out | std::ios::binary);
+        write_long(fout, FILE_MAGIC);
+        write_long(fout, generation);
+        header_size = fout ? static_cast<long>(2 * sizeof(long)) : 0;
+        file_size = header_size;
+    } else {
+        std::string data((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+        std::istringstream in(data);
+        long magic;
+        if (!read_long(in, magic) || (magic != FILE_MAGIC && magic != LEGACY_FILE_MAGIC) ||
+            (magic == FILE_MAGIC && !read_long(in, generation))) {
+            std::cerr << "\n Warning: " << path << " has an unknown format; stay history is unavailable." << std::endl;
+            path.clear();
+            return;
+        }
+        header_size = static_cast<long>(in.tellg());
+        long offset = header_size;
+        ArchivedStay stay;
+        while (offset < static_cast<long>(data.size()) && read_archived_stay(in, stay)) {
+            std::string key = guest_key(stay.phone);
+            if (!key.empty()) {
+                index_stay(key, {HOT_SEGMENT, offset});
+            }
+            offset = static_cast<long>(in.tellg());
+        }
+        if (offset < static_cast<long>(data.size())) {
+            std::cerr << "\n Warning: " << path << " has a damaged tail; it is dropped." << std::endl;
+            std::error_code ec;
+            std::filesystem::resize_file(path, offset, ec);
+        }
+        file_size = offset;
+    }
+
+    // Files newer than the hot file's generation belong to a compaction that never committed
+    std::error_code ec;
+    std::filesystem::create_directories(segment_dir, ec);
+    std::vector<long> segment_gens, aggregate_gens;
+    for (const auto& entry : std::filesystem::directory_iterator(segment_dir, ec)) {
+        std::string name = entry.path().filename().string();
+        long gen;
+        if (parse_generation(name, "cold-", ".seg", gen)) {
+            segment_gens.push_back(gen);
+        } else if (parse_generation(name, "monthly-", ".agg", gen)) {
+            aggregate_gens.push_back(gen);
+        } else if (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0) {
+            std::filesystem::remove(entry.path(), ec);
+        }
+    }
+    long aggregate_gen = -1;
+    for (long gen : aggregate_gens) {
+        if (gen <= generation) {
+            aggregate_gen = std::max(aggregate_gen, gen);
+        }
+    }
+    aggregate_generation = aggregate_gen;
+    for (long gen : aggregate_gens) {
+        if (gen != aggregate_gen) {
+            std::filesystem::remove(aggregate_file(gen), ec);
+        }
+    }
+
+    // Aggregate layout: magic, generation, folded segment generations, then per-month totals
+    std::vector<long> folded;
+    if (aggregate_gen >= 0) {
+        std::ifstream ain(aggregate_file(aggregate_gen), std::ios::in | std::ios::binary);
+        long magic, gen, folded_count, month_count;
+        bool ok = read_long(ain, magic) && magic == AGGREGATE_MAGIC && read_long(ain, gen) && read_long(ain, folded_count);
+        for (long i = 0; ok && i < folded_count; ++i) {
+            long folded_gen;
+            ok = read_long(ain, folded_gen);
+            folded.push_back(folded_gen);
+        }
+        ok = ok && read_long(ain, month_count);
+        for (long i = 0; ok && i < month_count; ++i) {
+            MonthlyStayAggregate agg;
+            ok = read_long(ain, agg.month) && read_long(ain, agg.stays) && read_long(ain, agg.nights) &&
+                 read_long(ain, agg.room_charges) && read_long(ain, agg.food_bill) && read_long(ain, agg.total);
+            if (ok) {
+                monthly[agg.month] = agg;
+            }
+        }
+        if (!ok) {
+            std::cerr << "\n Warning: " << aggregate_file(aggregate_gen) << " is damaged." << std::endl;
+        }
+    }
+
+    for (long gen : segment_gens) {
+        if (gen > generation || std::find(folded.begin(), folded.end(), gen) != folded.end()) {
+            std::filesystem::remove(segment_file(gen), ec);
+            continue;
+        }
+        std::vector<ArchivedStay> stays;
+        SegmentInfo info;
+        if (!load_segment(gen, stays, &info)) {
+            std::cerr << "\n Warning: " << segment_file(gen) << " is damaged; it is skipped." << std::endl;
+            continue;
+        }
+        segments[gen] = info;
+        for (size_t i = 0; i < stays.size(); ++i) {
+            std::string key = guest_key(stays[i].phone);
+            if (!key.empty()) {
+                index_stay(key, {gen, static_cast<long>(i)});
+            }
+        }
+    }
+}
+
+// Function to append a checked-out stay to the hot tier
+void StayArchive::append(const RoomData& room, long checkout_date) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (path.empty()) {
+        return;
+    }
+    ArchivedStay stay;
+    stay.checkout_date = checkout_date;
+    stay.arrival_date = room.arrival_date;
+    stay.room_no = room.room_no;
+    stay.nights = room.days;
+    stay.room_charges = room.room_charges;
+    stay.food_bill = room.food_bill;
+    stay.total = folio_balance(room);
+    stay.name = to_std_string(room.name);
+    stay.address = to_std_string(room.address);
+    stay.phone = to_std_string(room.phone);
+    stay.group_code = room.group_code;
+
+    std::ostringstream buf;
+    write_archived_stay(buf, stay);
+    std::string bytes = buf.str();
+    std::ofstream fout(path, std::ios::out | std::ios::binary | std::ios::app);
+    if (!fout.write(bytes.data(), bytes.size())) {
+        std::cerr << "\n Error: Could not write to " << path << std::endl;
+        return;
+    }
+    std::string key = guest_key(stay.phone);
+    if (!key.empty()) {
+        index_stay(key, {HOT_SEGMENT, file_size});
+    }
+    file_size += static_cast<long>(bytes.size());
+}
+
+// Function to look a guest up: the filter rules out new guests, the index finds
+// the stays of known ones in the hot file and cold segments
+bool StayArchive::lookup(const std::string& phone, std::vector<ArchivedStay>* out) {
+    std::string key = guest_key(phone);
+    std::lock_guard<std::mutex> lock(mutex);
+    probes++;
+    if (key.empty() || !filter.may_contain(GuestBloomFilter::hash_key(key))) {
+        filtered++;
+        return false;
+    }
+    auto it = guest_index.find(key);
+    if (it == guest_index.end()) {
+        false_positives++;
+        return false;
+    }
+    if (out != nullptr) {
+        std::ifstream fin(path, std::ios::in | std::ios::binary);
+        std::unordered_map<long, std::vector<ArchivedStay>> cold; // Segments decoded for this lookup
+        for (const StayLocation& location : it->second) {
+            if (location.segment == HOT_SEGMENT) {
+                ArchivedStay stay;
+                fin.seekg(location.position);
+                if (read_archived_stay(fin, stay)) {
+                    out->push_back(stay);
+                }
+                continue;
+            }
+            auto seg = cold.find(location.segment);
+            if (seg == cold.end()) {
+                seg = cold.emplace(location.segment, std::vector<ArchivedStay>()).first;
+                load_segment(location.segment, seg->second, nullptr);
+            }
+            if (location.position < static_cast<long>(seg->second.size())) {
+                out->push_back(seg->second[location.position]);
+            }
+        }
+        std::stable_sort(out->begin(), out->end(), [](const ArchivedStay& a, const ArchivedStay& b) {
+            return a.checkout_date < b.checkout_date;
+        });
+    }
+    return true;
+}
+
+// Function to start a background compaction; returns false if one is already running
+bool StayArchive::start_compaction(long today) {
+    if (path.empty() || compacting.exchange(true)) {
+        return false;
+    }
+    if (compactor.joinable()) {
+        compactor.join();
+    }
+    compactor = std::thread([this, today]() {
+        compact(today);
+        compacting = false;
+    });
+    return true;
+}
+
+// Stops a running compaction at its next paced chunk; its files are discarded on the next open
+StayArchive::~StayArchive() {
+    stop_compaction = true;
+    if (compactor.joinable()) {
+        compactor.join();
+    }
+}
+
+// Moves hot stays past HOT_DAYS into a new cold segment and folds stays past
+// ANCIENT_DAYS (from the hot file and from whole cold segments) into the monthly
+// aggregates. All reading, encoding and writing happens without the archive lock
+// at the throttled rate; the lock is held only to carry over stays appended
+// meanwhile, rename the new hot file into place and patch the index.
+void StayArchive::compact(long today) {
+    auto started = std::chrono::steady_clock::now();
+    IoThrottle throttle(compact_rate, &stop_compaction);
+    long hot_end, hot_header, gen, old_aggregate_gen;
+    std::vector<long> fold;
+    TrackedMap<long, MonthlyStayAggregate, MEM_INDEXES> new_monthly;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        hot_end = file_size;
+        hot_header = header_size;
+        gen = generation;
+        old_aggregate_gen = aggregate_generation;
+        new_monthly = monthly;
+        for (const auto& pair : segments) {
+            if (today - pair.second.last_checkout >= ANCIENT_DAYS) {
+                fold.push_back(pair.first);
+            }
+        }
+    }
+
+    std::string hot;
+    if (!throttled_read(path, 0, hot_end, hot, throttle)) {
+        return;
+    }
+    std::istringstream in(hot);
+    in.seekg(hot_header);
+    std::string kept; // Raw records that stay in the hot tier
+    std::vector<ArchivedStay> cold;
+    long aggregated = 0;
+    long offset = hot_header;
+    ArchivedStay stay;
+    while (offset < hot_end && read_archived_stay(in, stay)) {
+        long next = static_cast<long>(in.tellg());
+        long age = today - stay.checkout_date;
+        if (age < HOT_DAYS) {
+            kept.append(hot, offset, next - offset);
+        } else if (age < ANCIENT_DAYS) {
+            cold.push_back(stay);
+        } else {
+            fold_into_month(new_monthly, stay);
+            aggregated++;
+        }
+        offset = next;
+    }
+    if (offset != hot_end) {
+        return; // Not a clean record boundary; leave the file alone
+    }
+    for (long folded_gen : fold) {
+        std::vector<ArchivedStay> stays;
+        if (!load_segment(folded_gen, stays, nullptr)) {
+            return;
+        }
+        for (const auto& folded_stay : stays) {
+            fold_into_month(new_monthly, folded_stay);
+        }
+        aggregated += static_cast<long>(stays.size());
+        std::error_code ec;
+        if (!throttle.pace(std::filesystem::file_size(segment_file(folded_gen), ec))) {
+            return;
+        }
+    }
+    if (cold.empty() && aggregated == 0) {
+        return;
+    }
+
+    long new_gen = gen + 1;
+    long bytes_out = 0;
+    std::string segment;
+    std::stable_sort(cold.begin(), cold.end(), [](const ArchivedStay& a, const ArchivedStay& b) {
+        return a.checkout_date < b.checkout_date;
+    });
+    if (!cold.empty()) {
+        encode_cold_segment(cold, new_gen, segment);
+        if (!throttled_write(segment_file(new_gen), segment, throttle)) {
+            return;
+        }
+        bytes_out += static_cast<long>(segment.size());
+    }
+    if (aggregated > 0) {
+        std::ostringstream agg;
+        write_long(agg, AGGREGATE_MAGIC);
+        write_long(agg, new_gen);
+        write_long(agg, static_cast<long>(fold.size()));
+        for (long folded_gen : fold) {
+            write_long(agg, folded_gen);
+        }
+        write_long(agg, static_cast<long>(new_monthly.size()));
+        for (const auto& pair : new_monthly) {
+            const MonthlyStayAggregate& m = pair.second;
+            for (long v : {m.month, m.stays, m.nights, m.room_charges, m.food_bill, m.total}) {
+                write_long(agg, v);
+            }
+        }
+        if (!throttled_write(aggregate_file(new_gen), agg.str(), throttle)) {
+            std::remove(segment_file(new_gen).c_str());
+            return;
+        }
+        bytes_out += static_cast<long>(agg.str().size());
+    }
+    std::ostringstream header;
+    write_long(header, FILE_MAGIC);
+    write_long(header, new_gen);
+    std::string new_hot = header.str() + kept;
+    std::string tmp = path + ".tmp";
+    if (!throttled_write(tmp, new_hot, throttle)) {
+        std::remove(segment_file(new_gen).c_str());
+        std::remove(aggregate_file(new_gen).c_str());
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto lock_start = std::chrono::steady_clock::now();
+        // Stays checked out while compaction ran move over unchanged
+        std::string tail;
+        IoThrottle unpaced(0, nullptr);
+        bool ok = file_size == hot_end || throttled_read(path, hot_end, file_size, tail, unpaced);
+        if (ok && !tail.empty()) {
+            std::ofstream tout(tmp, std::ios::out | std::ios::binary | std::ios::app);
+            ok = static_cast<bool>(tout.write(tail.data(), tail.size()));
+        }
+        if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+            std::cerr << "\n Error: Could not replace " << path << "; compaction abandoned." << std::endl;
+            std::remove(tmp.c_str());
+            std::remove(segment_file(new_gen).c_str());
+            std::remove(aggregate_file(new_gen).c_str());
+            return;
+        }
+
+        // Patch the index: drop hot and folded locations, then add the new hot file and segment
+        for (auto it = guest_index.begin(); it != guest_index.end();) {
+            TrackedVector<StayLocation, MEM_INDEXES>& locations = it->second;
+            locations.erase(std::remove_if(locations.begin(), locations.end(), [&fold](const StayLocation& l) {
+                                return l.segment == HOT_SEGMENT ||
+                                       std::find(fold.begin(), fold.end(), l.segment) != fold.end();
+                            }),
+                            locations.end());
+            it = locations.empty() ? guest_index.erase(it) : std::next(it);
+        }
+        header_size = static_cast<long>(header.str().size());
+        std::istringstream hot_in(kept + tail);
+        long pos = 0;
+        ArchivedStay hot_stay;
+        while (read_archived_stay(hot_in, hot_stay)) {
+            std::string key = guest_key(hot_stay.phone);
+            if (!key.empty()) {
+                guest_index[key].push_back({HOT_SEGMENT, header_size + pos});
+            }
+            pos = static_cast<long>(hot_in.tellg());
+        }
+        for (size_t i = 0; i < cold.size(); ++i) {
+            std::string key = guest_key(cold[i].phone);
+            if (!key.empty()) {
+                guest_index[key].push_back({new_gen, static_cast<long>(i)});
+            }
+        }
+        rebuild_filter();
+        for (long folded_gen : fold) {
+            segments.erase(folded_gen);
+        }
+        if (!cold.empty()) {
+            segments[new_gen] = {static_cast<long>(cold.size()), cold.front().checkout_date, cold.back().checkout_date,
+                                 static_cast<long>(segment.size())};
+        }
+        monthly = new_monthly;
+        generation = new_gen;
+        if (aggregated > 0) {
+            aggregate_generation = new_gen;
+        }
+        file_size = header_size + static_cast<long>(kept.size() + tail.size());
+
+        last_compaction.generation = new_gen;
+        last_compaction.stays_compacted = static_cast<long>(cold.size());
+        last_compaction.stays_aggregated = aggregated;
+        last_compaction.bytes_in = throttle.bytes() - bytes_out - static_cast<long>(new_hot.size());
+        last_compaction.bytes_out = bytes_out + static_cast<long>(new_hot.size());
+        last_compaction.lock_ms =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - lock_start).count();
+        last_compaction.seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    }
+
+    // Committed: the folded segments and the previous aggregates are now garbage
+    for (long folded_gen : fold) {
+        std::remove(segment_file(folded_gen).c_str());
+    }
+    if (aggregated > 0 && old_aggregate_gen >= 0) {
+        std::remove(aggregate_file(old_aggregate_gen).c_str());
+    }
+}
+
+// Function to print archive size and filter effectiveness
+void StayArchive::print_stats(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t stays = 0;
+    for (const auto& pair : guest_index) {
+        stays += pair.second.size();
+    }
+    out << " Archived Stays: " << stays << " (" << guest_index.size() << " guests)" << std::endl;
+    out << " Bloom Filter: " << filter.key_count() << " keys in " << filter.bytes() << " bytes" << std::endl;
+    out << " Lookups: " << probes << " (" << filtered << " answered by the filter, "
+        << false_positives << " false positive(s))" << std::endl;
+}
+
+// Function to print the size of each retention tier and the monthly aggregates
+void StayArchive::print_retention(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    long hot_stays = 0;
+    for (const auto& pair : guest_index) {
+        for (const StayLocation& location : pair.second) {
+            hot_stays += location.segment == HOT_SEGMENT ? 1 : 0;
+        }
+    }
+    long cold_stays = 0, cold_bytes = 0;
+    for (const auto& pair : segments) {
+        cold_stays += pair.second.stays;
+        cold_bytes += pair.second.bytes;
+    }
+    out << " Generation: " << generation << std::endl;
+    out << " Hot (< " << HOT_DAYS << " days):     " << hot_stays << " stay(s), " << file_size << " bytes" << std::endl;
+    out << " Cold (< " << ANCIENT_DAYS << " days):   " << cold_stays << " stay(s) in " << segments.size()
+        << " segment(s), " << cold_bytes << " bytes" << std::endl;
+    out << " Ancient:             " << monthly.size() << " month(s) of aggregates" << std::endl;
+
+    std::vector<MonthlyStayAggregate> months;
+    for (const auto& pair : monthly) {
+        months.push_back(pair.second);
+    }
+    std::sort(months.begin(), months.end(), [](const MonthlyStayAggregate& a, const MonthlyStayAggregate& b) {
+        return a.month < b.month;
+    });
+    if (!months.empty()) {
+        out << "\n   Month   Stays  Nights   Room Rs.   Food Rs.  Total Rs." << std::endl;
+    }
+    for (const auto& m : months) {
+        out << "  " << m.month / 12 << "-" << std::setw(2) << std::setfill('0') << m.month % 12 + 1
+            << std::setfill(' ') << std::setw(7) << m.stays << std::setw(8) << m.nights << std::setw(11)
+            << m.room_charges << std::setw(11) << m.food_bill << std::setw(11) << m.total << std::endl;
+    }
+    if (compacting) {
+        out << "\n Compaction running in the background (" << compact_rate / 1024 << " KiB/s)." << std::endl;
+    } else if (last_compaction.generation > 0) {
+        out << "\n Last compaction: " << last_compaction.stays_compacted << " stay(s) to cold, "
+            << last_compaction.stays_aggregated << " folded into months, " << last_compaction.bytes_in
+            << " bytes read, " << last_compaction.bytes_out << " written in " << std::fixed << std::setprecision(2)
+            << last_compaction.seconds << " s (lock held " << last_compaction.lock_ms << " ms)" << std::endl;
+        out.unsetf(std::ios::fixed);
+    }
+}
+
+// Appends text to buf, escaping the characters HTML treats specially
+template <typename Str>
+static void append_html_escaped(std::string& buf, const Str& text) {
+    for (char ch : text) {
+        switch (ch) {
+            case '<': buf += "&lt;"; break;
+            case '>': buf += "&gt;"; break;
+            case '&': buf += "&amp;"; break;
+            case '"': buf += "&quot;"; break;
+            default: buf += ch; break;
+        }
+    }
+}
+
+// Appenders used by the invoice renderer, which writes straight into the
+// caller's buffer instead of concatenating temporary strings
+template <typename Str>
+static void append_text(std::string& buf, const Str& text) {
+    buf.append(text.data(), text.size());
+}
+
+static void append_number(std::string& buf, long value, int width = 0) {
+    char text[32];
+    int len = std::snprintf(text, sizeof(text), "%*ld", width, value);
+    buf.append(text, static_cast<size_t>(len));
+}
+
+// Appends a business date as YYYY-MM-DD (gmtime_r: invoices render on several threads)
+static void append_date(std::string& buf, long day) {
+    std::time_t t = static_cast<std::time_t>(day) * 86400;
+    std::tm tm_utc;
+    gmtime_r(&t, &tm_utc);
+    char text[16];
+    buf.append(text, std::strftime(text, sizeof(text), "%Y-%m-%d", &tm_utc));
+}
+
+// Renders an itemized invoice for a room into buf. buf is cleared but keeps its
+// capacity, so callers that render many invoices reuse one allocation.
+static void render_invoice(const RoomData& room, long date, InvoiceFormat format, std::string& buf) {
+    buf.clear();
+    if (format == INVOICE_TEXT) {
+        buf += " INVOICE - Room ";
+        append_number(buf, room.room_no);
+        buf += " (";
+        append_text(buf, room.rtype);
+        buf += ")\n Date: ";
+        append_date(buf, date);
+        buf += "\n Guest: ";
+        append_text(buf, room.name);
+        buf += "\n Address: ";
+        append_text(buf, room.address);
+        buf += "\n Phone: ";
+        append_text(buf, room.phone);
+        buf += "\n";
+        for (const auto& folio : room.folios) {
+            buf += "\n Folio: ";
+            append_text(buf, folio.payer);
+            buf += "\n ------------------------------------------------------\n";
+            for (const auto& line : folio.lines) {
+                buf += " ";
+                append_date(buf, line.date);
+                buf += "  ";
+                append_text(buf, line.description);
+                if (line.description.size() < 28) {
+                    buf.append(28 - line.description.size(), ' ');
+                }
+                append_number(buf, line.amount, 10);
+                buf += "\n";
+            }
+            buf += " ------------------------------------------------------\n";
+            buf += " Folio Total                             ";
+            append_number(buf, folio.total, 10);
+            buf += "\n";
+        }
+        buf += "\n Grand Total (Rs.)                       ";
+        append_number(buf, folio_balance(room), 10);
+        buf += "\n";
+    } else {
+        buf += "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>Invoice Room ";
+        append_number(buf, room.room_no);
+        buf += "</title></head><body>\n<h1>Invoice - Room ";
+        append_number(buf, room.room_no);
+        buf += " (";
+        append_text(buf, room.rtype);
+        buf += ")</h1>\n<p>Date: ";
+        append_date(buf, date);
+        buf += "<br>Guest: ";
+        append_html_escaped(buf, room.name);
+        buf += "<br>Address: ";
+        append_html_escaped(buf, room.address);
+        buf += "<br>Phone: ";
+        append_html_escaped(buf, room.phone);
+        buf += "</p>\n";
+        for (const auto& folio : room.folios) {
+            buf += "<h2>Folio: ";
+            append_html_escaped(buf, folio.payer);
+            buf += "</h2>\n<table border=\"1\">\n<tr><th>Date</th><th>Description</th><th>Amount</th></tr>\n";
+            for (const auto& line : folio.lines) {
+                buf += "<tr><td>";
+                append_date(buf, line.date);
+                buf += "</td><td>";
+                append_html_escaped(buf, line.description);
+                buf += "</td><td>";
+                append_number(buf, line.amount);
+                buf += "</td></tr>\n";
+            }
+            buf += "<tr><th colspan=\"2\">Folio Total</th><th>";
+            append_number(buf, folio.total);
+            buf += "</th></tr>\n</table>\n";
+        }
+        buf += "<h2>Grand Total: Rs. ";
+        append_number(buf, folio_balance(room));
+        buf += "</h2>\n</body></html>\n";
+    }
+}
+
+void ChannelIngestor::start(const std::string& dir, const std::string& ledger,
+                            const std::vector<std::string>& existing_refs, long business_date, AllotmentBook* book) {
+    if (running()) {
+        return;
+    }
+    allotments = book;
+    drop_dir = dir;
+    ledger_file = ledger;
+    today = business_date;
+    {
+        std::lock_guard<std::mutex> lock(refs_mutex);
+        known_refs.insert(existing_refs.begin(), existing_refs.end());
+    }
+    std::error_code ec;
+    for (const char* name : {"processing", "done", "rejected"}) {
+        std::filesystem::create_directories(subdir(name), ec);
+    }
+    scanner = std::thread(&ChannelIngestor::scan_loop, this);
+    validator = std::thread(&ChannelIngestor::validate_loop, this);
+}
+
+void ChannelIngestor::stop() {
+    if (!running()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    parsed.close();
+    ready.close();
+    scanner.join();
+    validator.join();
+}
+
+void ChannelIngestor::scan_now() {
+    std::unique_lock<std::mutex> lock(wake_mutex);
+    long ticket = ++scans_requested;
+    wake.notify_all();
+    wake.wait_for(lock, std::chrono::seconds(2), [this, ticket]() { return stopping || scans_done >= ticket; });
+}
+
+// Function to claim new drop files (oldest name first) and parse them. Files
+// left in processing/ by an earlier run go first. Only *.csv files are taken,
+// so a channel can upload under another name and rename when complete.
+void ChannelIngestor::scan_loop() {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    bool first_pass = true;
+    for (;;) {
+        long scan_ticket;
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            scan_ticket = scans_requested;
+        }
+        auto is_drop_file = [](const fs::directory_entry& entry) {
+            const std::string name = entry.path().filename().string();
+            return entry.is_regular_file() && name.size() > 4 && name.compare(name.size() - 4, 4, ".csv") == 0;
+        };
+        std::vector<std::string> names;
+        if (first_pass) {
+            for (const auto& entry : fs::directory_iterator(subdir("processing"), ec)) {
+                if (is_drop_file(entry)) {
+                    names.push_back(entry.path().filename().string());
+                }
+            }
+            first_pass = false;
+        }
+        std::vector<std::string> dropped;
+        for (const auto& entry : fs::directory_iterator(drop_dir, ec)) {
+            if (is_drop_file(entry)) {
+                dropped.push_back(entry.path().filename().string());
+            }
+        }
+        std::sort(names.begin(), names.end());
+        std::sort(dropped.begin(), dropped.end());
+        for (const auto& name : dropped) {
+            fs::path claimed = fs::path(subdir("processing")) / name;
+            if (fs::exists(claimed, ec)) {
+                continue; // Same name still in flight: take it on a later scan
+            }
+            fs::rename(fs::path(drop_dir) / name, claimed, ec);
+            if (!ec) {
+                names.push_back(name);
+            }
+        }
+        in_pipeline += static_cast<long>(names.size());
+        for (size_t i = 0; i < names.size(); ++i) {
+            ChannelBatch batch;
+            batch.file = names[i];
+            auto start = std::chrono::steady_clock::now();
+            parse_file(subdir("processing") + "/" + names[i], batch);
+            batch.parse_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (!parsed.push(std::move(batch))) {
+                in_pipeline -= static_cast<long>(names.size() - i);
+                return; // Stopping; the rest stay in processing/ for the next run
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        scans_done = scan_ticket;
+        wake.notify_all();
+        wake.wait_for(lock, std::chrono::seconds(1), [this]() { return stopping || scans_requested > scans_done; });
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+// Function to parse a drop file. Each line is
+//   booking_id,channel,room_type,arrival(YYYY-MM-DD),nights,name,phone,address
+// with the address running to the end of the line; blank lines and lines
+// starting with '#' are skipped. Malformed lines are kept with an error.
+bool ChannelIngestor::parse_file(const std::string& path, ChannelBatch& batch) const {
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        return false;
+    }
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line)) {
+        line_no++;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        ChannelBooking booking;
+        booking.line_no = line_no;
+        std::string fields[8];
+        size_t pos = 0;
+        int count = 0;
+        for (; count < 7; ++count) {
+            size_t comma = line.find(',', pos);
+            if (comma == std::string::npos) {
+                break;
+            }
+            fields[count] = line.substr(pos, comma - pos);
+            pos = comma + 1;
+        }
+        fields[count++] = line.substr(pos);
+        booking.booking_id = fields[0];
+        booking.channel = fields[1];
+        booking.rtype = fields[2];
+        booking.name = fields[5];
+        booking.phone = fields[6];
+        booking.address = fields[7];
+        char* end = nullptr;
+        booking.nights = std::strtol(fields[4].c_str(), &end, 10);
+        if (count < 8) {
+            booking.error = "expected 8 fields, found " + std::to_string(count);
+        } else if (!parse_date(fields[3], booking.arrival_date)) {
+            booking.error = "bad arrival date '" + fields[3] + "'";
+        } else if (fields[4].empty() || *end != '\0') {
+            booking.error = "bad number of nights '" + fields[4] + "'";
+        }
+        batch.bookings.push_back(std::move(booking));
+    }
+    return true;
+}
+
+// Function to dedupe and validate parsed files. The dedupe set is seeded from
+// the ledger here, off the startup path.
+void ChannelIngestor::validate_loop() {
+    {
+        std::ifstream in(ledger_file);
+        std::string line;
+        std::lock_guard<std::mutex> lock(refs_mutex);
+        while (std::getline(in, line)) {
+            known_refs.insert(line.substr(0, line.find(' ')));
+        }
+    }
+    ChannelBatch batch;
+    while (parsed.pop(batch)) {
+        auto start = std::chrono::steady_clock::now();
+        for (auto& booking : batch.bookings) {
+            validate(booking);
+        }
+        batch.validate_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (!ready.push(std::move(batch))) {
+            in_pipeline--;
+            return;
+        }
+    }
+}
+
+void ChannelIngestor::validate(ChannelBooking& booking) {
+    if (!booking.error.empty()) {
+        return; // Did not parse
+    }
+    const std::string ref = booking.ref();
+    {
+        std::lock_guard<std::mutex> lock(refs_mutex);
+        if (known_refs.count(ref) != 0) {
+            booking.duplicate = true;
+            booking.error = "duplicate of an existing reservation";
+            return;
+        }
+    }
+    long day = today;
+    if (booking.booking_id.empty() || booking.channel.empty()) {
+        booking.error = "missing booking id or channel";
+    } else if (room_type_index(booking.rtype) < 0) {
+        booking.error = "unknown room type '" + booking.rtype + "'";
+    } else if (booking.arrival_date < day) {
+        booking.error = "arrival date " + format_date(booking.arrival_date) + " has passed";
+    } else if (booking.arrival_date > day + 365) {
+        booking.error = "arrival date is more than a year ahead";
+    } else if (booking.nights < 1 || booking.nights > MAX_STAY_NIGHTS) {
+        booking.error = "nights must be 1-" + std::to_string(MAX_STAY_NIGHTS);
+    } else if (booking.name.empty()) {
+        booking.error = "missing guest name";
+    } else if (StayArchive::guest_key(booking.phone).empty()) {
+        booking.error = "phone number has no digits";
+    }
+    if (!booking.error.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(refs_mutex);
+        if (!known_refs.insert(ref).second) {
+            booking.duplicate = true; // Listed twice in the same file
+            booking.error = "duplicate of an existing reservation";
+            return;
+        }
+    }
+    booking.claimed = true;
+    booking.from_allotment = allotments != nullptr &&
+                             allotments->draw(booking.channel, room_type_index(booking.rtype), booking.arrival_date,
+                                              booking.nights);
+}
+
+// Function to record a committed file. Called after the room table is
+// durable, so a crash in between replays the file and dedupes every booking.
+void ChannelIngestor::finish(const ChannelBatch& batch, double commit_ms) {
+    namespace fs = std::filesystem;
+    std::string ledger_lines, rejects;
+    long accepted = 0, duplicates = 0, invalid = 0, unallocated = 0;
+    {
+        std::lock_guard<std::mutex> lock(refs_mutex);
+        for (const auto& booking : batch.bookings) {
+            if (booking.room_no > 0) {
+                accepted++;
+                ledger_lines += booking.ref() + " " + std::to_string(booking.room_no) + " " +
+                                format_date(booking.arrival_date) + "\n";
+                continue;
+            }
+            if (booking.claimed) {
+                known_refs.erase(booking.ref()); // No room was free: the channel may resend it
+                if (booking.from_allotment) {
+                    allotments->restore(booking.channel, room_type_index(booking.rtype), booking.arrival_date,
+                                        booking.arrival_date + booking.nights);
+                }
+                unallocated++;
+            } else if (booking.duplicate) {
+                duplicates++;
+            } else {
+                invalid++;
+            }
+            rejects += "line " + std::to_string(booking.line_no) + " " + booking.ref() + ": " + booking.error + "\n";
+        }
+    }
+    if (!ledger_lines.empty()) {
+        std::ofstream out(ledger_file, std::ios::out | std::ios::app);
+        out << ledger_lines;
+    }
+    std::error_code ec;
+    if (!rejects.empty()) {
+        std::ofstream out(subdir("rejected") + "/" + batch.file + ".rejects", std::ios::out | std::ios::trunc);
+        out << rejects;
+    }
+    fs::path target = fs::path(subdir("done")) / batch.file;
+    for (int n = 1; fs::exists(target, ec); ++n) {
+        target = fs::path(subdir("done")) / (batch.file + "." + std::to_string(n));
+    }
+    fs::rename(fs::path(subdir("processing")) / batch.file, target, ec);
+
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    stats.files++;
+    stats.bookings += static_cast<long>(batch.bookings.size());
+    stats.accepted += accepted;
+    stats.duplicates += duplicates;
+    stats.invalid += invalid;
+    stats.unallocated += unallocated;
+    stats.parse_ms += batch.parse_ms;
+    stats.validate_ms += batch.validate_ms;
+    stats.commit_ms += commit_ms;
+    recent.push_front(batch.file + ": " + std::to_string(accepted) + " booked, " + std::to_string(duplicates) +
+                      " duplicate, " + std::to_string(invalid) + " invalid, " + std::to_string(unallocated) +
+                      " without a free room");
+    if (recent.size() > 5) {
+        recent.pop_back();
+    }
+    in_pipeline--;
+}
+
+bool AllotmentBook::add(const std::string& agent, int room_type, long first_night, long last_night, long count,
+                        long release_days, std::string& error) {
+    int n = published.load(std::memory_order_relaxed);
+    if (agent.empty()) {
+        error = "missing agent";
+    } else if (room_type < 0 || room_type >= ROOM_TYPE_COUNT) {
+        error = "unknown room type";
+    } else if (last_night < first_night || last_night - first_night >= 366) {
+        error = "the date range must cover 1-366 nights";
+    } else if (count < 1 || count > ROOM_TYPE_RANGES[room_type].last - ROOM_TYPE_RANGES[room_type].first + 1) {
+        error = "the room count must be between 1 and the number of " + std::string(ROOM_TYPE_RANGES[room_type].name) +
+                " rooms";
+    } else if (release_days < 0) {
+        error = "the release period cannot be negative";
+    } else if (n == MAX_BLOCKS) {
+        error = "no room for more blocks";
+    }
+    for (int i = 0; error.empty() && i < n; ++i) {
+        const AllotmentBlock& other = *blocks[i];
+        if (other.agent == agent && other.room_type == room_type && first_night <= other.last_night &&
+            last_night >= other.first_night) {
+            error = "overlaps the block " + format_date(other.first_night) + " to " + format_date(other.last_night);
+        }
+    }
+    if (!error.empty()) {
+        return false;
+    }
+    std::unique_ptr<AllotmentBlock> block(new AllotmentBlock());
+    block->agent = agent;
+    block->room_type = room_type;
+    block->first_night = first_night;
+    block->last_night = last_night;
+    block->count = count;
+    block->release_days = release_days;
+    block->released_through = first_night - 1;
+    block->released_rooms = 0;
+    block->remaining.reset(new std::atomic<long>[block->nights()]);
+    for (long d = 0; d < block->nights(); ++d) {
+        block->remaining[d].store(count, std::memory_order_relaxed);
+    }
+    blocks[n] = std::move(block);
+    published.store(n + 1, std::memory_order_release); // Readers see the block fully built
+    return true;
+}
+
+int AllotmentBook::find(const std::string& agent, int room_type, long night) const {
+    int n = published.load(std::memory_order_acquire);
+    for (int i = 0; i < n; ++i) {
+        const AllotmentBlock& block = *blocks[i];
+        if (block.room_type == room_type && night >= block.first_night && night <= block.last_night &&
+            block.agent == agent) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// A released night's counter holds -1, so neither a draw nor a restore (both
+// compare-and-swap on a non-negative count) can touch it again
+bool AllotmentBook::draw(const std::string& agent, int room_type, long arrival, long nights) {
+    int i = nights < 1 ? -1 : find(agent, room_type, arrival);
+    if (i < 0 || arrival + nights - 1 > blocks[i]->last_night) {
+        return false;
+    }
+    AllotmentBlock& block = *blocks[i];
+    std::atomic<long>* nightly = &block.remaining[arrival - block.first_night];
+    for (long d = 0; d < nights; ++d) {
+        long left = nightly[d].load(std::memory_order_relaxed);
+        do {
+            if (left <= 0) {
+                restore(agent, room_type, arrival, arrival + d); // Give back the nights already taken
+                return false;
+            }
+        } while (!nightly[d].compare_exchange_weak(left, left - 1, std::memory_order_acq_rel, std::memory_order_relaxed));
+    }
+    return true;
+}
+
+void AllotmentBook::restore(const std::string& agent, int room_type, long from, long to) {
+    int i = find(agent, room_type, from);
+    if (i < 0) {
+        return;
+    }
+    AllotmentBlock& block = *blocks[i];
+    for (long night = from; night < to && night <= block.last_night; ++night) {
+        std::atomic<long>& left = block.remaining[night - block.first_night];
+        long seen = left.load(std::memory_order_relaxed);
+        while (seen >= 0 && seen < block.count &&
+               !left.compare_exchange_weak(seen, seen + 1, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+        }
+    }
+}
+
+long AllotmentBook::held(int room_type, long night) const {
+    int n = published.load(std::memory_order_acquire);
+    long total = 0;
+    for (int i = 0; i < n; ++i) {
+        const AllotmentBlock& block = *blocks[i];
+        if (block.room_type == room_type && night >= block.first_night && night <= block.last_night) {
+            total += std::max(0L, block.remaining[night - block.first_night].load(std::memory_order_relaxed));
+        }
+    }
+    return total;
+}
+
+long AllotmentBook::release_due(long today, std::string& summary) {
+    int n = published.load(std::memory_order_acquire);
+    long total = 0;
+    for (int i = 0; i < n; ++i) {
+        AllotmentBlock& block = *blocks[i];
+        long first = block.released_through + 1, released = 0;
+        while (block.released_through < block.last_night && block.released_through + 1 - block.release_days <= today) {
+            long night = ++block.released_through;
+            released += std::max(0L, block.remaining[night - block.first_night].exchange(-1));
+        }
+        if (block.released_through >= first) {
+            block.released_rooms += released;
+            total += released;
+            summary += (summary.empty() ? "" : ", ") + block.agent + " " + ROOM_TYPE_RANGES[block.room_type].name +
+                       " " + format_date(first) + ".." + format_date(block.released_through) +
+                       " rooms=" + std::to_string(released);
+        }
+    }
+    return total;
+}
+
+// Function to load the allotment blocks, dropping blocks whose last night has passed
+bool AllotmentBook::load(const std::string& file, long today) {
+    std::ifstream fin(file, std::ios::in | std::ios::binary);
+    long count;
+    if (!fin.is_open() || !read_long(fin, count)) {
+        return false;
+    }
+    for (long b = 0; b < count; ++b) {
+        std::string agent, error;
+        long room_type, first, last, rooms, release_days, released_through, released_rooms;
+        bool ok = read_string(fin, agent) && read_long(fin, room_type) && read_long(fin, first) &&
+                  read_long(fin, last) && read_long(fin, rooms) && read_long(fin, release_days) &&
+                  read_long(fin, released_through) && read_long(fin, released_rooms);
+        std::vector<long> remaining(ok && last >= first && last - first < 366 ? last - first + 1 : 0);
+        for (long& left : remaining) {
+            ok = ok && read_long(fin, left);
+        }
+        if (!ok) {
+            std::cerr << "\n Warning: " << file << " is truncated." << std::endl;
+            return false;
+        }
+        if (last < today || !add(agent, static_cast<int>(room_type), first, last, rooms, release_days, error)) {
+            continue;
+        }
+        AllotmentBlock& block = *blocks[published.load(std::memory_order_relaxed) - 1];
+        block.released_through = released_through;
+        block.released_rooms = released_rooms;
+        for (size_t d = 0; d < remaining.size(); ++d) {
+            block.remaining[d].store(remaining[d], std::memory_order_relaxed);
+        }
+    }
+    return true;
+}
+
+void AllotmentBook::save(const std::string& file) const {
+    std::ofstream fout(file, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!fout.is_open()) {
+        std::cerr << "\n Error: Could not open " << file << " for saving." << std::endl;
+        return;
+    }
+    int n = published.load(std::memory_order_acquire);
+    write_long(fout, n);
+    for (int i = 0; i < n; ++i) {
+        const AllotmentBlock& block = *blocks[i];
+        write_string(fout, block.agent);
+        write_long(fout, block.room_type);
+        write_long(fout, block.first_night);
+        write_long(fout, block.last_night);
+        write_long(fout, block.count);
+        write_long(fout, block.release_days);
+        write_long(fout, block.released_through);
+        write_long(fout, block.released_rooms);
+        for (long d = 0; d < block.nights(); ++d) {
+            write_long(fout, block.remaining[d].load(std::memory_order_relaxed));
+        }
+    }
+}
+
+void AllotmentBook::print(std::ostream& out, long today) const {
+    int n = published.load(std::memory_order_acquire);
+    if (n == 0) {
+        out << "\n No allotment blocks on contract." << std::endl;
+        return;
+    }
+    for (int i = 0; i < n; ++i) {
+        const AllotmentBlock& block = *blocks[i];
+        long unsold = 0;
+        for (long d = 0; d < block.nights(); ++d) {
+            unsold += std::max(0L, block.remaining[d].load(std::memory_order_relaxed));
+        }
+        out << "\n " << i + 1 << ". " << block.agent << " - " << ROOM_TYPE_RANGES[block.room_type].name << ", "
+            << format_date(block.first_night) << " to " << format_date(block.last_night) << ", " << block.count
+            << " room(s) a night, released " << block.release_days << " day(s) ahead" << std::endl;
+        out << "    Sold: " << block.count * block.nights() - unsold - block.released_rooms << " room-night(s), unsold: "
+            << unsold << ", released: " << block.released_rooms;
+        if (today >= block.first_night && today <= block.last_night) {
+            long tonight = block.remaining[today - block.first_night].load(std::memory_order_relaxed);
+            out << ", tonight: " << (tonight < 0 ? std::string("released") : std::to_string(tonight) + " left");
+        }
+        out << std::endl;
+    }
+}
+
+void ReservationBook::add(const RoomData& room) {
+    TrackedVector<RoomData, MEM_ROOM_TABLE>& list = by_room[room.room_no];
+    auto pos = std::find_if(list.begin(), list.end(),
+                            [&room](const RoomData& other) { return other.arrival_date > room.arrival_date; });
+    list.insert(pos, room);
+    count++;
+}
+
+long ReservationBook::next_arrival(int r_no, long from) const {
+    auto it = by_room.find(r_no);
+    if (it != by_room.end()) {
+        for (const RoomData& room : it->second) {
+            if (room.arrival_date + room.days > from) {
+                return room.arrival_date;
+            }
+        }
+    }
+    return -1;
+}
+
+bool ReservationBook::conflicts(int r_no, long from, long to) const {
+    long arrival = next_arrival(r_no, from);
+    return arrival >= 0 && arrival < to;
+}
+
+const RoomData* ReservationBook::arriving(int r_no, long date) const {
+    auto it = by_room.find(r_no);
+    if (it != by_room.end()) {
+        for (const RoomData& room : it->second) {
+            if (room.arrival_date == date) {
+                return &room;
+            }
+        }
+    }
+    return nullptr;
+}
+
+const RoomData* ReservationBook::departing(int r_no, long date) const {
+    auto it = by_room.find(r_no);
+    if (it != by_room.end()) {
+        for (const RoomData& room : it->second) {
+            if (room.arrival_date + room.days == date) {
+                return &room;
+            }
+        }
+    }
+    return nullptr;
+}
+
+bool ReservationBook::take_due(int r_no, long today, RoomData& out) {
+    auto it = by_room.find(r_no);
+    if (it == by_room.end() || it->second.front().arrival_date > today) {
+        return false;
+    }
+    out = it->second.front();
+    it->second.erase(it->second.begin());
+    if (it->second.empty()) {
+        by_room.erase(it);
+    }
+    count--;
+    return true;
+}
+
+void RevenueIndex::rebuild(long new_origin, size_t new_size) {
+    long shift = origin < 0 ? 0 : origin - new_origin;
+    for (int t = 0; t < ROOM_TYPE_COUNT; ++t) {
+        for (int c = 0; c < CHARGE_CATEGORY_COUNT; ++c) {
+            TrackedVector<long, MEM_INDEXES> moved(new_size, 0);
+            for (size_t i = 0; i < daily[t][c].size(); ++i) {
+                moved[i + shift] = daily[t][c][i];
+            }
+            daily[t][c].swap(moved);
+            // Linear-time build: each node passes its sum on to its parent
+            TrackedVector<long, MEM_INDEXES>& tree = trees[t][c];
+            tree.assign(new_size + 1, 0);
+            for (size_t i = 1; i <= new_size; ++i) {
+                tree[i] += daily[t][c][i - 1];
+                size_t parent = i + (i & (~i + 1));
+                if (parent <= new_size) {
+                    tree[parent] += tree[i];
+                }
+            }
+        }
+    }
+    origin = new_origin;
+}
+
+void RevenueIndex::post(int type, int category, long date, long amount) {
+    if (type < 0 || type >= ROOM_TYPE_COUNT || category < 0 || category >= CHARGE_CATEGORY_COUNT || amount == 0) {
+        return;
+    }
+    if (origin < 0) {
+        rebuild(date, 1024);
+    } else if (date < origin || date - origin >= static_cast<long>(size())) {
+        long new_origin = std::min(origin, date);
+        size_t new_size = size();
+        while (static_cast<long>(new_size) <= std::max(date, origin + static_cast<long>(size()) - 1) - new_origin) {
+            new_size *= 2;
+        }
+        rebuild(new_origin, new_size);
+    }
+    size_t offset = static_cast<size_t>(date - origin);
+    daily[type][category][offset] += amount;
+    TrackedVector<long, MEM_INDEXES>& tree = trees[type][category];
+    for (size_t i = offset + 1; i < tree.size(); i += i & (~i + 1)) {
+        tree[i] += amount;
+    }
+}
+
+long RevenueIndex::prefix(int type, int category, long date) const {
+    if (origin < 0 || date <= origin) {
+        return 0;
+    }
+    const TrackedVector<long, MEM_INDEXES>& tree = trees[type][category];
+    long sum = 0;
+    for (size_t i = static_cast<size_t>(std::min(date - origin, static_cast<long>(size()))); i > 0; i -= i & (~i + 1)) {
+        sum += tree[i];
+    }
+    return sum;
+}
+
+long RevenueIndex::range(int type, int category, long from, long to) const {
+    if (type < 0) {
+        long sum = 0;
+        for (int t = 0; t < ROOM_TYPE_COUNT; ++t) {
+            sum += range(t, category, from, to);
+        }
+        return sum;
+    }
+    return to < from ? 0 : prefix(type, category, to + 1) - prefix(type, category, from);
+}
+
+// Function to load the daily amounts (origin, size, then the non-zero days of
+// each type and category) and rebuild the trees from them
+AggregateLoad RevenueIndex::load(const std::string& file) {
+    std::ifstream fin(file, std::ios::in | std::ios::binary);
+    long saved_origin, saved_size;
+    if (!fin.is_open()) {
+        return AGGREGATE_MISSING;
+    }
+    if (!read_long(fin, saved_origin) || !read_long(fin, saved_size) || saved_size < 1 ||
+        saved_size > (1L << 20)) {
+        return AGGREGATE_DAMAGED;
+    }
+    std::vector<long> amounts[ROOM_TYPE_COUNT][CHARGE_CATEGORY_COUNT];
+    for (int t = 0; t < ROOM_TYPE_COUNT; ++t) {
+        for (int c = 0; c < CHARGE_CATEGORY_COUNT; ++c) {
+            amounts[t][c].assign(saved_size, 0);
+            long days, offset, amount;
+            if (!read_long(fin, days)) {
+                return AGGREGATE_DAMAGED;
+            }
+            for (long d = 0; d < days; ++d) {
+                if (!read_long(fin, offset) || !read_long(fin, amount) || offset < 0 || offset >= saved_size) {
+                    return AGGREGATE_DAMAGED;
+                }
+                amounts[t][c][offset] = amount;
+            }
+        }
+    }
+    for (int t = 0; t < ROOM_TYPE_COUNT; ++t) {
+        for (int c = 0; c < CHARGE_CATEGORY_COUNT; ++c) {
+            daily[t][c].assign(amounts[t][c].begin(), amounts[t][c].end());
+        }
+    }
+    origin = -1; // Nothing to shift: the amounts are already at their offsets
+    rebuild(saved_origin, static_cast<size_t>(saved_size));
+    return AGGREGATE_LOADED;
+}
+
+void RevenueIndex::save(const std::string& file) const {
+    if (origin < 0) {
+        return;
+    }
+    std::ofstream fout(file, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!fout.is_open()) {
+        std::cerr << "\n Error: Could not open " << file << " for saving." << std::endl;
+        return;
+    }
+    write_long(fout, origin);
+    write_long(fout, static_cast<long>(size()));
+    for (int t = 0; t < ROOM_TYPE_COUNT; ++t) {
+        for (int c = 0; c < CHARGE_CATEGORY_COUNT; ++c) {
+            const TrackedVector<long, MEM_INDEXES>& days = daily[t][c];
+            write_long(fout, static_cast<long>(days.size() - std::count(days.begin(), days.end(), 0L)));
+            for (size_t i = 0; i < days.size(); ++i) {
+                if (days[i] != 0) {
+                    write_long(fout, static_cast<long>(i));
+                    write_long(fout, days[i]);
+                }
+            }
+        }
+    }
+}
+
+// Key layout: type (4 bits), floor (8), wing (4), channel (8), date (32); ALL sets every bit of its field
+uint64_t OccupancyCube::key(int type, int floor, int wing, int channel, long date) {
+    return (static_cast<uint64_t>(type < 0 ? 0xF : type) << 52) |
+           (static_cast<uint64_t>(floor < 0 ? 0xFF : floor) << 44) |
+           (static_cast<uint64_t>(wing < 0 ? 0xF : wing) << 40) |
+           (static_cast<uint64_t>(channel < 0 ? 0xFF : channel) << 32) |
+           (date < 0 ? 0xFFFFFFFFULL : static_cast<uint64_t>(date));
+}
+
+void OccupancyCube::add(int type, int floor, int wing, int channel, long date, const CubeMeasures& delta) {
+    if (type < 0 || date < 0) {
+        return;
+    }
+    // Bit d of the mask rolls dimension d up to ALL
+    for (int mask = 0; mask < 32; ++mask) {
+        CubeMeasures& cell = cells[key((mask & 1) ? ALL : type, (mask & 2) ? ALL : floor, (mask & 4) ? ALL : wing,
+                                       (mask & 8) ? ALL : channel, (mask & 16) ? static_cast<long>(ALL) : date)];
+        cell.room_nights += delta.room_nights;
+        cell.revenue += delta.revenue;
+        cell.food_revenue += delta.food_revenue;
+    }
+    if (first_date < 0 || date < first_date) {
+        first_date = date;
+    }
+    last_date = std::max(last_date, date);
+}
+
+int OccupancyCube::find_channel(const std::string& name) const {
+    for (size_t i = 0; i < channels.size(); ++i) {
+        if (channels[i] == name) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+int OccupancyCube::channel_id(const std::string& name) {
+    int id = find_channel(name);
+    if (id >= 0) {
+        return id;
+    }
+    if (channels.size() + 1 >= static_cast<size_t>(MAX_CHANNELS)) {
+        if (channels.size() + 1 == static_cast<size_t>(MAX_CHANNELS)) {
+            channels.push_back("Other");
+        }
+        return MAX_CHANNELS - 1;
+    }
+    channels.push_back(name);
+    return static_cast<int>(channels.size() - 1);
+}
+
+// Desk bookings are channel 0; channel bookings are named by their reference prefix
+int OccupancyCube::channel_of(const RoomData& room) {
+    return room.channel_ref.empty() ? 0 : channel_id(to_std_string(room.channel_ref.substr(0, room.channel_ref.find(':'))));
+}
+
+void OccupancyCube::add_nights(const RoomData& room, long from, long to, int sign) {
+    CubeMeasures delta;
+    delta.room_nights = sign;
+    int channel = channel_of(room);
+    for (long night = from; night < to; ++night) {
+        add(room_type_of(room.room_no), room_floor(room.room_no), room_wing(room.room_no), channel, night, delta);
+    }
+}
+
+void OccupancyCube::add_charge(const RoomData& room, int category, long date, long amount) {
+    if (amount == 0) {
+        return;
+    }
+    CubeMeasures delta;
+    delta.revenue = amount;
+    delta.food_revenue = category == CHARGE_FOOD ? amount : 0;
+    add(room_type_of(room.room_no), room_floor(room.room_no), room_wing(room.room_no), channel_of(room), date, delta);
+}
+
+CubeMeasures OccupancyCube::slice(int type, int floor, int wing, int channel, long from, long to) const {
+    CubeMeasures sum;
+    if (from < 0) {
+        from = to = ALL;
+    } else {
+        from = std::max(from, first_date); // Only days with facts are looked up
+        to = std::min(to, last_date);
+    }
+    for (long date = from; date <= to; ++date) {
+        auto it = cells.find(key(type, floor, wing, channel, date));
+        if (it != cells.end()) {
+            sum.room_nights += it->second.room_nights;
+            sum.revenue += it->second.revenue;
+            sum.food_revenue += it->second.food_revenue;
+        }
+    }
+    return sum;
+}
+
+// Function to load the channel names and base cells, rolling each cell up again
+AggregateLoad OccupancyCube::load(const std::string& file) {
+    std::ifstream fin(file, std::ios::in | std::ios::binary);
+    long channel_count;
+    if (!fin.is_open()) {
+        return AGGREGATE_MISSING;
+    }
+    if (!read_long(fin, channel_count) || channel_count < 1 || channel_count > MAX_CHANNELS) {
+        return AGGREGATE_DAMAGED;
+    }
+    std::vector<std::string> names(static_cast<size_t>(channel_count));
+    for (auto& name : names) {
+        if (!read_string(fin, name)) {
+            return AGGREGATE_DAMAGED;
+        }
+    }
+    long cell_total;
+    if (!read_long(fin, cell_total) || cell_total < 0) {
+        return AGGREGATE_DAMAGED;
+    }
+    channels = names;
+    // Every field of a base cell must be a real value: an out-of-range one
+    // would decode as the ALL rollup key or as another field
+    const long floor_count = room_floor(ROOM_TYPE_RANGES[ROOM_TYPE_COUNT - 1].last);
+    for (long i = 0; i < cell_total; ++i) {
+        long type, floor, wing, channel, date;
+        CubeMeasures delta;
+        if (!read_long(fin, type) || !read_long(fin, floor) || !read_long(fin, wing) || !read_long(fin, channel) ||
+            !read_long(fin, date) || !read_long(fin, delta.room_nights) || !read_long(fin, delta.revenue) ||
+            !read_long(fin, delta.food_revenue) || type < 0 || type >= ROOM_TYPE_COUNT || floor < 1 ||
+            floor > floor_count || wing < 0 || wing >= WING_COUNT || channel < 0 || channel >= channel_count ||
+            date < 0 || date >= 0xFFFFFFFFL) {
+            return AGGREGATE_DAMAGED;
+        }
+        add(static_cast<int>(type), static_cast<int>(floor), static_cast<int>(wing), static_cast<int>(channel), date, delta);
+    }
+    return AGGREGATE_LOADED;
+}
+
+void OccupancyCube::save(const std::string& file) const {
+    std::ofstream fout(file, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!fout.is_open()) {
+        std::cerr << "\n Error: Could not open " << file << " for saving." << std::endl;
+        return;
+    }
+    write_long(fout, static_cast<long>(channels.size()));
+    for (const auto& name : channels) {
+        write_string(fout, name);
+    }
+    // Base cells have no field rolled up; they are 1 in 32 of the cells
+    std::vector<std::pair<uint64_t, const CubeMeasures*>> base;
+    for (const auto& pair : cells) {
+        uint64_t k = pair.first;
+        if ((k >> 52) != 0xF && ((k >> 44) & 0xFF) != 0xFF && ((k >> 40) & 0xF) != 0xF &&
+            ((k >> 32) & 0xFF) != 0xFF && (k & 0xFFFFFFFFULL) != 0xFFFFFFFFULL) {
+            base.push_back(std::make_pair(k, &pair.second));
+        }
+    }
+    write_long(fout, static_cast<long>(base.size()));
+    for (const auto& cell : base) {
+        write_long(fout, static_cast<long>(cell.first >> 52));
+        write_long(fout, static_cast<long>((cell.first >> 44) & 0xFF));
+        write_long(fout, static_cast<long>((cell.first >> 40) & 0xF));
+        write_long(fout, static_cast<long>((cell.first >> 32) & 0xFF));
+        write_long(fout, static_cast<long>(cell.first & 0xFFFFFFFFULL));
+        write_long(fout, cell.second->room_nights);
+        write_long(fout, cell.second->revenue);
+        write_long(fout, cell.second->food_revenue);
+    }
+}
+
+void MovementIndex::insert(Buckets& buckets, long date, int r_no) {
+    TrackedVector<int, MEM_INDEXES>& rooms = buckets[date];
+    rooms.insert(std::lower_bound(rooms.begin(), rooms.end(), r_no), r_no);
+}
+
+void MovementIndex::erase(Buckets& buckets, long date, int r_no) {
+    auto it = buckets.find(date);
+    if (it == buckets.end()) {
+        return;
+    }
+    TrackedVector<int, MEM_INDEXES>& rooms = it->second;
+    auto pos = std::lower_bound(rooms.begin(), rooms.end(), r_no);
+    if (pos != rooms.end() && *pos == r_no) {
+        rooms.erase(pos);
+    }
+    if (rooms.empty()) {
+        buckets.erase(it);
+    }
+}
+
+const TrackedVector<int, MEM_INDEXES>* MovementIndex::find(const Buckets& buckets, long date) {
+    auto it = buckets.find(date);
+    return it == buckets.end() ? nullptr : &it->second;
+}
+
+void MovementIndex::add(const RoomData& room) {
+    insert(arrivals, room.arrival_date, room.room_no);
+    insert(departures, room.arrival_date + room.days, room.room_no);
+    changes++;
+}
+
+void MovementIndex::remove(const RoomData& room) {
+    erase(arrivals, room.arrival_date, room.room_no);
+    erase(departures, room.arrival_date + room.days, room.room_no);
+    changes++;
+}
+
+void MovementIndex::move_departure(int r_no, long from, long to) {
+    if (from != to) {
+        erase(departures, from, r_no);
+        insert(departures, to, r_no);
+        changes++;
+    }
+}
+
+ChannelIngestor::Stats ChannelIngestor::get_stats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    return stats;
+}
+
+void ChannelIngestor::print_status(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    out << "\n Drop directory: " << drop_dir << "/ (" << (running() ? "watching" : "not running") << ", "
+        << in_pipeline << " file(s) in the pipeline)" << std::endl;
+    out << " Files: " << stats.files << ", bookings: " << stats.bookings << std::endl;
+    out << " Booked: " << stats.accepted << ", duplicates: " << stats.duplicates << ", invalid: " << stats.invalid
+        << ", no room free: " << stats.unallocated << std::endl;
+    out << std::fixed << std::setprecision(2);
+    out << " Stage time: parse " << stats.parse_ms << " ms, dedupe/validate " << stats.validate_ms
+        << " ms, allocate/commit " << stats.commit_ms << " ms" << std::endl;
+    out.unsetf(std::ios::fixed);
+    if (!recent.empty()) {
+        out << "\n Recent files:" << std::endl;
+        for (const auto& line : recent) {
+            out << "   " << line << std::endl;
+        }
+    }
+}
+
+// Constructor: Loads data when HotelManager object is created
+HotelManager::HotelManager(StartupProfiler* startup_profiler, bool read_only)
+    : room_directory(HotRoomTable::MAX_ROOMS + 1, nullptr), business_date(std::time(nullptr) / 86400),
+      request_results(4096, idempotency_ttl_from_env()),
+      movement_sheet_date(-1), movement_sheet_version(0), hot_rooms(&epochs),
+      profiler(startup_profiler), save_on_exit(startup_profiler == nullptr && !read_only),
+      data_file_rejected(false), bgsave_pid(0), bgsave_pipe(-1) {
+    const char* terminal = std::getenv("HMS_TERMINAL");
+    const char* tty = ttyname(STDIN_FILENO);
+    terminal_id = terminal ? terminal : (tty ? tty : "console");
+    if (save_on_exit) {
+        recover_partition_fold(); // Before loading: it may publish a staged room table
+    }
+    load_data(); // Runs the file open, read, decode, index and aggregate phases
+    if (save_on_exit && usable() && fold_partition_journals() < 0) {
+        std::cerr << "\n Error: The partitioned server's journals could not be folded into " << DATA_FILE
+                  << ". They are kept for the next start." << std::endl;
+        data_file_rejected = true;
+    }
+    startup_phase(nullptr);
+}
+
+// Destructor: Saves data when HotelManager object is destroyed
+HotelManager::~HotelManager() {
+    if (save_on_exit) {
+        save_data(); // Cancels a running snapshot: this save is newer
+        std::cout << "\n Memory at exit:" << std::endl;
+        print_memory_report(std::cout, rooms_map.size(), 0);
+    } else {
+        reap_bgsave(true); // Nothing newer is written, so a running snapshot may finish
+    }
+}
+
+// Helper to clear input buffer after numeric input
+void HotelManager::clearInputBuffer() {
+    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+}
+
+// Function to load data from file into the unordered_map
+void HotelManager::load_data() {
+    startup_phase("file open");
+    std::ifstream file(DATA_FILE, std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+        std::cout << "\n No existing record file found. Starting with empty data." << std::endl;
+        build_indexes_and_aggregates();
+        return;
+    }
+
+    // Read the whole file in one go, then decode from memory
+    startup_phase("read");
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+
+    startup_phase("decode");
+    std::istringstream fin(contents);
+
+    // File layout: magic, business date, then length-prefixed room records
+    long magic, saved_date;
+    if (!read_long(fin, magic) ||
+        (magic != RECORD_FILE_MAGIC && magic != RECORD_FILE_MAGIC_V4 && magic != RECORD_FILE_MAGIC_V3 &&
+         magic != RECORD_FILE_MAGIC_V2)) {
+        // No magic: a raw record image from before HMS2, checked in full before
+        // anything is taken from it. Its guests are treated as in house today.
+        if (contents.empty() || contents.size() % LEGACY_RECORD_SIZE != 0) {
+            reject_data_file("has an unknown format");
+            return;
+        }
+        for (size_t offset = 0; offset < contents.size(); offset += LEGACY_RECORD_SIZE) {
+            RoomData temp_room;
+            if (!read_legacy_record(contents.data() + offset, temp_room)) {
+                reject_data_file("is in the original record layout, but room record " +
+                                 std::to_string(offset / LEGACY_RECORD_SIZE + 1) + " cannot be recovered");
+                return;
+            }
+            temp_room.arrival_date = business_date;
+            temp_room.arrived = true;
+            bring_forward_totals(temp_room, business_date);
+            rooms_map[temp_room.room_no] = temp_room;
+        }
+        build_indexes_and_aggregates();
+        std::cout << "\n Data converted from the original record layout of " << DATA_FILE << std::endl;
+        return;
+    }
+    if (!read_long(fin, saved_date)) {
+        reject_data_file("is truncated or damaged");
+        return;
+    }
+    business_date = saved_date;
+
+    if (magic == RECORD_FILE_MAGIC_V2) {
+        // HMS2: room records up to the end of the file, charges as totals only
+        while (fin.peek() != std::char_traits<char>::eof()) {
+            RoomData temp_room;
+            if (!read_record(fin, temp_room, magic)) {
+                reject_data_file("is truncated or damaged");
+                return;
+            }
+            bring_forward_totals(temp_room, business_date);
+            rooms_map[temp_room.room_no] = temp_room;
+        }
+    }
+    long room_count;
+    if (magic == RECORD_FILE_MAGIC_V2 || !read_long(fin, room_count)) {
+        room_count = 0;
+    }
+    for (long i = 0; i < room_count; ++i) {
+        RoomData temp_room;
+        if (!read_record(fin, temp_room, magic)) {
+            reject_data_file("is truncated or damaged");
+            return;
+        }
+        rooms_map[temp_room.room_no] = temp_room;
+    }
+
+    // Group accounts: code, company, category totals, then per-room totals
+    long group_count;
+    if (!read_long(fin, group_count)) {
+        group_count = 0;
+    }
+    for (long g = 0; g < group_count; ++g) {
+        std::string code;
+        GroupAccount account;
+        long room_entries;
+        bool ok = read_string(fin, code) && read_string(fin, account.company) && read_long(fin, account.total);
+        for (int c = 0; ok && c < CHARGE_CATEGORY_COUNT; ++c) {
+            ok = read_long(fin, account.category_totals[c]);
+        }
+        ok = ok && read_long(fin, room_entries);
+        for (long e = 0; ok && e < room_entries; ++e) {
+            long r_no, amount;
+            ok = read_long(fin, r_no) && read_long(fin, amount);
+            account.room_totals[static_cast<int>(r_no)] = amount;
+        }
+        if (!ok) {
+            reject_data_file("has truncated group accounts");
+            return;
+        }
+        group_accounts[code] = account;
+    }
+
+    // Reservations: future channel bookings, in the room record layout. Older
+    // files kept them in the room table, from which they are moved out here.
+    long reservation_count = 0;
+    if (magic == RECORD_FILE_MAGIC && !read_long(fin, reservation_count)) {
+        reservation_count = 0;
+    }
+    for (long i = 0; i < reservation_count; ++i) {
+        RoomData reservation;
+        if (!read_record(fin, reservation, magic)) {
+            reject_data_file("has truncated or damaged reservations");
+            return;
+        }
+        reservations.add(reservation);
+    }
+    for (auto it = rooms_map.begin(); it != rooms_map.end();) {
+        if (!it->second.arrived && it->second.arrival_date > business_date) {
+            reservations.add(it->second);
+            it = rooms_map.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    build_indexes_and_aggregates();
+    std::cout << "\n Data loaded successfully from " << DATA_FILE << std::endl;
+}
+
+// Function to refuse an unreadable record file: saving over it at exit would
+// replace every stay it holds with an empty table
+void HotelManager::reject_data_file(const std::string& reason) {
+    std::cerr << "\n Error: " << DATA_FILE << " " << reason << ". It has been left untouched;"
+              << " move it aside to start with empty data." << std::endl;
+    rooms_map.clear();
+    group_accounts.clear();
+    save_on_exit = false;
+    data_file_rejected = true;
+}
+
+// Function to refuse to run on a damaged aggregate file. Rebuilding it from
+// the room table would lose the history of guests already checked out, so
+// the file is kept as it is for the user to restore or move aside.
+void HotelManager::reject_aggregate_file(const std::string& file) {
+    std::cerr << "\n Error: " << file << " is truncated or damaged. It has been left untouched;"
+              << " restore it, or move it aside to rebuild it from the rooms in house." << std::endl;
+    save_on_exit = false;
+    data_file_rejected = true;
+}
+
+// Function to build the in-memory indexes and aggregates after the room table is loaded
+void HotelManager::build_indexes_and_aggregates() {
+    startup_phase("index build");
+    for (auto& pair : rooms_map) {
+        refresh_hot_room(pair.second);
+        room_directory[pair.first] = &pair.second;
+    }
+    availability.rebuild(business_date, rooms_map, reservations);
+    AggregateLoad revenue_state = revenue.load(REVENUE_FILE);
+    if (revenue_state == AGGREGATE_DAMAGED) {
+        reject_aggregate_file(REVENUE_FILE);
+    } else if (revenue_state == AGGREGATE_MISSING) {
+        // First run: start from the charges on the rooms still in house
+        for (const auto& pair : rooms_map) {
+            for (const auto& folio : pair.second.folios) {
+                for (const auto& line : folio.lines) {
+                    revenue.post(room_type_of(pair.first), line.category, line.date, line.amount);
+                }
+            }
+        }
+    }
+    for (const auto& pair : rooms_map) {
+        movements.add(pair.second);
+    }
+    reservations.for_each([this](const RoomData& room) { movements.add(room); });
+    AggregateLoad cube_state = cube.load(CUBE_FILE);
+    if (cube_state == AGGREGATE_DAMAGED) {
+        reject_aggregate_file(CUBE_FILE);
+    } else if (cube_state == AGGREGATE_MISSING) {
+        for (const auto& pair : rooms_map) {
+            const RoomData& room = pair.second;
+            // A guest not in house by now was a no-show on the nights already closed
+            long from = room.arrived ? room.arrival_date : std::max(room.arrival_date, business_date);
+            cube.add_nights(room, from, room.arrival_date + room.days, 1);
+            for (const auto& folio : room.folios) {
+                for (const auto& line : folio.lines) {
+                    cube.add_charge(room, line.category, line.date, line.amount);
+                }
+            }
+        }
+        reservations.for_each([this](const RoomData& room) {
+            cube.add_nights(room, room.arrival_date, room.arrival_date + room.days, 1);
+        });
+    }
+    audit_trail.open(AUDIT_FILE);
+    stay_archive.open(ARCHIVE_FILE, ARCHIVE_DIR);
+    if (save_on_exit) { // Only the desk that answers requests may compact the log
+        request_results.open(REQUEST_FILE);
+    }
+
+    startup_phase("aggregate build");
+    load_loyalty();
+    allotments.load(ALLOTMENT_FILE, business_date);
+    if (save_on_exit) { // A profiling instance must not replace the running desk's snapshot
+        snapshot_publisher.open();
+        snapshot_publisher.publish(rooms_map, business_date, availability);
+    }
+}
+
+// Function to save data from the unordered_map to file
+void HotelManager::save_data() {
+    // Through the temporary file, after any running BGSAVE child is cancelled:
+    // its older snapshot would otherwise be renamed on top of this save
+    if (!commit_room_table()) { // Also saves the allotments
+        std::cerr << "\n Error: Could not save data to " << DATA_FILE << "." << std::endl;
+        return;
+    }
+    save_loyalty();
+    revenue.save(REVENUE_FILE);
+    cube.save(CUBE_FILE);
+    std::cout << "\n Data saved successfully to " << DATA_FILE << std::endl;
+}
+
+// Function to read an optional request key (sent by kiosks and integrations so
+// a retry after a lost reply does not book or charge twice). If the key was
+// already used, the original result is shown and true is returned.
+bool HotelManager::replay_keyed_request(std::string& key) {
+    std::cout << "\n Request Key (optional, Enter to skip): ";
+    std::getline(std::cin, key);
+    std::string result;
+    if (key.empty() || request_results.lookup(key, result) != IdempotencyTable::DONE) {
+        return false;
+    }
+    std::cout << "\n Request " << key << " was already processed: " << result << std::endl;
+    return true;
+}
+
+// Function to serialize the room table and group accounts
+void HotelManager::write_room_table(std::ostream& fout) {
+    write_long(fout, RECORD_FILE_MAGIC);
+    write_long(fout, business_date);
+    write_long(fout, static_cast<long>(rooms_map.size()));
+    for (const auto& pair : rooms_map) {
+        write_record(fout, pair.second);
+    }
+    write_long(fout, static_cast<long>(group_accounts.size()));
+    for (const auto& pair : group_accounts) {
+        const GroupAccount& account = pair.second;
+        write_string(fout, pair.first);
+        write_string(fout, account.company);
+        write_long(fout, account.total);
+        for (int c = 0; c < CHARGE_CATEGORY_COUNT; ++c) {
+            write_long(fout, account.category_totals[c]);
+        }
+        write_long(fout, static_cast<long>(account.room_totals.size()));
+        for (const auto& rt : account.room_totals) {
+            write_long(fout, rt.first);
+            write_long(fout, rt.second);
+        }
+    }
+    write_long(fout, static_cast<long>(reservations.size()));
+    reservations.for_each([&fout](const RoomData& room) { write_record(fout, room); });
+}
+
+// Sums a field (in kB) over the memory map of the calling process
+static long smaps_total_kb(const char* field) {
+    std::ifstream smaps("/proc/self/smaps_rollup");
+    if (!smaps.is_open()) {
+        smaps.open("/proc/self/smaps");
+    }
+    std::string key;
+    long total = 0;
+    while (smaps >> key) {
+        if (key == field) {
+            long kb;
+            smaps >> kb;
+            total += kb;
+        }
+        smaps.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+    return total;
+}
+
+// Function to fork a child that writes the frozen copy-on-write image of the
+// room table to its own temporary file while the parent keeps serving the
+// desk. The child reports back through a pipe and leaves with _exit so no
+// destructor (and no exit-time save) runs in it. The parent renames the file
+// over DATA_FILE when it reaps the child, so a cancelled snapshot never lands.
+bool HotelManager::start_bgsave() {
+    if (bgsave_pid != 0) {
+        return false;
+    }
+    int fds[2];
+    if (pipe(fds) != 0) {
+        std::cerr << "\n Error: Could not create snapshot pipe: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    std::cout.flush(); // Buffered output would otherwise be written twice
+    bgsave_started = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::cerr << "\n Error: fork failed: " << std::strerror(errno) << std::endl;
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        auto save_start = std::chrono::steady_clock::now();
+        BgsaveResult result;
+        std::ostringstream image;
+        write_room_table(image);
+        IoThrottle unpaced(0, nullptr);
+        result.ok = throttled_write(bgsave_file(getpid()), image.str(), unpaced);
+        result.bytes = static_cast<long>(image.str().size());
+        result.rooms = static_cast<long>(rooms_map.size());
+        result.save_ms =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - save_start).count();
+        result.cow_kb = smaps_total_kb("Private_Dirty:");
+        ssize_t written = write(fds[1], &result, sizeof(result));
+        _exit(result.ok && written == static_cast<ssize_t>(sizeof(result)) ? 0 : 1);
+    }
+    close(fds[1]);
+    bgsave_pid = pid;
+    bgsave_pipe = fds[0];
+    last_bgsave = BgsaveResult();
+    last_bgsave.fork_ms =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - bgsave_started).count();
+    return true;
+}
+
+// Function to collect a finished snapshot child and its report; with wait set,
+// blocks until the child is done
+void HotelManager::reap_bgsave(bool wait) {
+    if (bgsave_pid == 0) {
+        return;
+    }
+    int status;
+    pid_t done = waitpid(bgsave_pid, &status, wait ? 0 : WNOHANG);
+    if (done == 0 || (done < 0 && errno == EINTR)) {
+        return; // Still running
+    }
+    double fork_ms = last_bgsave.fork_ms;
+    BgsaveResult result;
+    if (done < 0 || read(bgsave_pipe, &result, sizeof(result)) != static_cast<ssize_t>(sizeof(result))) {
+        result = BgsaveResult();
+    }
+    result.ok = result.ok && done > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    std::string tmp = bgsave_file(bgsave_pid);
+    result.ok = result.ok && std::rename(tmp.c_str(), DATA_FILE.c_str()) == 0;
+    if (!result.ok) {
+        std::remove(tmp.c_str());
+    }
+    result.fork_ms = fork_ms;
+    result.total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - bgsave_started).count();
+    last_bgsave = result;
+    close(bgsave_pipe);
+    bgsave_pipe = -1;
+    bgsave_pid = 0;
+    append_journal("BGSAVE " + format_date(business_date) + (result.ok ? " ok" : " failed") +
+                   " rooms=" + std::to_string(result.rooms) + " bytes=" + std::to_string(result.bytes) +
+                   " cow_kb=" + std::to_string(result.cow_kb));
+}
+
+// Function to stop a running snapshot child without waiting for its save; its
+// temporary file is removed, so the older image is never renamed into place
+void HotelManager::cancel_bgsave() {
+    if (bgsave_pid == 0) {
+        return;
+    }
+    kill(bgsave_pid, SIGKILL);
+    int status;
+    while (waitpid(bgsave_pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    std::remove(bgsave_file(bgsave_pid).c_str());
+    double fork_ms = last_bgsave.fork_ms;
+    last_bgsave = BgsaveResult();
+    last_bgsave.fork_ms = fork_ms;
+    last_bgsave.total_ms =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - bgsave_started).count();
+    close(bgsave_pipe);
+    bgsave_pipe = -1;
+    bgsave_pid = 0;
+    append_journal("BGSAVE " + format_date(business_date) + " cancelled");
+}
+
+// Function to load the loyalty ledger
+void HotelManager::load_loyalty() {
+    std::ifstream fin(LOYALTY_FILE, std::ios::in | std::ios::binary);
+    if (!fin.is_open()) {
+        return;
+    }
+    long count;
+    if (!read_long(fin, count)) {
+        return;
+    }
+    for (long i = 0; i < count; ++i) {
+        std::string phone;
+        LoyaltyAccount account;
+        long tier;
+        bool ok = read_string(fin, phone) && read_long(fin, account.points_balance) &&
+                  read_long(fin, account.head_month) && read_long(fin, account.stays) && read_long(fin, tier);
+        for (int m = 0; ok && m < LoyaltyAccount::WINDOW_MONTHS; ++m) {
+            ok = read_long(fin, account.month_points[m]);
+            account.rolling_points += account.month_points[m];
+        }
+        if (!ok) {
+            std::cerr << "\n Warning: " << LOYALTY_FILE << " is truncated." << std::endl;
+            break;
+        }
+        account.tier = static_cast<int>(tier);
+        loyalty_ledger[phone] = account;
+    }
+}
+
+// Function to save the loyalty ledger
+void HotelManager::save_loyalty() {
+    std::ofstream fout(LOYALTY_FILE, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!fout.is_open()) {
+        std::cerr << "\n Error: Could not open " << LOYALTY_FILE << " for saving." << std::endl;
+        return;
+    }
+    write_long(fout, static_cast<long>(loyalty_ledger.size()));
+    for (const auto& pair : loyalty_ledger) {
+        const LoyaltyAccount& account = pair.second;
+        write_string(fout, pair.first);
+        write_long(fout, account.points_balance);
+        write_long(fout, account.head_month);
+        write_long(fout, account.stays);
+        write_long(fout, account.tier);
+        for (int m = 0; m < LoyaltyAccount::WINDOW_MONTHS; ++m) {
+            write_long(fout, account.month_points[m]);
+        }
+    }
+}
+
+// Function to credit loyalty points for a completed stay
+void HotelManager::award_loyalty_points(const RoomData& room) {
+    if (room.phone.empty()) {
+        return;
+    }
+    long points = (room.room_charges + room.food_bill) / RUPEES_PER_POINT;
+    long month = month_of(business_date);
+    LoyaltyAccount& account = loyalty_ledger[to_std_string(room.phone)];
+    if (account.head_month == 0) {
+        account.head_month = month; // New account: the ring starts at this month
+    }
+    advance_loyalty_window(account, month); // Age the ring first, or it would clear the slot credited below
+    account.month_points[month % LoyaltyAccount::WINDOW_MONTHS] += points;
+    account.rolling_points += points;
+    account.points_balance += points;
+    account.stays++;
+    advance_loyalty_window(account, month); // Same month: only recomputes the tier
+    std::cout << "\n " << points << " loyalty points credited. Tier: " << LOYALTY_TIER_NAMES[account.tier]
+              << " (" << account.points_balance << " points)" << std::endl;
+}
+
+// Function to look up a loyalty account by phone number, or nullptr if none
+const LoyaltyAccount* HotelManager::loyalty_lookup(const std::string& phone) {
+    auto it = loyalty_ledger.find(phone);
+    if (it == loyalty_ledger.end()) {
+        return nullptr;
+    }
+    advance_loyalty_window(it->second, month_of(business_date));
+    return &it->second;
+}
+
+// Function to draw the main menu
+void HotelManager::print_main_menu(std::ostream& out) {
+    out << "\n\t\t\t +---------------------------------+" << std::endl;
+    out << "\n\t\t\t |          THE HOTEL            |" << std::endl;
+    out << "\n\t\t\t +---------------------------------+" << std::endl;
+    out << "\n\n\t\t\t ********* MAIN MENU *********" << std::endl;
+    out << "\n\n\t\t\t 1. Book A Room" << std::endl;
+    out << "\n\t\t\t 2. Customer Information" << std::endl;
+    out << "\n\t\t\t 3. Rooms Allotted" << std::endl;
+    out << "\n\t\t\t 4. Edit Customer Details" << std::endl;
+    out << "\n\t\t\t 5. Order Food from Restaurant" << std::endl;
+    out << "\n\t\t\t 6. Back Office" << std::endl;
+    out << "\n\t\t\t 7. Exit" << std::endl;
+    out << "\n\t\t\t Business Date: " << format_date(business_date) << std::endl;
+}
+
+// Function to display the main menu of the hotel management system
+void HotelManager::main_menu() {
+    int choice;
+    // Only the interactive desk takes channel bookings
+    std::vector<std::string> channel_refs;
+    for (const auto& pair : rooms_map) {
+        if (!pair.second.channel_ref.empty()) {
+            channel_refs.push_back(to_std_string(pair.second.channel_ref));
+        }
+    }
+    reservations.for_each([&channel_refs](const RoomData& room) { channel_refs.push_back(to_std_string(room.channel_ref)); });
+    channel_ingest.start(CHANNEL_DIR, CHANNEL_LEDGER, channel_refs, business_date, &allotments);
+    do {
+        ingest_channel_batches();
+        snapshot_publisher.publish(rooms_map, business_date, availability);
+        epochs.collect(); // Free guest copies retired by the previous operation
+        reap_bgsave(false);
+        system("clear"); 
+        print_main_menu(std::cout);
+        std::cout << "\n\t\t\t Enter Your Choice: ";
+        std::cin >> choice;
+        clearInputBuffer(); 
+
+        switch(choice) {
+            case 1:
+                add_room();
+                break;
+            case 2:
+                display_room();
+                break;
+            case 3:
+                display_all_rooms();
+                break;
+            case 4:
+                edit_customer_details();
+                break;
+            case 5:
+                order_food();
+                break;
+            case 6:
+                back_office_menu();
+                break;
+            case 7:
+                std::cout << "\n Exiting Hotel Management System. Goodbye!" << std::endl;
+                break;
+            default:
+                std::cout << "\n\n\t\t\t Wrong choice. Please try again." << std::endl;
+                std::cout << "\n\t\t\t Press Enter to continue. ";
+                std::cin.get(); 
+        }
+    } while (choice != 7);
+}
+
+// Function to add a new customer and book a room
+void HotelManager::add_room() {
+    system("clear");
+    int r_no;
+    std::cout << "\n\t\t\t +---------------------------------+" << std::endl;
+    std::cout << "\n\t\t\t | Rooms | Room Type |" << std::endl;
+    std::cout << "\n\t\t\t +---------------------------------+" << std::endl;
+    for (int t = 0; t < ROOM_TYPE_COUNT; ++t) {
+        std::cout << "\n\t\t\t | " << ROOM_TYPE_RANGES[t].first << "-" << ROOM_TYPE_RANGES[t].last << " | "
+                  << ROOM_TYPE_RANGES[t].name << " |" << std::endl;
+    }
+    std::cout << "\n\t\t\t +---------------------------------+" << std::endl;
+    std::cout << "\n\n ENTER CUSTOMER DETAILS";
+    std::cout << "\n -----------------------";
+    std::string request_key;
+    if (replay_keyed_request(request_key)) {
+        std::cout << "\n Press Enter to continue.";
+        std::cin.get();
+        return;
+    }
+    std::cout << "\n\n Room Number (" << ROOM_TYPE_RANGES[0].first << "-" << ROOM_TYPE_RANGES[ROOM_TYPE_COUNT - 1].last
+              << "): ";
+    std::cin >> r_no;
+    clearInputBuffer();
+
+    int status = check_room_status(r_no);
+    std::string outcome;
+    bool succeeded = false; // Refusals are not remembered: a retry is checked again
+
+    if (status == 1) {
+        RoomData& reserved = rooms_map[r_no];
+        char check_in = 'n';
+        if (!reserved.arrived && reserved.arrival_date <= business_date) {
+            std::cout << " Room " << r_no << " is reserved for " << reserved.name << " (arriving "
+                      << format_date(reserved.arrival_date) << "). Check in now (y/n): ";
+            std::cin >> check_in;
+            clearInputBuffer();
+        }
+        if (check_in == 'y' || check_in == 'Y') {
+            reserved.arrived = true;
+            reserved.no_show = false;
+            refresh_hot_room(reserved);
+            outcome = to_std_string(reserved.name) + " has checked in to Room " + std::to_string(r_no) + ".";
+            succeeded = true;
+        } else {
+            outcome = "Sorry, Room " + std::to_string(r_no) + " is already booked.";
+        }
+    } else if (status == 2) {
+        outcome = "Sorry, Room " + std::to_string(r_no) + " does not exist (valid range " +
+                  std::to_string(ROOM_TYPE_RANGES[0].first) + "-" +
+                  std::to_string(ROOM_TYPE_RANGES[ROOM_TYPE_COUNT - 1].last) + ").";
+    } else {
+        RoomData new_room;
+        new_room.room_no = r_no;
+        std::cout << " Name: ";
+        std::getline(std::cin, new_room.name);
+        std::cout << " Address: ";
+        std::getline(std::cin, new_room.address);
+        std::cout << " Phone Number: ";
+        std::getline(std::cin, new_room.phone);
+        if (const LoyaltyAccount* account = loyalty_lookup(to_std_string(new_room.phone))) {
+            std::cout << " Welcome back! Loyalty Tier: " << LOYALTY_TIER_NAMES[account->tier]
+                      << " (" << account->points_balance << " points)" << std::endl;
+        } else if (stay_archive.lookup(to_std_string(new_room.phone), nullptr)) {
+            std::cout << " Welcome back! (returning guest)" << std::endl;
+        }
+        std::cout << " Number of Days: ";
+        std::cin >> new_room.days;
+        clearInputBuffer();
+        if (new_room.days < 1 || new_room.days > MAX_STAY_NIGHTS) {
+            std::cout << "\n Sorry, the stay must be 1-" << MAX_STAY_NIGHTS << " days." << std::endl;
+            std::cout << "\n Press Enter to continue.";
+            std::cin.get();
+            return;
+        }
+        long reserved_from = reservations.next_arrival(r_no, business_date);
+        if (reserved_from >= 0 && reserved_from < business_date + new_room.days) {
+            std::cout << "\n Sorry, Room " << r_no << " is reserved from " << format_date(reserved_from) << "; it is free for "
+                      << (reserved_from - business_date) << " night(s)." << std::endl;
+            std::cout << "\n Press Enter to continue.";
+            std::cin.get();
+            return;
+        }
+
+        new_room.rtype = ROOM_TYPE_RANGES[room_type_of(new_room.room_no)].name;
+        new_room.cost = new_room.days * nightly_rate(new_room.room_no);
+        new_room.food_bill = 0; // Initialize food bill
+        new_room.arrival_date = business_date;
+        new_room.arrived = true; // Walk-in booking at the desk: guest is in house
+
+        std::cout << " Group / Company Code (leave blank if none): ";
+        std::getline(std::cin, new_room.group_code);
+        if (!new_room.group_code.empty()) {
+            GroupAccount& account = group_accounts[to_std_string(new_room.group_code)];
+            if (account.company.empty()) {
+                std::cout << " Company Name: ";
+                std::getline(std::cin, account.company);
+            }
+            int type = room_type_index(to_std_string(new_room.rtype));
+            new_room.from_allotment = allotments.draw(to_std_string(new_room.group_code), type, business_date, new_room.days);
+            if (new_room.from_allotment) {
+                std::cout << " Drawn from the " << new_room.group_code << " allotment ("
+                          << allotments.held(type, business_date) << " " << new_room.rtype << " left tonight)" << std::endl;
+            }
+            new_room.folios.push_back(Folio(account.company));
+            // Routing rules: each charge category goes to the guest (0) or company (1) folio
+            for (int c = 0; c < CHARGE_CATEGORY_COUNT; ++c) {
+                char bill_company;
+                std::cout << " Bill " << CHARGE_CATEGORY_NAMES[c] << " charges to " << account.company << " (y/n): ";
+                std::cin >> bill_company;
+                clearInputBuffer();
+                new_room.routing[c] = (bill_company == 'y' || bill_company == 'Y') ? 1 : 0;
+            }
+        }
+
+        // Rooms held for unsold allotments are kept back from other bookings, as in channel ingestion
+        if (!new_room.from_allotment &&
+            held_for_allotments(room_type_index(to_std_string(new_room.rtype)), business_date, business_date + new_room.days)) {
+            outcome = "Sorry, the free " + new_room.rtype + " rooms are held for allotments on at least" +
+                      " one night of the stay.";
+        } else if (commit_booking(new_room)) {
+            outcome = "Room " + std::to_string(new_room.room_no) + " has been booked for " + to_std_string(new_room.name) + ".";
+            succeeded = true;
+        } else {
+            if (new_room.from_allotment) {
+                allotments.restore(to_std_string(new_room.group_code), room_type_index(to_std_string(new_room.rtype)), new_room.arrival_date,
+                                   new_room.arrival_date + new_room.days);
+            }
+            outcome = "Sorry, Room " + std::to_string(r_no) + " was taken while the booking was entered.";
+        }
+    }
+    std::cout << "\n " << outcome << std::endl;
+    if (!request_key.empty() && succeeded) {
+        request_results.complete(request_key, outcome);
+    }
+    std::cout << "\n Press Enter to continue.";
+    std::cin.get();
+}
+
+// Function to tell whether a booking of the given room type that does not draw
+// on an allotment would leave fewer free rooms than the allotments still hold
+// on any of the nights [from, to). Nights past the availability window are
+// not checked; allotments are not taken that far out.
+bool HotelManager::held_for_allotments(int type, long from, long to) const {
+    int32_t free[AVAILABILITY_NIGHTS][ROOM_TYPE_COUNT];
+    int nights = static_cast<int>(std::min<long>(to - from, AVAILABILITY_NIGHTS));
+    long first = availability.copy(from, nights, free);
+    for (int i = 0; i < nights; ++i) {
+        if (free[i][type] <= allotments.held(type, first + i)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to display specific customer information
+void HotelManager::display_room() {
+    system("clear");
+    int r_no;
+    std::cout << "\n Enter Room Number to display: ";
+    std::cin >> r_no;
+    clearInputBuffer();
+
+    // Read the seqlocked hot copy: no lock, retries only if a write overlaps
+    HotRoomRecord room = HotRoomRecord();
+    if (r_no >= 1 && r_no <= HotRoomTable::MAX_ROOMS) {
+        room = hot_rooms.load(r_no);
+    }
+
+    if (room.room_no != 0) {
+        // Room found; full strings come from the epoch-protected guest copy,
+        // read in place while the epoch is pinned
+        EpochGuard guard(hot_rooms.pin());
+        const GuestStrings* guest = hot_rooms.guest(r_no);
+        system("clear");
+        std::cout << "\n Customer Details" << std::endl;
+        std::cout << "------------------" << std::endl;
+        std::cout << "\n Room Number: " << room.room_no << std::endl;
+        if (guest != nullptr) {
+            std::cout << " Name: " << guest->name << std::endl;
+            std::cout << " Address: " << guest->address << std::endl;
+            std::cout << " Phone Number: " << guest->phone << std::endl;
+        } else {
+            std::cout << " Name: " << room.name << std::endl;
+            std::cout << " Address: " << room.address << std::endl;
+            std::cout << " Phone Number: " << room.phone << std::endl;
+        }
+        std::cout << " Staying for: " << room.days << " days." << std::endl;
+        std::cout << " Room Type: " << room.rtype << std::endl;
+        std::cout << " Total Room Cost: " << room.cost << std::endl;
+        std::cout << " Total Food Bill: " << room.food_bill << std::endl;
+        std::cout << " Grand Total: " << (room.cost + room.food_bill) << std::endl;
+        std::cout << " Arrived On: " << format_date(room.arrival_date) << std::endl;
+        std::cout << " Nights Accrued: " << room.nights_posted << " (Rs. " << room.room_charges << ")" << std::endl;
+        std::cout << " Folio (Guest): Rs. " << room.folio_totals[0] << std::endl;
+        if (room.company[0] != '\0') {
+            std::cout << " Folio (" << room.company << "): Rs. " << room.folio_totals[1] << std::endl;
+        }
+        if (room.flags & 2) {
+            std::cout << " Status: DUE OUT" << std::endl;
+        } else if (room.flags & 4) {
+            std::cout << " Status: NO SHOW" << std::endl;
+        }
+    } else {
+        std::cout << "\n Room " << r_no << " is Vacant or does not exist." << std::endl;
+    }
+    std::cout << "\n Press Enter to continue.";
+    std::cin.get();
+}
+
+// Function to display all allotted rooms in a formatted table
+void HotelManager::display_all_rooms() {
+    system("clear");
+    char separator = ' ';
+    const int NoWidth = 8;
+    const int GuestWidth = 17;
+    const int AddressWidth = 16;
+    const int RoomTypeWidth = 13;
+    const int ContactNoWidth = 13;
+    const int DaysWidth = 5;
+    const int CostWidth = 10;
+
+    std::cout << "\n\t\t\t LIST OF ALLOTTED ROOMS" << std::endl;
+    std::cout << "\n\t\t\t +--------+-----------------+----------------+-------------+-------------+-----+----------+" << std::endl;
+    std::cout << "\n\t\t\t | Room No| Guest Name      | Address        | Room Type   | Contact No. |Days | Total    |" << std::endl;
+    std::cout << "\n\t\t\t +--------+-----------------+----------------+-------------+-------------+-----+----------+" << std::endl;
+
+    if (rooms_map.empty()) {
+        std::cout << "\n\t\t\t No rooms currently allotted." << std::endl;
+    } else {
+        for (const auto& pair : rooms_map) {
+            const RoomData& room = pair.second;
+            std::cout << "\n\t\t\t |" << std::setw(NoWidth) << std::setfill(separator) << room.room_no << "|"
+                      << std::setw(GuestWidth) << std::setfill(separator) << room.name << "|"
+                      << std::setw(AddressWidth) << std::setfill(separator) << room.address << "|"
+                      << std::setw(RoomTypeWidth) << std::setfill(separator) << room.rtype << "|"
+                      << std::setw(ContactNoWidth) << std::setfill(separator) << room.phone << "|"
+                      << std::setw(DaysWidth) << std::setfill(separator) << room.days << "|"
+                      << std::setw(CostWidth) << std::setfill(separator) << (room.cost + room.food_bill) << "|" << std::endl;
+        }
+    }
+    std::cout << "\n\t\t\t +--------+-----------------+----------------+-------------+-------------+-----+----------+" << std::endl;
+    std::cout << "\n\n\n\t\t\t Press Enter to continue.";
+    std::cin.get();
+}
+
+// Function to edit customer details (modify or delete)
+void HotelManager::edit_customer_details() {
+    system("clear");
+    int choice;
+    std::cout << "\n EDIT MENU:" << std::endl;
+    std::cout << "------------" << std::endl;
+    std::cout << "\n 1. Modify Customer Information." << std::endl;
+    std::cout << "\n 2. Customer Check Out." << std::endl;
+    std::cout << "\n Enter your choice: ";
+    std::cin >> choice;
+    clearInputBuffer();
+
+    system("clear");
+
+    switch(choice) {
+        case 1:
+            modify_customer_info();
+            break;
+        case 2:
+            delete_customer_record();
+            break;
+        default:
+            std::cout << "\n Wrong Choice. Please try again." << std::endl;
+            break;
+    }
+    std::cout << "\n Press Enter to continue.";
+    std::cin.get();
+}
+
+// Function to check room status (booked, vacant, or invalid)
+// Returns 0 if vacant, 1 if booked, 2 if invalid room number
+int HotelManager::check_room_status(int r_no) {
+    if (room_type_of(r_no) < 0) {
+        return 2; // Invalid room number
+    }
+    if (hot_rooms.load(r_no).room_no != 0) {
+        return 1; // Room is booked
+    }
+    return 0; // Room is vacant
+}
+
+// Function to display the back office menu for end-of-day batch jobs
+void HotelManager::back_office_menu() {
+    system("clear");
+    int choice;
+    std::cout << "\n BACK OFFICE:" << std::endl;
+    std::cout << "-------------" << std::endl;
+    std::cout << "\n 1. Night Audit (Close Business Day " << format_date(business_date) << ")" << std::endl;
+    std::cout << "\n 2. Group Invoice" << std::endl;
+    std::cout << "\n 3. Render Invoices for All Rooms" << std::endl;
+    std::cout << "\n 4. Loyalty Statement" << std::endl;
+    std::cout << "\n 5. Audit Trail for a Room" << std::endl;
+    std::cout << "\n 6. Memory Reclamation Stats" << std::endl;
+    std::cout << "\n 7. Memory Usage" << std::endl;
+    std::cout << "\n 8. Guest History" << std::endl;
+    std::cout << "\n 9. Archive Retention" << std::endl;
+    std::cout << "\n 10. Background Snapshot (BGSAVE)" << std::endl;
+    std::cout << "\n 11. Channel Manager Ingestion" << std::endl;
+    std::cout << "\n 12. Allotment Blocks" << std::endl;
+    std::cout << "\n 13. Availability (Next " << AVAILABILITY_NIGHTS << " Nights)" << std::endl;
+    std::cout << "\n 14. Revenue Between Dates" << std::endl;
+    std::cout << "\n 15. Occupancy & Revenue Cube" << std::endl;
+    std::cout << "\n 16. Arrivals & Departures" << std::endl;
+    std::cout << "\n Enter your choice: ";
+    std::cin >> choice;
+    clearInputBuffer();
+
+    switch(choice) {
+        case 1:
+            night_audit();
+            break;
+        case 2:
+            group_invoice();
+            break;
+        case 3:
+            batch_invoices();
+            break;
+        case 4:
+            loyalty_statement();
+            break;
+        case 5:
+            audit_report();
+            break;
+        case 6:
+            reclamation_stats();
+            break;
+        case 7:
+            memory_usage();
+            break;
+        case 8:
+            guest_history();
+            break;
+        case 9:
+            archive_retention();
+            break;
+        case 10:
+            background_snapshot();
+            break;
+        case 11:
+            channel_ingestion();
+            break;
+        case 12:
+            allotment_blocks();
+            break;
+        case 13:
+            availability_report();
+            break;
+        case 14:
+            revenue_report();
+            break;
+        case 15:
+            cube_report();
+            break;
+        case 16:
+            movements_report();
+            break;
+        default:
+            std::cout << "\n Wrong Choice. Please try again." << std::endl;
+            break;
+    }
+    std::cout << "\n Press Enter to continue.";
+    std::cin.get();
+}
+
+// Function to append one line to the journal file
+void HotelManager::append_journal(const std::string& entry) {
+    std::ofstream jout(JOURNAL_FILE, std::ios::out | std::ios::app);
+    if (!jout.is_open()) {
+        std::cerr << "\n Error: Could not open " << JOURNAL_FILE << " for writing." << std::endl;
+        return;
+    }
+    jout << entry << '\n';
+}
+
+// Function to post a charge to a room and, for company folios, to its group account
+void HotelManager::post_charge(RoomData& room, int category, long amount, const std::string& description) {
+    int idx = post_to_folio(room, category, amount, business_date, description);
+    revenue.post(room_type_of(room.room_no), category, business_date, amount);
+    cube.add_charge(room, category, business_date, amount);
+    if (idx > 0 && !room.group_code.empty()) {
+        apply_group_posting({to_std_string(room.group_code), room.room_no, category, amount});
+    }
+    refresh_hot_room(room);
+}
+
+// Function to copy the point-read fields of a room into its seqlocked slot
+void HotelManager::refresh_hot_room(const RoomData& room) {
+    if (room.room_no < 1 || room.room_no > HotRoomTable::MAX_ROOMS) {
+        return;
+    }
+    HotRoomRecord rec = HotRoomRecord();
+    rec.room_no = room.room_no;
+    rec.flags = (room.arrived ? 1 : 0) | (room.due_out ? 2 : 0) | (room.no_show ? 4 : 0);
+    rec.days = room.days;
+    rec.cost = room.cost;
+    rec.food_bill = room.food_bill;
+    rec.arrival_date = room.arrival_date;
+    rec.nights_posted = room.nights_posted;
+    rec.room_charges = room.room_charges;
+    for (size_t f = 0; f < room.folios.size() && f < 2; ++f) {
+        rec.folio_totals[f] = room.folios[f].total;
+    }
+    std::strncpy(rec.rtype, room.rtype.c_str(), sizeof(rec.rtype) - 1);
+    std::strncpy(rec.name, room.name.c_str(), sizeof(rec.name) - 1);
+    std::strncpy(rec.address, room.address.c_str(), sizeof(rec.address) - 1);
+    std::strncpy(rec.phone, room.phone.c_str(), sizeof(rec.phone) - 1);
+    if (room.folios.size() > 1) {
+        std::strncpy(rec.company, room.folios[1].payer.c_str(), sizeof(rec.company) - 1);
+    }
+    hot_rooms.store(room.room_no, rec);
+
+    // Republish the full strings only when one of them changed, comparing in
+    // place against the published copy
+    const GuestStrings* current = hot_rooms.guest(room.room_no);
+    if (current == nullptr || current->name != room.name || current->address != room.address ||
+        current->phone != room.phone) {
+        hot_rooms.store_guest(room.room_no, new GuestStrings{room.name, room.address, room.phone});
+    }
+}
+
+// Function to add a company-billed charge to the running totals of its group account
+void HotelManager::apply_group_posting(const GroupPosting& posting) {
+    GroupAccount& account = group_accounts[posting.group_code];
+    account.total += posting.amount;
+    account.category_totals[posting.category] += posting.amount;
+    account.room_totals[posting.room_no] += posting.amount;
+}
+
+// Function to run the night audit: accrue one night to every in-house room,
+// flag due-outs and no-shows, then advance and close the business date.
+// Rooms are split into contiguous slices processed by worker threads; each worker
+// only touches its own rooms and keeps local totals, so no locking is needed.
+NightAuditResult HotelManager::run_night_rollover() {
+    std::vector<RoomData*> rooms;
+    rooms.reserve(rooms_map.size());
+    for (auto& pair : rooms_map) {
+        rooms.push_back(&pair.second);
+    }
+
+    const size_t MIN_ROOMS_PER_WORKER = 64; // Below this a thread costs more than it saves
+    size_t workers = std::max<size_t>(1, std::thread::hardware_concurrency());
+    workers = std::min(workers, rooms.size() / MIN_ROOMS_PER_WORKER + 1);
+
+    std::vector<NightAuditResult> partial(workers);
+    const long audit_date = business_date;
+    auto process_slice = [&rooms, &partial, workers, audit_date](size_t w) {
+        NightAuditResult& local = partial[w];
+        size_t begin = rooms.size() * w / workers;
+        size_t end = rooms.size() * (w + 1) / workers;
+        for (size_t i = begin; i < end; ++i) {
+            RoomData& room = *rooms[i];
+            local.rooms_processed++;
+            if (!room.arrived) {
+                if (room.arrival_date <= audit_date && !room.no_show) {
+                    room.no_show = true;
+                    local.no_shows.push_back(room.room_no);
+                } else if (room.no_show && audit_date < room.arrival_date + room.days) {
+                    local.still_absent.push_back(room.room_no);
+                }
+                continue;
+            }
+            if (room.nights_posted < room.days) {
+                long rate = nightly_rate(room.room_no);
+                room.nights_posted++;
+                int idx = post_to_folio(room, CHARGE_ROOM, rate, audit_date, to_std_string(room.rtype) + " room night");
+                if (idx > 0 && !room.group_code.empty()) {
+                    // Group accounts are shared, so they are updated after the pass
+                    local.group_postings.push_back({to_std_string(room.group_code), room.room_no, CHARGE_ROOM, rate});
+                }
+                local.accrued_rooms.push_back(room.room_no);
+                local.nights_accrued++;
+                local.amount_accrued += rate;
+                local.accrued_by_type[room_type_of(room.room_no)] += rate;
+            }
+            if (room.nights_posted >= room.days) {
+                room.due_out = true;
+                local.due_outs.push_back(room.room_no);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t w = 1; w < workers; ++w) {
+        threads.emplace_back(process_slice, w);
+    }
+    process_slice(0); // The calling thread takes the first slice
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    NightAuditResult result;
+    result.closed_date = audit_date;
+    for (const auto& local : partial) {
+        result.rooms_processed += local.rooms_processed;
+        result.nights_accrued += local.nights_accrued;
+        result.amount_accrued += local.amount_accrued;
+        for (int t = 0; t < ROOM_TYPE_COUNT; ++t) {
+            result.accrued_by_type[t] += local.accrued_by_type[t];
+        }
+        result.due_outs.insert(result.due_outs.end(), local.due_outs.begin(), local.due_outs.end());
+        result.no_shows.insert(result.no_shows.end(), local.no_shows.begin(), local.no_shows.end());
+        for (const auto& posting : local.group_postings) {
+            apply_group_posting(posting);
+        }
+        for (int r_no : local.accrued_rooms) {
+            cube.add_charge(*room_directory[r_no], CHARGE_ROOM, audit_date, nightly_rate(r_no));
+        }
+        // Nights a no-show did not stay are no longer occupied room-nights
+        for (int r_no : local.no_shows) {
+            const RoomData& room = *room_directory[r_no];
+            cube.add_nights(room, room.arrival_date, std::min(audit_date + 1, room.arrival_date + room.days), -1);
+        }
+        for (int r_no : local.still_absent) {
+            cube.add_nights(*room_directory[r_no], audit_date, audit_date + 1, -1);
+        }
+    }
+    for (const RoomData* room : rooms) {
+        refresh_hot_room(*room);
+    }
+    std::sort(result.due_outs.begin(), result.due_outs.end());
+    std::sort(result.no_shows.begin(), result.no_shows.end());
+
+    for (int t = 0; t < ROOM_TYPE_COUNT; ++t) {
+        revenue.post(t, CHARGE_ROOM, audit_date, result.accrued_by_type[t]);
+    }
+
+    business_date = audit_date + 1;
+    channel_ingest.set_business_date(business_date);
+    admit_due_reservations();
+    availability.advance(business_date, rooms_map, reservations);
+    todays_movements(); // Ready for the morning
+
+    // Release-back job: unsold allotment rooms inside their release window
+    std::string releases;
+    result.allotment_released = allotments.release_due(business_date, releases);
+
+    // One journal entry for the whole batch, release-back job included
+    append_journal("ROLLOVER " + format_date(audit_date) + " -> " + format_date(business_date) +
+                   " rooms=" + std::to_string(result.rooms_processed) +
+                   " nights=" + std::to_string(result.nights_accrued) +
+                   " accrued=" + std::to_string(result.amount_accrued) +
+                   " due_out=" + std::to_string(result.due_outs.size()) +
+                   " no_show=" + std::to_string(result.no_shows.size()) +
+                   " released=" + std::to_string(result.allotment_released) +
+                   (releases.empty() ? "" : " (" + releases + ")"));
+    save_data(); // Close the day
+    return result;
+}
+
+// Function to run the night audit and print its report
+void HotelManager::night_audit() {
+    char confirm_char;
+    std::cout << "\n Close business day " << format_date(business_date) << " (y/n): ";
+    std::cin >> confirm_char;
+    clearInputBuffer();
+    if (confirm_char != 'y' && confirm_char != 'Y') {
+        std::cout << "\n Night audit cancelled." << std::endl;
+        return;
+    }
+
+    NightAuditResult result = run_night_rollover();
+    std::cout << "\n NIGHT AUDIT REPORT" << std::endl;
+    std::cout << "--------------------" << std::endl;
+    std::cout << "\n Closed Date: " << format_date(result.closed_date) << std::endl;
+    std::cout << " New Business Date: " << format_date(business_date) << std::endl;
+    std::cout << " Rooms Processed: " << result.rooms_processed << std::endl;
+    std::cout << " Nights Accrued: " << result.nights_accrued << std::endl;
+    std::cout << " Room Charges Accrued: Rs. " << result.amount_accrued << std::endl;
+    std::cout << " Allotment Room-Nights Released: " << result.allotment_released << std::endl;
+    const TrackedVector<int, MEM_INDEXES>* arriving = movements.arriving(business_date);
+    const TrackedVector<int, MEM_INDEXES>* departing = movements.departing(business_date);
+    std::cout << " Expected Today: " << (arriving ? arriving->size() : 0) << " arrivals, "
+              << (departing ? departing->size() : 0) << " departures (Back Office 16)" << std::endl;
+    std::cout << " Due Outs:";
+    for (int r_no : result.due_outs) {
+        std::cout << " " << r_no;
+    }
+    std::cout << "\n No Shows:";
+    for (int r_no : result.no_shows) {
+        std::cout << " " << r_no;
+    }
+    std::cout << std::endl;
+    if (stay_archive.start_compaction(business_date)) {
+        std::cout << " Stay archive compaction started in the background." << std::endl;
+    }
+}
+
+// Function to print a consolidated invoice for a group from its running totals
+void HotelManager::group_invoice() {
+    std::string code;
+    std::cout << "\n Enter Group / Company Code: ";
+    std::getline(std::cin, code);
+
+    auto it = group_accounts.find(code);
+    if (it == group_accounts.end()) {
+        std::cout << "\n No group account found for code " << code << "." << std::endl;
+        return;
+    }
+    const GroupAccount& account = it->second;
+    std::cout << "\n CONSOLIDATED INVOICE - " << account.company << " (" << code << ")" << std::endl;
+    std::cout << "----------------------------------------" << std::endl;
+
+    std::vector<std::pair<int, long>> rooms(account.room_totals.begin(), account.room_totals.end());
+    std::sort(rooms.begin(), rooms.end());
+    std::vector<int> room_numbers;
+    for (const auto& rt : rooms) {
+        room_numbers.push_back(rt.first);
+    }
+    batch_lookup(room_directory.data(), room_directory.size(), room_numbers.data(), room_numbers.size(),
+                 [&rooms, &code](size_t i, const RoomData* room) {
+                     std::cout << " Room " << std::setw(4) << rooms[i].first << ": Rs. " << rooms[i].second
+                               << (room != nullptr && room->group_code == code.c_str() ? "" : " (checked out)") << std::endl;
+                 });
+    for (int c = 0; c < CHARGE_CATEGORY_COUNT; ++c) {
+        std::cout << " " << CHARGE_CATEGORY_NAMES[c] << " Charges: Rs. " << account.category_totals[c] << std::endl;
+    }
+    std::cout << " Total Due: Rs. " << account.total << std::endl;
+
+    char settle_char;
+    std::cout << "\n Settle this account (y/n): ";
+    std::cin >> settle_char;
+    clearInputBuffer();
+    if (settle_char == 'y' || settle_char == 'Y') {
+        append_journal("GROUP_SETTLED " + code + " date=" + format_date(business_date) +
+                       " amount=" + std::to_string(account.total));
+        group_accounts.erase(it);
+        std::cout << "\n Group account " << code << " settled." << std::endl;
+    }
+}
+
+// Function to render invoices for a set of rooms, one file per room and format,
+// into INVOICE_DIR. Each worker renders its slice with its own reusable buffer
+// into a staging directory; files are only moved into INVOICE_DIR once every
+// render succeeded, so the printer/email spooler never sees a partial batch.
+size_t HotelManager::render_invoice_batch(const std::vector<const RoomData*>& rooms,
+                                          const std::vector<InvoiceFormat>& formats) {
+    namespace fs = std::filesystem;
+    const fs::path out_dir(INVOICE_DIR);
+    const fs::path staging_dir = out_dir / ".staging";
+    std::error_code ec;
+    fs::create_directories(staging_dir, ec);
+    if (ec) {
+        std::cerr << "\n Error: Could not create " << staging_dir << ": " << ec.message() << std::endl;
+        return 0;
+    }
+
+    // invoice-<date>-room<N>, then -2, -3, ... for later invoices of the room on
+    // the same day (a second stay, or a batch run before the checkout), so a
+    // published invoice is never overwritten
+    const size_t jobs = rooms.size() * formats.size(); // Job i: room i / formats, format i % formats
+    std::vector<std::string> names(jobs);
+    for (size_t i = 0; i < jobs; ++i) {
+        const std::string extension = (formats[i % formats.size()] == INVOICE_HTML) ? ".html" : ".txt";
+        std::string stem =
+            "invoice-" + format_date(business_date) + "-room" + std::to_string(rooms[i / formats.size()]->room_no);
+        names[i] = stem + extension;
+        for (int sequence = 2; fs::exists(out_dir / names[i], ec); ++sequence) {
+            names[i] = stem + "-" + std::to_string(sequence) + extension;
+        }
+    }
+
+    const size_t MIN_INVOICES_PER_WORKER = 8;
+    size_t workers = std::max<size_t>(1, std::thread::hardware_concurrency());
+    workers = std::min(workers, jobs / MIN_INVOICES_PER_WORKER + 1);
+    std::vector<size_t> failures(workers, 0);
+    const long date = business_date;
+
+    auto render_slice = [&, date](size_t w) {
+        std::string buf;
+        buf.reserve(4096);
+        size_t begin = jobs * w / workers;
+        size_t end = jobs * (w + 1) / workers;
+        for (size_t i = begin; i < end; ++i) {
+            render_invoice(*rooms[i / formats.size()], date, formats[i % formats.size()], buf);
+            std::ofstream out(staging_dir / names[i], std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!out.write(buf.data(), buf.size())) {
+                failures[w]++;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t w = 1; w < workers; ++w) {
+        threads.emplace_back(render_slice, w);
+    }
+    render_slice(0);
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    size_t failed = 0;
+    for (size_t f : failures) {
+        failed += f;
+    }
+    if (failed > 0) {
+        std::cerr << "\n Error: " << failed << " invoice(s) could not be written. Batch discarded." << std::endl;
+        for (const auto& name : names) {
+            fs::remove(staging_dir / name, ec);
+        }
+        return 0;
+    }
+
+    size_t published = 0;
+    for (const auto& name : names) {
+        fs::rename(staging_dir / name, out_dir / name, ec);
+        if (ec) {
+            std::cerr << "\n Error: Could not publish " << name << ": " << ec.message() << std::endl;
+        } else {
+            published++;
+        }
+    }
+    return published;
+}
+
+// Function to render invoices for every in-house room
+void HotelManager::batch_invoices() {
+    int format_choice;
+    std::cout << "\n 1. Text\n 2. HTML\n Enter format: ";
+    std::cin >> format_choice;
+    clearInputBuffer();
+
+    std::vector<const RoomData*> rooms;
+    rooms.reserve(rooms_map.size());
+    for (const auto& pair : rooms_map) {
+        rooms.push_back(&pair.second);
+    }
+    size_t published = render_invoice_batch(rooms, {format_choice == 2 ? INVOICE_HTML : INVOICE_TEXT});
+    std::cout << "\n " << published << " invoice(s) written to " << INVOICE_DIR << "/" << std::endl;
+}
+
+// Function to show a guest's loyalty tier, points and rolling 12-month earnings
+void HotelManager::loyalty_statement() {
+    std::string phone;
+    std::cout << "\n Enter Guest Phone Number: ";
+    std::getline(std::cin, phone);
+
+    const LoyaltyAccount* account = loyalty_lookup(phone);
+    if (account == nullptr) {
+        std::cout << "\n No loyalty account found for " << phone << "." << std::endl;
+        return;
+    }
+    std::cout << "\n Tier: " << LOYALTY_TIER_NAMES[account->tier] << std::endl;
+    std::cout << " Points Balance: " << account->points_balance << std::endl;
+    std::cout << " Points (last 12 months): " << account->rolling_points << std::endl;
+    std::cout << " Stays: " << account->stays << std::endl;
+    if (account->tier < TIER_PLATINUM) {
+        std::cout << " Points to " << LOYALTY_TIER_NAMES[account->tier + 1] << ": "
+                  << (LOYALTY_TIER_THRESHOLDS[account->tier] - account->rolling_points) << std::endl;
+    }
+}
+
+// Function to show the audit trail of a room
+void HotelManager::audit_report() {
+    int r_no;
+    std::cout << "\n Enter Room Number: ";
+    std::cin >> r_no;
+    clearInputBuffer();
+
+    std::vector<AuditEntry> entries = audit_trail.query(r_no);
+    if (entries.empty()) {
+        std::cout << "\n No changes recorded for Room " << r_no << "." << std::endl;
+        return;
+    }
+    std::cout << "\n AUDIT TRAIL - Room " << r_no << std::endl;
+    std::cout << "------------------------" << std::endl;
+    for (const auto& entry : entries) {
+        std::time_t t = static_cast<std::time_t>(entry.timestamp);
+        char when[32];
+        std::strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", std::localtime(&t));
+        const char* field = (entry.field >= AUDIT_NAME && entry.field <= AUDIT_DAYS) ? AUDIT_FIELD_NAMES[entry.field] : "?";
+        std::cout << " " << when << " [" << entry.terminal << "] " << field << ": \""
+                  << entry.old_value << "\" -> \"" << entry.new_value << "\"" << std::endl;
+    }
+}
+
+// Function to show the epoch manager's deferred-free backlog
+void HotelManager::reclamation_stats() {
+    epochs.collect();
+    EpochManager::Stats st = epochs.get_stats();
+    std::cout << "\n MEMORY RECLAMATION" << std::endl;
+    std::cout << "--------------------" << std::endl;
+    std::cout << "\n Global Epoch: " << st.global_epoch << std::endl;
+    std::cout << " Objects Retired: " << st.retired << std::endl;
+    std::cout << " Objects Freed: " << st.freed << std::endl;
+    std::cout << " Backlog: " << st.backlog_objects << " object(s), " << st.backlog_bytes << " bytes" << std::endl;
+    std::cout << " Peak Backlog: " << st.peak_backlog_bytes << " bytes (limit "
+              << EpochManager::MAX_BACKLOG_BYTES << ")" << std::endl;
+    std::cout << " Epoch Advances: " << st.advances << " (" << st.stalled << " stalled by readers)" << std::endl;
+}
+
+// Function to show memory usage per subsystem and project it to a target room count
+void HotelManager::memory_usage() {
+    long target_rooms;
+    std::cout << "\n Project footprint for how many rooms (0 to skip): ";
+    std::cin >> target_rooms;
+    clearInputBuffer();
+
+    std::cout << "\n MEMORY USAGE (bytes)" << std::endl;
+    std::cout << "----------------------" << std::endl;
+    print_memory_report(std::cout, rooms_map.size(), target_rooms);
+}
+
+// Function to show every archived stay of a guest
+void HotelManager::guest_history() {
+    std::string phone;
+    std::cout << "\n Enter Guest Phone Number: ";
+    std::getline(std::cin, phone);
+
+    std::vector<ArchivedStay> stays;
+    if (!stay_archive.lookup(phone, &stays)) {
+        std::cout << "\n " << phone << " has never stayed with us." << std::endl;
+    } else {
+        std::cout << "\n STAY HISTORY - " << phone << std::endl;
+        std::cout << "----------------------------" << std::endl;
+        for (const auto& stay : stays) {
+            std::cout << " " << format_date(stay.arrival_date) << " to " << format_date(stay.checkout_date)
+                      << "  Room " << std::setw(3) << stay.room_no << "  " << stay.name
+                      << "  Rs. " << stay.total << std::endl;
+        }
+    }
+    std::cout << std::endl;
+    stay_archive.print_stats(std::cout);
+}
+
+// Function to show the stay archive tiers and optionally start a compaction
+void HotelManager::archive_retention() {
+    std::cout << "\n STAY ARCHIVE RETENTION" << std::endl;
+    std::cout << "------------------------" << std::endl;
+    stay_archive.print_retention(std::cout);
+    if (stay_archive.compaction_running()) {
+        return;
+    }
+    char confirm_char;
+    std::cout << "\n Compact the archive now (y/n): ";
+    std::cin >> confirm_char;
+    clearInputBuffer();
+    if ((confirm_char == 'y' || confirm_char == 'Y') && stay_archive.start_compaction(business_date)) {
+        std::cout << "\n Compaction started in the background." << std::endl;
+    }
+}
+
+// Function to start a background snapshot, or report on the running/last one
+void HotelManager::background_snapshot() {
+    reap_bgsave(false);
+    std::cout << "\n BACKGROUND SNAPSHOT" << std::endl;
+    std::cout << "---------------------" << std::endl;
+    if (bgsave_pid != 0) {
+        std::cout << "\n Snapshot child " << bgsave_pid << " still running (forked in "
+                  << last_bgsave.fork_ms << " ms)." << std::endl;
+        return;
+    }
+    if (last_bgsave.fork_ms > 0) {
+        std::cout << "\n Last snapshot: " << (last_bgsave.ok ? "ok" : "FAILED") << ", " << last_bgsave.rooms
+                  << " room(s), " << last_bgsave.bytes << " bytes" << std::endl;
+        std::cout << " Fork Latency: " << last_bgsave.fork_ms << " ms" << std::endl;
+        std::cout << " Serialization: " << last_bgsave.save_ms << " ms (" << last_bgsave.total_ms
+                  << " ms fork to reap)" << std::endl;
+        std::cout << " Copy-on-Write: " << last_bgsave.cow_kb << " kB (" << last_bgsave.cow_kb * 1024 / getpagesize()
+                  << " page(s)) duplicated while the child ran" << std::endl;
+    }
+    char confirm_char;
+    std::cout << "\n Write a snapshot of " << rooms_map.size() << " room(s) to " << DATA_FILE << " now (y/n): ";
+    std::cin >> confirm_char;
+    clearInputBuffer();
+    if ((confirm_char == 'y' || confirm_char == 'Y') && start_bgsave()) {
+        std::cout << "\n Snapshot child " << bgsave_pid << " forked in " << last_bgsave.fork_ms
+                  << " ms; the desk stays open while it writes." << std::endl;
+    }
+}
+
+// Returns the agent a room's allotment draw was made for: its group code, or
+// the channel of a channel booking
+static std::string allotment_agent(const RoomData& room) {
+    if (!room.group_code.empty()) {
+        return to_std_string(room.group_code);
+    }
+    return to_std_string(room.channel_ref.substr(0, room.channel_ref.find(':')));
+}
+
+// Function to list the allotment blocks, add one, or run the release-back job
+void HotelManager::allotment_blocks() {
+    std::cout << "\n ALLOTMENT BLOCKS" << std::endl;
+    std::cout << "------------------" << std::endl;
+    allotments.print(std::cout, business_date);
+    int choice;
+    std::cout << "\n 1. Add Block" << std::endl;
+    std::cout << " 2. Run Release-Back Job" << std::endl;
+    std::cout << " 3. Back" << std::endl;
+    std::cout << "\n Enter your choice: ";
+    std::cin >> choice;
+    clearInputBuffer();
+    if (choice == 1) {
+        std::string agent, rtype, first, last, error;
+        long first_night = 0, last_night = 0, count, release_days;
+        std::cout << " Agent (channel name or group code): ";
+        std::getline(std::cin, agent);
+        std::cout << " Room Type (Deluxe/Executive/Presidential): ";
+        std::getline(std::cin, rtype);
+        std::cout << " First Night (YYYY-MM-DD): ";
+        std::getline(std::cin, first);
+        std::cout << " Last Night (YYYY-MM-DD): ";
+        std::getline(std::cin, last);
+        std::cout << " Rooms per Night: ";
+        std::cin >> count;
+        clearInputBuffer();
+        std::cout << " Release Unsold Rooms How Many Days Ahead: ";
+        std::cin >> release_days;
+        clearInputBuffer();
+        if (!parse_date(first, first_night) || !parse_date(last, last_night)) {
+            std::cout << "\n Invalid date." << std::endl;
+        } else if (!allotments.add(agent, room_type_index(rtype), first_night, last_night, count, release_days, error)) {
+            std::cout << "\n Block not added: " << error << "." << std::endl;
+        } else {
+            allotments.save(ALLOTMENT_FILE);
+            append_journal("ALLOTMENT_ADD " + agent + " " + rtype + " " + first + ".." + last +
+                           " rooms=" + std::to_string(count) + " release=" + std::to_string(release_days));
+            std::cout << "\n Block added for " << agent << "." << std::endl;
+        }
+    } else if (choice == 2) {
+        std::string releases;
+        long released = allotments.release_due(business_date, releases);
+        if (!releases.empty()) {
+            append_journal("ALLOTMENT_RELEASE " + releases);
+            allotments.save(ALLOTMENT_FILE);
+        }
+        std::cout << "\n " << released << " unsold room-night(s) released to general sale." << std::endl;
+    }
+}
+
+// Function to print revenue by room type and category between two dates
+void HotelManager::revenue_report() {
+    std::string from_text, to_text;
+    long from, to;
+    std::cout << "\n From Date (YYYY-MM-DD): ";
+    std::getline(std::cin, from_text);
+    std::cout << " To Date (YYYY-MM-DD, inclusive): ";
+    std::getline(std::cin, to_text);
+    if (!parse_date(from_text, from) || !parse_date(to_text, to)) {
+        std::cout << "\n Invalid date." << std::endl;
+        return;
+    }
+    std::cout << "\n REVENUE " << format_date(from) << " TO " << format_date(to) << std::endl;
+    std::cout << "----------------------------------" << std::endl;
+    std::cout << "\n " << std::left << std::setw(14) << "Room Type" << std::right;
+    for (int c = 0; c < CHARGE_CATEGORY_COUNT; ++c) {
+        std::cout << std::setw(14) << CHARGE_CATEGORY_NAMES[c];
+    }
+    std::cout << std::setw(14) << "Total" << std::endl;
+    for (int t = 0; t <= ROOM_TYPE_COUNT; ++t) {
+        int type = t < ROOM_TYPE_COUNT ? t : -1; // All types last
+        long total = 0;
+        std::cout << " " << std::left << std::setw(14) << (type < 0 ? "All" : ROOM_TYPE_RANGES[type].name) << std::right;
+        for (int c = 0; c < CHARGE_CATEGORY_COUNT; ++c) {
+            long amount = revenue.range(type, c, from, to);
+            total += amount;
+            std::cout << std::setw(14) << amount;
+        }
+        std::cout << std::setw(14) << total << std::endl;
+    }
+    if (revenue.first_date() > from) {
+        std::cout << "\n Revenue is tracked from " << format_date(revenue.first_date()) << "." << std::endl;
+    }
+}
+
+// Function to slice the occupancy cube: each dimension is fixed or left blank for all
+void HotelManager::cube_report() {
+    std::string text;
+    int type = OccupancyCube::ALL, floor = OccupancyCube::ALL, wing = OccupancyCube::ALL, channel = OccupancyCube::ALL;
+    long from = OccupancyCube::ALL, to = OccupancyCube::ALL;
+    const int floors = room_floor(ROOM_TYPE_RANGES[ROOM_TYPE_COUNT - 1].last);
+
+    std::cout << "\n Leave a field blank to include all values." << std::endl;
+    std::cout << "\n Room Type (Deluxe/Executive/Presidential): ";
+    std::getline(std::cin, text);
+    if (!text.empty() && (type = room_type_index(text)) < 0) {
+        std::cout << "\n Invalid room type." << std::endl;
+        return;
+    }
+    std::cout << " Floor (1-" << floors << "): ";
+    std::getline(std::cin, text);
+    if (!text.empty() && ((floor = std::atoi(text.c_str())) < 1 || floor > floors)) {
+        std::cout << "\n Invalid floor." << std::endl;
+        return;
+    }
+    std::cout << " Wing (" << WING_NAMES[0] << "/" << WING_NAMES[1] << "): ";
+    std::getline(std::cin, text);
+    if (!text.empty()) {
+        wing = text == WING_NAMES[0] ? 0 : text == WING_NAMES[1] ? 1 : -2;
+        if (wing < 0) {
+            std::cout << "\n Invalid wing." << std::endl;
+            return;
+        }
+    }
+    std::cout << " Channel (";
+    for (size_t i = 0; i < cube.channel_names().size(); ++i) {
+        std::cout << (i > 0 ? "/" : "") << cube.channel_names()[i];
+    }
+    std::cout << "): ";
+    std::getline(std::cin, text);
+    if (!text.empty() && (channel = cube.find_channel(text)) < 0) {
+        std::cout << "\n Unknown channel." << std::endl;
+        return;
+    }
+    std::cout << " From Date (YYYY-MM-DD): ";
+    std::getline(std::cin, text);
+    if (!text.empty()) {
+        if (!parse_date(text, from)) {
+            std::cout << "\n Invalid date." << std::endl;
+            return;
+        }
+        std::cout << " To Date (YYYY-MM-DD, inclusive; blank for the same day): ";
+        std::getline(std::cin, text);
+        to = from;
+        if (!text.empty() && !parse_date(text, to)) {
+            std::cout << "\n Invalid date." << std::endl;
+            return;
+        }
+    }
+
+    std::cout << "\n OCCUPANCY & REVENUE ";
+    if (from < 0) {
+        std::cout << "(ALL DATES)" << std::endl;
+    } else {
+        std::cout << format_date(from) << " TO " << format_date(to) << std::endl;
+    }
+    std::cout << "----------------------------------" << std::endl;
+    std::cout << "\n " << std::left << std::setw(14) << "Room Type" << std::right << std::setw(14) << "Room-Nights"
+              << std::setw(14) << "Revenue" << std::setw(14) << "Food" << std::endl;
+    auto started = std::chrono::steady_clock::now();
+    for (int t = 0; t <= ROOM_TYPE_COUNT; ++t) {
+        int row = t < ROOM_TYPE_COUNT ? t : OccupancyCube::ALL; // All types last
+        if (type != OccupancyCube::ALL && row != type) {
+            continue;
+        }
+        CubeMeasures m = cube.slice(row, floor, wing, channel, from, to);
+        std::cout << " " << std::left << std::setw(14) << (row < 0 ? "All" : ROOM_TYPE_RANGES[row].name) << std::right
+                  << std::setw(14) << m.room_nights << std::setw(14) << m.revenue << std::setw(14) << m.food_revenue
+                  << std::endl;
+    }
+    double elapsed_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started).count();
+    std::cout << "\n " << cube.cell_count() << " cells, sliced in " << std::fixed << std::setprecision(1) << elapsed_us
+              << " us" << std::defaultfloat << std::endl;
+}
+
+// Function to render the expected arrivals and departures of a business date
+// from the movement index, touching only the rooms listed
+void HotelManager::render_movements(long date, std::string& buf) {
+    buf.clear();
+    char line[160];
+    buf += " ARRIVALS & DEPARTURES " + format_date(date) + "\n";
+    buf += " ----------------------------------\n";
+    for (int pass = 0; pass < 2; ++pass) {
+        const TrackedVector<int, MEM_INDEXES>* list = pass == 0 ? movements.arriving(date) : movements.departing(date);
+        size_t count = list ? list->size() : 0;
+        buf += pass == 0 ? "\n Arrivals (" : "\n Departures (";
+        buf += std::to_string(count) + ")\n";
+        for (size_t i = 0; i < count; ++i) {
+            int r_no = (*list)[i];
+            const RoomData* room = room_directory[r_no];
+            if (room == nullptr || (pass == 0 ? room->arrival_date : room->arrival_date + room->days) != date) {
+                room = pass == 0 ? reservations.arriving(r_no, date) : reservations.departing(r_no, date);
+            }
+            if (room == nullptr) {
+                continue;
+            }
+            std::string source = !room->channel_ref.empty() ? to_std_string(room->channel_ref)
+                                 : !room->group_code.empty() ? "Group " + to_std_string(room->group_code)
+                                                             : "Desk";
+            if (pass == 0) {
+                std::snprintf(line, sizeof(line), " Room %3d  %-24.24s %-13s %3ld nights  %s\n", room->room_no,
+                              to_std_string(room->name).c_str(), room->rtype.c_str(), room->days, source.c_str());
+            } else {
+                std::snprintf(line, sizeof(line), " Room %3d  %-24.24s %-13s since %s  %s\n", room->room_no,
+                              to_std_string(room->name).c_str(), room->rtype.c_str(),
+                              format_date(room->arrival_date).c_str(), source.c_str());
+            }
+            buf += line;
+        }
+    }
+}
+
+// Function to return today's movement sheet. It is rendered by the night audit
+// and again only after a booking, extension or checkout changed the index.
+const std::string& HotelManager::todays_movements() {
+    if (movement_sheet_date != business_date || movement_sheet_version != movements.version()) {
+        render_movements(business_date, movement_sheet);
+        movement_sheet_date = business_date;
+        movement_sheet_version = movements.version();
+    }
+    return movement_sheet;
+}
+
+// Function to show the arrivals and departures of today or another business date
+void HotelManager::movements_report() {
+    std::string text;
+    long date = business_date;
+    std::cout << "\n Date (YYYY-MM-DD, blank for today): ";
+    std::getline(std::cin, text);
+    if (!text.empty() && !parse_date(text, date)) {
+        std::cout << "\n Invalid date." << std::endl;
+        return;
+    }
+    if (date == business_date) {
+        std::cout << "\n" << todays_movements();
+    } else {
+        std::string sheet;
+        render_movements(date, sheet);
+        std::cout << "\n" << sheet;
+    }
+}
+
+// Function to print free rooms per type for each night of the booking window
+void HotelManager::availability_report() {
+    std::cout << "\n AVAILABILITY" << std::endl;
+    std::cout << "--------------" << std::endl;
+    AvailabilityWindow window;
+    availability.snapshot(window);
+    std::cout << "\n Night      ";
+    for (int t = 0; t < ROOM_TYPE_COUNT; ++t) {
+        std::cout << std::setw(14) << ROOM_TYPE_RANGES[t].name;
+    }
+    std::cout << std::endl;
+    for (int n = 0; n < AVAILABILITY_NIGHTS; ++n) {
+        std::cout << " " << format_date(window.first_night + n);
+        for (int t = 0; t < ROOM_TYPE_COUNT; ++t) {
+            std::cout << std::setw(14) << window.free[n][t];
+        }
+        std::cout << std::endl;
+    }
+}
+
+// Function to write the room table through a temporary file and rename, so a
+// crash mid-write leaves the previous table in place
+bool HotelManager::commit_room_table() {
+    cancel_bgsave(); // An older snapshot must not be renamed over this one
+    std::string tmp = DATA_FILE + ".tmp";
+    std::ostringstream image;
+    write_room_table(image);
+    IoThrottle unpaced(0, nullptr);
+    bool ok = throttled_write(tmp, image.str(), unpaced); // Synced, so the rename publishes complete data
+    allotments.save(ALLOTMENT_FILE); // Draws made for the committed bookings
+    return ok && std::rename(tmp.c_str(), DATA_FILE.c_str()) == 0;
+}
+
+// Function to allocate rooms to validated channel files and commit each file
+// as one group: one room table write and one journal append for all of its
+// bookings. Current occupants come from one batched directory pass, and each
+// booking gets the lowest room free on all of its nights. Bookings are kept
+// as reservations until their arrival date, and channel guests are not in
+// house until they check in at the desk.
+void HotelManager::ingest_channel_batches() {
+    ChannelBatch batch;
+    while (channel_ingest.take_ready(batch)) {
+        auto start = std::chrono::steady_clock::now();
+        // Night from which each room is clear of its current occupant (a guest
+        // past their last night still holds the room until checkout)
+        std::vector<long> busy_until(room_directory.size(), 0);
+        std::vector<int> room_numbers;
+        for (int r_no = ROOM_TYPE_RANGES[0].first; r_no <= ROOM_TYPE_RANGES[ROOM_TYPE_COUNT - 1].last; ++r_no) {
+            room_numbers.push_back(r_no);
+        }
+        long today = business_date;
+        batch_lookup(room_directory.data(), room_directory.size(), room_numbers.data(), room_numbers.size(),
+                     [&busy_until, &room_numbers, today](size_t i, const RoomData* room) {
+                         if (room != nullptr) {
+                             busy_until[room_numbers[i]] = std::max(room->arrival_date + room->days, today + 1);
+                         }
+                     });
+        std::string journal;
+        long booked = 0;
+        for (auto& booking : batch.bookings) {
+            if (!booking.error.empty()) {
+                continue;
+            }
+            int t = room_type_index(booking.rtype);
+            if (booking.arrival_date < business_date) {
+                booking.error = "arrival date passed before a room was allocated";
+                continue;
+            }
+            // Rooms held for unsold allotments are kept back from other bookings
+            long held = 0;
+            for (long night = booking.arrival_date; !booking.from_allotment && night < booking.arrival_date + booking.nights;
+                 ++night) {
+                held = std::max(held, allotments.held(t, night));
+            }
+            // Rooms free on every night of the stay; the first one is taken
+            long departure = booking.arrival_date + booking.nights;
+            long free = 0;
+            int chosen = 0;
+            for (int r_no = ROOM_TYPE_RANGES[t].first; r_no <= ROOM_TYPE_RANGES[t].last; ++r_no) {
+                if (busy_until[r_no] <= booking.arrival_date && !reservations.conflicts(r_no, booking.arrival_date, departure)) {
+                    chosen = chosen == 0 ? r_no : chosen;
+                    free++;
+                }
+            }
+            if (free <= held) {
+                booking.error = "no " + booking.rtype + " room free" + (held > 0 ? " outside allotments" : "");
+                continue;
+            }
+            RoomData room;
+            room.room_no = chosen;
+            room.name = booking.name.c_str();
+            room.address = booking.address.c_str();
+            room.phone = booking.phone.c_str();
+            room.days = booking.nights;
+            room.rtype = booking.rtype;
+            room.cost = room.days * nightly_rate(room.room_no);
+            room.arrival_date = booking.arrival_date;
+            room.arrived = false;
+            room.from_allotment = booking.from_allotment;
+            room.channel_ref = booking.ref();
+            reservations.add(room); // Arrivals due today are moved into the room table below
+            availability.book(room);
+            cube.add_nights(room, room.arrival_date, room.arrival_date + room.days, 1);
+            movements.add(room);
+            booking.room_no = room.room_no;
+            booked++;
+            journal += "CHANNEL_BOOKING " + to_std_string(room.channel_ref) + " room=" + std::to_string(room.room_no) +
+                       " arrival=" + format_date(room.arrival_date) + " nights=" + std::to_string(room.days) + "\n";
+        }
+        if (booked > 0) {
+            admit_due_reservations();
+            if (!commit_room_table()) {
+                std::cerr << "\n Error: Could not write " << DATA_FILE << "; channel bookings from " << batch.file
+                          << " are saved at exit." << std::endl;
+            }
+            append_journal(journal + "CHANNEL_BATCH " + batch.file + " date=" + format_date(business_date) +
+                           " booked=" + std::to_string(booked) + " lines=" + std::to_string(batch.bookings.size()));
+        }
+        channel_ingest.finish(batch,
+                              std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+}
+
+// Function to move the reservations that arrive by today into their rooms. A
+// room still held by a guest who has not checked out is retried at checkout.
+void HotelManager::admit_due_reservations() {
+    std::vector<int> due;
+    long today = business_date;
+    reservations.for_each([&due, today](const RoomData& room) {
+        if (room.arrival_date <= today) {
+            due.push_back(room.room_no);
+        }
+    });
+    RoomData room;
+    for (int r_no : due) {
+        if (rooms_map.count(r_no) == 0 && reservations.take_due(r_no, business_date, room)) {
+            rooms_map[r_no] = room;
+            room_directory[r_no] = &rooms_map[r_no];
+            refresh_hot_room(room);
+        }
+    }
+}
+
+// Function to pull in channel files dropped since the last scan and show
+// what the pipeline has done
+void HotelManager::channel_ingestion() {
+    std::cout << "\n CHANNEL MANAGER INGESTION" << std::endl;
+    std::cout << "---------------------------" << std::endl;
+    channel_ingest.scan_now();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    for (;;) {
+        ingest_channel_batches();
+        if (channel_ingest.pending() == 0 || std::chrono::steady_clock::now() > deadline) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    channel_ingest.print_status(std::cout);
+    std::cout << "\n Drop files as " << CHANNEL_DIR << "/<name>.csv, one booking per line:" << std::endl;
+    std::cout << "   booking_id,channel,room_type,arrival(YYYY-MM-DD),nights,name,phone,address" << std::endl;
+}
+
+// Function to modify customer information
+void HotelManager::modify_customer_info() {
+    system("clear");
+    int ch, r_no;
+    std::cout << "\n MODIFY MENU:" << std::endl;
+    std::cout << "-------------" << std::endl;
+    std::cout << "\n 1. Modify Name" << std::endl;
+    std::cout << "\n 2. Modify Address" << std::endl;
+    std::cout << "\n 3. Modify Phone Number" << std::endl;
+    std::cout << "\n 4. Modify Number of Days of Stay" << std::endl;
+    std::cout << "\n Enter Your Choice: ";
+    std::cin >> ch;
+    clearInputBuffer();
+
+    system("clear");
+    std::cout << "\n Enter Room Number to modify: ";
+    std::cin >> r_no;
+    clearInputBuffer();
+
+    auto it = rooms_map.find(r_no);
+    if (it == rooms_map.end()) {
+        std::cout << "\n Sorry, Room " << r_no << " is vacant or does not exist." << std::endl;
+        return;
+    }
+
+    switch(ch) {
+        case 1:
+            modify_name(r_no);
+            break;
+        case 2:
+            modify_address(r_no);
+            break;
+        case 3:
+            modify_phone(r_no);
+            break;
+        case 4:
+            modify_days(r_no);
+            break;
+        default:
+            std::cout << "\n Wrong Choice. Please try again." << std::endl;
+            break;
+    }
+}
+
+// Function to modify the name of a guest
+void HotelManager::modify_name(int r_no) {
+    auto it = rooms_map.find(r_no);
+    if (it != rooms_map.end()) {
+        std::string old_value = to_std_string(it->second.name);
+        std::cout << "\n Enter New Name: ";
+        std::getline(std::cin, it->second.name);
+        audit_trail.record(r_no, AUDIT_NAME, old_value, to_std_string(it->second.name), terminal_id);
+        refresh_hot_room(it->second);
+        std::cout << "\n Customer Name has been modified." << std::endl;
+    } else {
+        std::cout << "\n Sorry, Room is vacant." << std::endl;
+    }
+}
+
+// Function to modify the address of a guest
+void HotelManager::modify_address(int r_no) {
+    auto it = rooms_map.find(r_no);
+    if (it != rooms_map.end()) {
+        std::string old_value = to_std_string(it->second.address);
+        std::cout << "\n Enter New Address: ";
+        std::getline(std::cin, it->second.address);
+        audit_trail.record(r_no, AUDIT_ADDRESS, old_value, to_std_string(it->second.address), terminal_id);
+        refresh_hot_room(it->second);
+        std::cout << "\n Customer Address has been modified." << std::endl;
+    } else {
+        std::cout << "\n Sorry, Room is vacant." << std::endl;
+    }
+}
+
+// Function to modify the phone number of a guest
+void HotelManager::modify_phone(int r_no) {
+    auto it = rooms_map.find(r_no);
+    if (it != rooms_map.end()) {
+        std::string old_value = to_std_string(it->second.phone);
+        std::cout << "\n Enter New Phone Number: ";
+        std::getline(std::cin, it->second.phone);
+        audit_trail.record(r_no, AUDIT_PHONE, old_value, to_std_string(it->second.phone), terminal_id);
+        refresh_hot_room(it->second);
+        std::cout << "\n Customer Phone Number has been modified." << std::endl;
+    } else {
+        std::cout << "\n Sorry, Room is vacant." << std::endl;
+    }
+}
+
+// Function to modify the number of days of stay for a guest
+void HotelManager::modify_days(int r_no) {
+    auto it = rooms_map.find(r_no);
+    if (it != rooms_map.end()) {
+        long old_days = it->second.days;
+        long new_days = 0;
+        std::cout << "\n Enter New Number of Days of Stay: ";
+        std::cin >> new_days;
+        clearInputBuffer();
+        if (new_days < 1 || new_days > MAX_STAY_NIGHTS) {
+            std::cout << "\n Sorry, the stay must be 1-" << MAX_STAY_NIGHTS << " days." << std::endl;
+            return;
+        }
+        long reserved_from = reservations.next_arrival(r_no, it->second.arrival_date + old_days);
+        if (new_days > old_days && reserved_from >= 0 && reserved_from < it->second.arrival_date + new_days) {
+            std::cout << "\n Sorry, Room " << r_no << " is reserved from " << format_date(reserved_from)
+                      << "; the stay can be extended to at most " << (reserved_from - it->second.arrival_date)
+                      << " days." << std::endl;
+            return;
+        }
+        // Allotment nights follow the stay: an extension draws the added nights
+        // from the block (or, for other bookings, may not take held rooms), and
+        // a shortening gives the trimmed nights back
+        RoomData& room = it->second;
+        int type = room_type_index(to_std_string(room.rtype));
+        long stay_end = room.arrival_date + old_days;
+        if (new_days > old_days) {
+            if (room.from_allotment) {
+                if (!allotments.draw(allotment_agent(room), type, stay_end, new_days - old_days)) {
+                    std::cout << "\n Sorry, the " << allotment_agent(room) << " allotment cannot cover the added nights."
+                              << std::endl;
+                    return;
+                }
+            } else if (held_for_allotments(type, stay_end, room.arrival_date + new_days)) {
+                std::cout << "\n Sorry, the free " << room.rtype << " rooms are held for allotments on at least"
+                          << " one of the added nights." << std::endl;
+                return;
+            }
+        } else if (new_days < old_days && room.from_allotment) {
+            allotments.restore(allotment_agent(room), type, std::max(room.arrival_date + new_days, business_date),
+                               stay_end);
+        }
+        it->second.days = new_days;
+
+        // Recalculate cost based on new days
+        it->second.cost = it->second.days * nightly_rate(it->second.room_no);
+        long arrival = it->second.arrival_date;
+        if (it->second.days > old_days) {
+            availability.adjust(r_no, arrival + old_days, arrival + it->second.days, -1);
+            cube.add_nights(it->second, arrival + old_days, arrival + it->second.days, 1);
+        } else {
+            availability.adjust(r_no, arrival + it->second.days, arrival + old_days, 1);
+            cube.add_nights(it->second, arrival + it->second.days, arrival + old_days, -1);
+        }
+        movements.move_departure(r_no, arrival + old_days, arrival + it->second.days);
+        it->second.due_out = it->second.nights_posted >= it->second.days;
+        refresh_hot_room(it->second);
+        audit_trail.record(r_no, AUDIT_DAYS, std::to_string(old_days), std::to_string(it->second.days), terminal_id);
+        std::cout << "\n Customer information is modified." << std::endl;
+    } else {
+        std::cout << "\n Sorry, Room is vacant." << std::endl;
+    }
+}
+
+// Function to delete a customer record (check out)
+void HotelManager::delete_customer_record() {
+    int r_no;
+    char confirm_char;
+    std::cout << "\n Enter Room Number to check out: ";
+    std::cin >> r_no;
+    clearInputBuffer();
+
+    const RoomData* room = find_room(r_no);
+    if (room != nullptr) {
+        // Room found, display details before checkout
+        std::cout << "\n Name: " << room->name << std::endl;
+        std::cout << "\n Address: " << room->address << std::endl;
+        std::cout << "\n Phone Number: " << room->phone << std::endl;
+        std::cout << "\n Your total bill is: Rs. " << checkout_quote(r_no) << std::endl;
+        std::cout << "\n Do you want to check out this customer (y/n): ";
+        std::cin >> confirm_char;
+        clearInputBuffer();
+
+        if (confirm_char == 'y' || confirm_char == 'Y') {
+            if (check_out(r_no) < 0) {
+                std::cout << "\n Room " << r_no << " was checked out meanwhile." << std::endl;
+            }
+        } else {
+            std::cout << "\n Checkout cancelled." << std::endl;
+        }
+    } else {
+        std::cout << "\n Sorry, Room " << r_no << " is vacant or does not exist." << std::endl;
+    }
+    std::cout << "\n Press Enter to continue.";
+    std::cin.get();
+}
+
+// Function to return a room's record, or nullptr if it is vacant
+const RoomData* HotelManager::find_room(int r_no) const {
+    auto it = rooms_map.find(r_no);
+    return it == rooms_map.end() ? nullptr : &it->second;
+}
+
+// Function to insert a booking into the room table and its indexes. The room
+// is checked again here, in the step that inserts, so a vacancy seen earlier
+// can never turn into a double booking.
+bool HotelManager::commit_booking(const RoomData& room) {
+    if (check_room_status(room.room_no) != 0 || rooms_map.count(room.room_no) != 0 ||
+        reservations.conflicts(room.room_no, room.arrival_date, room.arrival_date + room.days)) {
+        return false;
+    }
+    RoomData& stored = rooms_map[room.room_no] = room;
+    room_directory[room.room_no] = &stored;
+    refresh_hot_room(stored);
+    availability.book(stored);
+    cube.add_nights(stored, stored.arrival_date, stored.arrival_date + stored.days, 1);
+    movements.add(stored);
+    return true;
+}
+
+// Function to return the bill shown before checkout: the folios plus the
+// booked nights not yet accrued
+long HotelManager::checkout_quote(int r_no) const {
+    const RoomData* room = find_room(r_no);
+    if (room == nullptr) {
+        return -1;
+    }
+    return folio_balance(*room) + std::max(0L, room->cost - room->room_charges);
+}
+
+// Function to check a guest out: post the balance of stay, print and publish
+// the invoice, settle the folios, archive the stay and free the room
+long HotelManager::check_out(int r_no) {
+    auto it = rooms_map.find(r_no);
+    if (it == rooms_map.end()) {
+        return -1;
+    }
+    RoomData& room = it->second;
+    long outstanding = room.cost - room.room_charges; // Booked nights not yet accrued
+    if (outstanding > 0) {
+        post_charge(room, CHARGE_ROOM, outstanding, "Room charges (balance of stay)");
+    }
+    render_invoice(room, business_date, INVOICE_TEXT, invoice_buffer);
+    std::cout << "\n" << invoice_buffer;
+    // Settle each folio from its running total
+    for (const auto& folio : room.folios) {
+        if (&folio == &room.folios[0]) {
+            std::cout << "\n Guest pays: Rs. " << folio.total << std::endl;
+        } else {
+            std::cout << "\n Billed to " << folio.payer << " (group " << room.group_code
+                      << "): Rs. " << folio.total << std::endl;
+        }
+    }
+    long billed = folio_balance(room);
+    render_invoice_batch({&room}, {INVOICE_TEXT, INVOICE_HTML});
+    award_loyalty_points(room);
+    if (room.from_allotment) { // Unstayed nights go back to the agent's block
+        allotments.restore(allotment_agent(room), room_type_index(to_std_string(room.rtype)),
+                           std::max(room.arrival_date, business_date), room.arrival_date + room.days);
+    }
+    stay_archive.append(room, business_date);
+    availability.adjust(r_no, std::max(room.arrival_date, business_date), room.arrival_date + room.days, 1);
+    cube.add_nights(room, std::max(room.arrival_date, business_date), room.arrival_date + room.days, -1);
+    movements.remove(room);
+    rooms_map.erase(it);
+    room_directory[r_no] = nullptr;
+    hot_rooms.clear(r_no);
+    admit_due_reservations(); // A reservation may have been waiting for this room
+    std::cout << "\n Customer Checked Out. Room " << r_no << " is now vacant." << std::endl;
+    return billed;
+}
+
+// Function to post a meal order (1 breakfast, 2 lunch, 3 dinner) to a room
+long HotelManager::post_meal(int r_no, int meal, int num_people) {
+    auto it = rooms_map.find(r_no);
+    if (it == rooms_map.end()) {
+        return -1;
+    }
+    long balance_before = folio_balance(it->second);
+    switch(meal) {
+        case 1:
+            calculateBreakfastCost(it->second, num_people);
+            break;
+        case 2:
+            calculateLunchCost(it->second, num_people);
+            break;
+        case 3:
+            calculateDinnerCost(it->second, num_people);
+            break;
+        default:
+            break;
+    }
+    return folio_balance(it->second) - balance_before;
+}
+
+long HotelManager::posted_total() const {
+    long total = 0;
+    for (int c = 0; c < CHARGE_CATEGORY_COUNT; ++c) {
+        total += revenue.range(-1, c, revenue.first_date(), business_date);
+    }
+    return total;
+}
+
+long HotelManager::in_house_balance() const {
+    long total = 0;
+    for (const auto& pair : rooms_map) {
+        total += folio_balance(pair.second);
+    }
+    return total;
+}
+
+void HotelManager::check_consistency(std::vector<std::string>& problems) {
+    long tonight[ROOM_TYPE_COUNT] = {};
+    long occupied_tonight = 0;
+    long today = business_date;
+    auto count_stay = [&tonight, &occupied_tonight, today](const RoomData& room) {
+        int t = room_type_of(room.room_no);
+        if (t >= 0 && today >= room.arrival_date && today < room.arrival_date + room.days) {
+            tonight[t]++;
+            occupied_tonight++;
+        }
+    };
+    for (const auto& pair : rooms_map) {
+        count_stay(pair.second);
+        if (room_directory[pair.first] != &pair.second) {
+            problems.push_back("room " + std::to_string(pair.first) + " missing from the directory");
+        }
+    }
+    reservations.for_each(count_stay);
+    for (int r_no = 1; r_no <= HotRoomTable::MAX_ROOMS; ++r_no) {
+        bool hot = hot_rooms.load(r_no).room_no != 0;
+        if (hot != (rooms_map.count(r_no) != 0)) {
+            problems.push_back("hot copy of room " + std::to_string(r_no) + (hot ? " outlived its stay" : " is missing"));
+        }
+    }
+    AvailabilityWindow window;
+    availability.snapshot(window);
+    for (int t = 0; t < ROOM_TYPE_COUNT && window.first_night == business_date; ++t) {
+        long expected = ROOM_TYPE_RANGES[t].last - ROOM_TYPE_RANGES[t].first + 1 - tonight[t];
+        if (window.free[0][t] != expected) {
+            problems.push_back(std::string("availability of ") + ROOM_TYPE_RANGES[t].name + " tonight is " +
+                               std::to_string(window.free[0][t]) + ", room table says " + std::to_string(expected));
+        }
+    }
+    CubeMeasures cell = cube.slice(OccupancyCube::ALL, OccupancyCube::ALL, OccupancyCube::ALL, OccupancyCube::ALL,
+                                   business_date, business_date);
+    if (cell.room_nights != occupied_tonight) {
+        problems.push_back("cube has " + std::to_string(cell.room_nights) + " room-nights tonight, room table " +
+                           std::to_string(occupied_tonight));
+    }
+}
+
+// Function to handle restaurant food orders
+void HotelManager::order_food() {
+    system("clear");
+    int r_no, meal_choice, num_people;
+    std::cout << "\n RESTAURANT MENU:" << std::endl;
+    std::cout << "------------------" << std::endl;
+    std::cout << "\n 1. Order Breakfast" << std::endl;
+    std::cout << " 2. Order Lunch" << std::endl;
+    std::cout << " 3. Order Dinner" << std::endl;
+    std::string request_key;
+    if (replay_keyed_request(request_key)) {
+        std::cout << "\n Press Enter to continue.";
+        std::cin.get();
+        return;
+    }
+    std::cout << "\n Enter your choice: ";
+    std::cin >> meal_choice;
+    clearInputBuffer();
+
+    system("clear");
+    std::cout << " Enter Room Number for the order: ";
+    std::cin >> r_no;
+    clearInputBuffer();
+
+    auto it = rooms_map.find(r_no);
+    if (it == rooms_map.end()) {
+        std::cout << "\n Sorry, Room " << r_no << " is vacant or does not exist." << std::endl;
+        std::cout << "\n Press Enter to continue.";
+        std::cin.get();
+        return;
+    }
+    std::cout << " Enter number of people: ";
+    std::cin >> num_people;
+    clearInputBuffer();
+    long posted = post_meal(r_no, meal_choice, num_people);
+    if (posted == 0) {
+        std::cout << "\n Invalid choice for meal." << std::endl;
+    } else if (posted > 0 && !request_key.empty()) { // Only a posted order is remembered; a bad one can be retried
+        request_results.complete(request_key, "Rs. " + std::to_string(posted) + " added to the bill of Room " +
+                                                  std::to_string(r_no) + ".");
+    }
+    std::cout << "\n Press Enter to continue.";
+    std::cin.get();
+}
+
+// Private helper functions for food cost calculation
+void HotelManager::calculateBreakfastCost(RoomData& room, int num_people) {
+    long cost_per_person = 500;
+    long added_cost = cost_per_person * num_people;
+    post_charge(room, CHARGE_FOOD, added_cost, "Breakfast x " + std::to_string(num_people));
+    std::cout << "\n Rs. " << added_cost << " added to the bill for breakfast." << std::endl;
+}
+
+void HotelManager::calculateLunchCost(RoomData& room, int num_people) {
+    long cost_per_person = 1000;
+    long added_cost = cost_per_person * num_people;
+    post_charge(room, CHARGE_FOOD, added_cost, "Lunch x " + std::to_string(num_people));
+    std::cout << "\n Rs. " << added_cost << " added to the bill for lunch." << std::endl;
+}
+
+void HotelManager::calculateDinnerCost(RoomData& room, int num_people) {
+    long cost_per_person = 1200;
+    long added_cost = cost_per_person * num_people;
+    post_charge(room, CHARGE_FOOD, added_cost, "Dinner x " + std::to_string(num_people));
+    std::cout << "\n Rs. " << added_cost << " added to the bill for dinner." << std::endl;
+}
+
+// ---------------------------------------------------------------------------
+// Deterministic simulation harness
+//
+// Front-desk operations run as tasks against a real HotelManager (read-only,
+// in a scratch directory), split at the points where the desk waits for the
+// clerk: a booking checks the room and later commits it (commit_booking), a
+// checkout shows the bill and later settles it (checkout_quote, check_out),
+// and a food order finds the room and later posts the meal (post_meal). A
+// seeded scheduler picks which task runs its next step, so every interleaving
+// is reproducible from the seed, and the chosen schedule can be saved and
+// replayed exactly. After every step the invariants are checked on the
+// manager's own state:
+//   - no double booking (each room holds the guest whose booking succeeded
+//     last, until that guest checks out)
+//   - bills never lost (everything posted is either billed or still in house)
+//   - aggregates (directory, hot copies, availability, cube) match the room table
+// ---------------------------------------------------------------------------
+
+enum SimTaskKind {
+    SIM_BOOK,
+    SIM_CHECKOUT,
+    SIM_ORDER
+};
+
+static const char* const SIM_TASK_NAMES[] = { "book", "checkout", "order" };
+
+struct SimTask {
+    int kind;
+    int room_no;
+    std::string guest;
+    int meal;         // 1-3 for SIM_ORDER
+    int people;
+    int step;         // Next step to run
+    bool done;
+    long observed;    // Value read in an earlier step (room status or bill)
+};
+
+// What the harness saw the operations do, checked against the manager
+struct SimState {
+    std::unordered_map<int, std::string> occupants; // Room -> guest of the last successful booking
+    long billed_total;                              // Every bill settled at checkout
+    std::vector<std::string> violations;
+
+    SimState() : billed_total(0) {}
+};
+
+// Parameters that, together with the seed, fully determine a simulation
+struct SimConfig {
+    uint64_t seed;
+    int tasks;
+    int rooms;       // Rooms 1..rooms are contended
+};
+
+static RoomData sim_booking(const HotelManager& hotel, int r_no, const std::string& guest) {
+    RoomData room;
+    room.room_no = r_no;
+    room.name = guest.c_str();
+    room.phone = ("9" + std::to_string(r_no)).c_str();
+    room.days = 1;
+    room.rtype = ROOM_TYPE_RANGES[room_type_of(r_no)].name;
+    room.cost = nightly_rate(r_no);
+    room.arrival_date = hotel.today();
+    room.arrived = true;
+    return room;
+}
+
+// Runs one step of a task through the manager's front-desk operations
+static void sim_step(HotelManager& hotel, SimState& st, SimTask& task) {
+    switch (task.kind) {
+        case SIM_BOOK:
+            if (task.step == 0) {
+                task.observed = hotel.check_room_status(task.room_no);
+                task.done = task.observed != 0;
+            } else {
+                if (hotel.commit_booking(sim_booking(hotel, task.room_no, task.guest))) {
+                    if (st.occupants.count(task.room_no) != 0) {
+                        st.violations.push_back("double booking of room " + std::to_string(task.room_no) + ": " +
+                                                st.occupants[task.room_no] + " replaced by " + task.guest);
+                    }
+                    st.occupants[task.room_no] = task.guest;
+                }
+                task.done = true;
+            }
+            break;
+        case SIM_CHECKOUT:
+            if (task.step == 0) {
+                task.observed = hotel.checkout_quote(task.room_no); // Bill shown to the guest
+                task.done = task.observed < 0;
+            } else {
+                long billed = hotel.check_out(task.room_no);
+                if (billed >= 0) {
+                    st.billed_total += billed;
+                    st.occupants.erase(task.room_no);
+                }
+                task.done = true;
+            }
+            break;
+        case SIM_ORDER:
+            if (task.step == 0) {
+                task.observed = hotel.check_room_status(task.room_no);
+                task.done = task.observed != 1;
+            } else {
+                hotel.post_meal(task.room_no, task.meal, task.people);
+                task.done = true;
+            }
+            break;
+    }
+    task.step++;
+}
+
+static void sim_check_invariants(HotelManager& hotel, SimState& st, const SimConfig& cfg, const std::string& where) {
+    for (int r_no = 1; r_no <= cfg.rooms; ++r_no) {
+        const RoomData* room = hotel.find_room(r_no);
+        auto expected = st.occupants.find(r_no);
+        std::string actual = room ? to_std_string(room->name) : "";
+        if ((expected == st.occupants.end() ? std::string() : expected->second) != actual) {
+            st.violations.push_back(where + ": room " + std::to_string(r_no) + " holds '" + actual + "', expected '" +
+                                    (expected == st.occupants.end() ? std::string() : expected->second) + "'");
+        }
+    }
+    long posted = hotel.posted_total();
+    long balance = hotel.in_house_balance();
+    if (posted != st.billed_total + balance) {
+        st.violations.push_back(where + ": bill lost, posted " + std::to_string(posted) + " != billed " +
+                                std::to_string(st.billed_total) + " + in house " + std::to_string(balance));
+    }
+    std::vector<std::string> problems;
+    hotel.check_consistency(problems);
+    for (const auto& problem : problems) {
+        st.violations.push_back(where + ": " + problem);
+    }
+}
+
+// Books the seed's initial residents and generates the task list
+static void sim_setup(const SimConfig& cfg, HotelManager& hotel, SimState& st, std::vector<SimTask>& tasks) {
+    std::mt19937_64 rng(cfg.seed);
+    for (int r_no = 1; r_no <= cfg.rooms; ++r_no) {
+        if (rng() % 2 == 0) {
+            std::string guest = "Resident" + std::to_string(r_no);
+            if (hotel.commit_booking(sim_booking(hotel, r_no, guest))) {
+                st.occupants[r_no] = guest;
+            }
+        }
+    }
+    for (int i = 0; i < cfg.tasks; ++i) {
+        SimTask task;
+        task.kind = static_cast<int>(rng() % 3);
+        task.room_no = 1 + static_cast<int>(rng() % cfg.rooms);
+        task.guest = "Guest" + std::to_string(i);
+        task.meal = 1 + static_cast<int>(rng() % 3);
+        task.people = 1 + static_cast<int>(rng() % 4);
+        task.step = 0;
+        task.done = false;
+        task.observed = 0;
+        tasks.push_back(task);
+    }
+}
+
+// Runs one simulation in a fresh scratch directory, with the manager's own
+// output suppressed. If replay is non-null its choices are used instead of the
+// seeded scheduler; the choices actually made are returned in schedule.
+static bool sim_run(const SimConfig& cfg, const std::vector<int>* replay, std::vector<int>& schedule,
+                    std::vector<std::string>& violations, bool verbose) {
+    char scratch[] = "/tmp/hms-sim-XXXXXX";
+    if (mkdtemp(scratch) == nullptr) {
+        violations.push_back(std::string("could not create a scratch directory: ") + std::strerror(errno));
+        return false;
+    }
+    std::filesystem::path home = std::filesystem::current_path();
+    std::filesystem::current_path(scratch);
+    std::streambuf* screen = std::cout.rdbuf();
+    std::ostringstream discarded;
+    bool ok = true;
+    {
+        std::cout.rdbuf(discarded.rdbuf());
+        HotelManager hotel(nullptr, true);
+        SimState st;
+        std::vector<SimTask> tasks;
+        sim_setup(cfg, hotel, st, tasks);
+        std::mt19937_64 sched_rng(cfg.seed ^ 0x5DEECE66DULL);
+        schedule.clear();
+
+        for (size_t n = 0; ok; ++n) {
+            std::vector<int> runnable;
+            for (size_t i = 0; i < tasks.size(); ++i) {
+                if (!tasks[i].done) {
+                    runnable.push_back(static_cast<int>(i));
+                }
+            }
+            if (runnable.empty()) {
+                break;
+            }
+            int pick;
+            if (replay != nullptr) {
+                if (n >= replay->size() || tasks[(*replay)[n]].done) {
+                    violations.push_back("replay diverged at step " + std::to_string(n));
+                    ok = false;
+                    break;
+                }
+                pick = (*replay)[n];
+            } else {
+                pick = runnable[sched_rng() % runnable.size()];
+            }
+            schedule.push_back(pick);
+            SimTask& task = tasks[pick];
+            if (verbose) {
+                std::cout.rdbuf(screen);
+                std::cout << "  step " << n << ": task " << pick << " " << SIM_TASK_NAMES[task.kind]
+                          << " room " << task.room_no << " (step " << task.step << ")" << std::endl;
+                std::cout.rdbuf(discarded.rdbuf());
+            }
+            sim_step(hotel, st, task);
+            sim_check_invariants(hotel, st, cfg, "after step " + std::to_string(n));
+            discarded.str("");
+            if (!st.violations.empty()) {
+                violations = st.violations;
+                ok = false;
+            }
+        }
+    }
+    std::cout.rdbuf(screen);
+    std::filesystem::current_path(home);
+    std::error_code ec;
+    std::filesystem::remove_all(scratch, ec);
+    return ok;
+}
+
+static bool sim_save_schedule(const std::string& file, const SimConfig& cfg, const std::vector<int>& schedule) {
+    std::ofstream out(file);
+    if (!out.is_open()) {
+        return false;
+    }
+    out << "seed " << cfg.seed << "\ntasks " << cfg.tasks << "\nrooms " << cfg.rooms << "\nschedule";
+    for (int pick : schedule) {
+        out << ' ' << pick;
+    }
+    out << '\n';
+    return true;
+}
+
+// Explores runs seeds starting at seed: HMS --simulate <seed> [runs] [tasks]
+static int simulate(const SimConfig& base, int runs) {
+    for (int run = 0; run < runs; ++run) {
+        SimConfig cfg = base;
+        cfg.seed = base.seed + run;
+        std::vector<int> schedule;
+        std::vector<std::string> violations;
+        if (!sim_run(cfg, nullptr, schedule, violations, false)) {
+            std::string file = "sim-" + std::to_string(cfg.seed) + ".schedule";
+            std::cout << "Seed " << cfg.seed << ": FAILED after " << schedule.size() << " step(s)" << std::endl;
+            for (const auto& v : violations) {
+                std::cout << "  " << v << std::endl;
+            }
+            if (sim_save_schedule(file, cfg, schedule)) {
+                std::cout << "  schedule saved; replay with: HMS --replay " << file << std::endl;
+            }
+            return 1;
+        }
+    }
+    std::cout << runs << " simulation(s) from seed " << base.seed << " passed ("
+              << "front-desk operations, " << base.tasks << " tasks, "
+              << base.rooms << " rooms)" << std::endl;
+    return 0;
+}
+
+// Replays a saved schedule step by step: HMS --replay <file>
+static int replay_schedule(const std::string& file) {
+    std::ifstream in(file);
+    if (!in.is_open()) {
+        std::cerr << "Could not open " << file << std::endl;
+        return 2;
+    }
+    SimConfig cfg = {0, 0, 0};
+    std::vector<int> choices;
+    std::string key;
+    while (in >> key) {
+        if (key == "seed") {
+            in >> cfg.seed;
+        } else if (key == "tasks") {
+            in >> cfg.tasks;
+        } else if (key == "rooms") {
+            in >> cfg.rooms;
+        } else if (key == "schedule") {
+            int pick;
+            while (in >> pick) {
+                choices.push_back(pick);
+            }
+        }
+    }
+    if (cfg.tasks <= 0 || cfg.rooms <= 0) {
+        std::cerr << file << " is not a schedule file" << std::endl;
+        return 2;
+    }
+    for (int pick : choices) {
+        if (pick < 0 || pick >= cfg.tasks) {
+            std::cerr << file << " has an invalid task index " << pick << std::endl;
+            return 2;
+        }
+    }
+
+    std::cout << "Replaying seed " << cfg.seed << " (" << choices.size() << " steps)" << std::endl;
+    std::vector<int> schedule;
+    std::vector<std::string> violations;
+    bool ok = sim_run(cfg, &choices, schedule, violations, true);
+    for (const auto& v : violations) {
+        std::cout << "  " << v << std::endl;
+    }
+    std::cout << (ok ? "Replay passed" : "Replay reproduced the failure") << std::endl;
+    return ok ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// Thread-per-core partitioned server: HMS --serve-partitioned [partitions] [rooms]
+//
+// Each partition thread is pinned to a core and owns the rooms whose number
+// hashes to it: their records, a private heap carved from its own arena (huge
+// pages per HMS_HUGEPAGES=off|thp|explicit) and its own journal file. Nothing
+// is shared between partitions, so a room record never bounces between cores
+// and nothing is locked. A router thread parses line-based requests from stdin
+// and hands each one to the owning partition over a lock-free single-producer
+// single-consumer ring; replies come back on a ring per partition and are
+// printed as they complete, tagged with the request's arrival number.
+//
+// The partitions start from the hotel's own room table: Record.DAT is loaded
+// through HotelManager, each partition takes its occupied rooms and the first
+// reserved night of each room, and rooms are charged at their real rates. At
+// exit (and at the next start of the server or the desk, after a crash) the
+// partition journals are replayed through the front-desk steps and committed
+// to Record.DAT (see HotelManager::fold_partition_journals).
+//
+// An admission controller sits in front of the router. Requests wait in
+// per-class queues (checkout > booking > order > report) and are dispatched by
+// priority into a bounded in-flight window (HMS_MAX_INFLIGHT). Arrivals to a
+// full queue are rejected, queued orders and reports past their deadline are
+// shed, and latency is tracked per class, so a flood of reports cannot starve
+// check-ins and check-outs. Requests for different rooms may therefore run out
+// of arrival order; requests for the same room never do.
+//
+// Group bookings span partitions and use two-phase commit with the router as
+// coordinator: every involved partition first holds its rooms and votes
+// (PREPARE); only if all vote yes are the holds turned into bookings (COMMIT),
+// otherwise they are released (ABORT). A held room refuses other bookings.
+//
+// Requests, one per line:
+//   book <room> <days> <phone> <name...>
+//   order <room> breakfast|lunch|dinner <people>
+//   checkout <room>
+//   show <room>
+//   group <code> <days> <room,room,...> <contact name...>
+//   stats
+// ---------------------------------------------------------------------------
+
+// Bounded lock-free ring between exactly one producer and one consumer thread.
+// Each side caches the other's index so the shared cache lines are only read
+// when the ring looks full or empty.
+template <typename T>
+class SpscQueue {
+private:
+    std::vector<T> slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head; // Next slot to read (written by the consumer)
+    alignas(64) std::atomic<size_t> tail; // Next slot to write (written by the producer)
+    alignas(64) size_t cached_head;       // Producer's copy of head
+    alignas(64) size_t cached_tail;       // Consumer's copy of tail
+
+public:
+    explicit SpscQueue(size_t capacity) : head(0), tail(0), cached_head(0), cached_tail(0) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    bool try_push(T& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cached_head == slots.size()) {
+            cached_head = head.load(std::memory_order_acquire);
+            if (t - cached_head == slots.size()) {
+                return false;
+            }
+        }
+        slots[t & mask] = std::move(item);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == cached_tail) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h == cached_tail) {
+                return false;
+            }
+        }
+        item = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+// Spin briefly, then yield, then sleep while a polling loop finds no work
+static void idle_backoff(int& idle) {
+    ++idle;
+    if (idle < 64) {
+        return;
+    } else if (idle < 128) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+// Reads the page size policy for partition arenas from HMS_HUGEPAGES
+static HugePageMode hugepage_mode_from_env() {
+    const char* mode = std::getenv("HMS_HUGEPAGES");
+    if (mode == nullptr || std::string(mode) == "thp") {
+        return HUGEPAGE_TRANSPARENT;
+    }
+    if (std::string(mode) == "explicit") {
+        return HUGEPAGE_EXPLICIT;
+    }
+    if (std::string(mode) != "off") {
+        std::cerr << " Warning: HMS_HUGEPAGES=" << mode << " is not off, thp or explicit; using off." << std::endl;
+    }
+    return HUGEPAGE_OFF;
+}
+
+// A partition's private heap: 64-byte size classes with intrusive free lists
+// on top of the partition's arena, so freed nodes are reused by the same core
+// and never travel through the global allocator. Blocks of CLASS_COUNT classes
+// or more (bucket arrays, long strings) carry a one-class header with their
+// size and are reused best fit, up to twice the size asked for, from a list
+// of their own.
+class PartitionHeap {
+public:
+    static const size_t CLASS_SIZE = 64;
+    static const size_t CLASS_COUNT = 64; // Blocks this many classes and up are large
+
+private:
+    struct LargeBlock {   // Header in front of a large block
+        size_t classes;   // Size of the block behind the header
+        LargeBlock* next; // Next free large block
+    };
+
+    HugePageArena arena;
+    std::vector<void*> free_lists;
+    LargeBlock* free_large;
+    size_t live;
+    size_t carved;
+
+    void* allocate_large(size_t cls) {
+        LargeBlock** best = nullptr;
+        for (LargeBlock** link = &free_large; *link != nullptr; link = &(*link)->next) {
+            size_t have = (*link)->classes;
+            if (have >= cls && have <= 2 * cls && (best == nullptr || have < (*best)->classes)) {
+                best = link;
+            }
+        }
+        LargeBlock* block;
+        if (best != nullptr) {
+            block = *best;
+            *best = block->next;
+        } else {
+            block = static_cast<LargeBlock*>(arena.allocate((cls + 1) * CLASS_SIZE, CLASS_SIZE));
+            block->classes = cls;
+            carved += (cls + 1) * CLASS_SIZE;
+        }
+        live += block->classes * CLASS_SIZE;
+        return reinterpret_cast<char*>(block) + CLASS_SIZE;
+    }
+
+public:
+    PartitionHeap(size_t bytes, HugePageMode mode)
+        : arena(bytes, mode), free_lists(CLASS_COUNT, nullptr), free_large(nullptr), live(0), carved(0) {}
+
+    void* allocate(size_t bytes) {
+        size_t cls = std::max<size_t>(1, (bytes + CLASS_SIZE - 1) / CLASS_SIZE);
+        if (cls >= CLASS_COUNT) {
+            return allocate_large(cls);
+        }
+        if (free_lists[cls] != nullptr) {
+            void* block = free_lists[cls];
+            free_lists[cls] = *static_cast<void**>(block);
+            live += cls * CLASS_SIZE;
+            return block;
+        }
+        void* block = arena.allocate(cls * CLASS_SIZE, CLASS_SIZE); // Throws std::bad_alloc when full
+        carved += cls * CLASS_SIZE;
+        live += cls * CLASS_SIZE;
+        return block;
+    }
+    void deallocate(void* block, size_t bytes) {
+        size_t cls = std::max<size_t>(1, (bytes + CLASS_SIZE - 1) / CLASS_SIZE);
+        if (cls >= CLASS_COUNT) {
+            LargeBlock* header = reinterpret_cast<LargeBlock*>(static_cast<char*>(block) - CLASS_SIZE);
+            live -= header->classes * CLASS_SIZE;
+            header->next = free_large;
+            free_large = header;
+            return;
+        }
+        live -= cls * CLASS_SIZE;
+        *static_cast<void**>(block) = free_lists[cls];
+        free_lists[cls] = block;
+    }
+    size_t live_bytes() const { return live; }
+    size_t carved_bytes() const { return carved; }
+    HugePageMode mode() const { return arena.mode(); }
+};
+
+// Standard allocator over a partition's heap
+template <typename T>
+struct PartitionAllocator {
+    typedef T value_type;
+    PartitionHeap* heap;
+
+    explicit PartitionAllocator(PartitionHeap* h) noexcept : heap(h) {}
+    template <typename U>
+    PartitionAllocator(const PartitionAllocator<U>& other) noexcept : heap(other.heap) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(heap->allocate(n * sizeof(T))); }
+    void deallocate(T* ptr, size_t n) noexcept { heap->deallocate(ptr, n * sizeof(T)); }
+};
+
+template <typename T, typename U>
+bool operator==(const PartitionAllocator<T>& a, const PartitionAllocator<U>& b) { return a.heap == b.heap; }
+template <typename T, typename U>
+bool operator!=(const PartitionAllocator<T>& a, const PartitionAllocator<U>& b) { return a.heap != b.heap; }
+
+typedef std::basic_string<char, std::char_traits<char>, PartitionAllocator<char>> PartitionString;
+
+// A booked room as held by its owning partition
+struct PartitionRoom {
+    PartitionString name;
+    PartitionString phone;
+    PartitionString group_code;
+    long days;
+    long cost;
+    long food_bill;
+
+    explicit PartitionRoom(PartitionHeap* heap)
+        : name(PartitionAllocator<char>(heap)), phone(PartitionAllocator<char>(heap)),
+          group_code(PartitionAllocator<char>(heap)), days(0), cost(0), food_bill(0) {}
+};
+
+enum PartitionOp {
+    POP_BOOK,
+    POP_ORDER,
+    POP_CHECKOUT,
+    POP_SHOW,
+    POP_PREPARE, // Hold rooms for a group booking and vote
+    POP_COMMIT,  // Turn the holds into bookings
+    POP_ABORT,   // Release the holds
+    POP_STATS,
+    POP_STOP
+};
+
+struct PartitionRequest {
+    long id;             // Request (or group transaction) id assigned by the router
+    int op;
+    std::vector<int> rooms;
+    long days;
+    long amount;
+    std::string name;
+    std::string phone;
+    std::string group_code;
+    std::string detail;  // Meal name for orders
+};
+
+struct PartitionReply {
+    long id;
+    int op;
+    int partition;
+    bool ok;
+    std::string text;
+};
+
+static const char* const PARTITION_MEALS[] = { "breakfast", "lunch", "dinner" };
+static const long PARTITION_MEAL_PRICES[] = { 500, 1000, 1200 }; // Per person, as at the desk
+
+// Routes a room to a partition by multiplicative hash, so neighbouring rooms
+// (usually booked together) spread across cores
+static int partition_of(int room_no, int partitions) {
+    uint32_t h = static_cast<uint32_t>(room_no) * 2654435761U;
+    return static_cast<int>((h >> 16) % static_cast<uint32_t>(partitions));
+}
+
+// Function to name the journal of partition idx
+static std::string partition_journal_file(int idx) {
+    return "Journal-p" + std::to_string(idx) + ".LOG";
+}
+
+// One shard of the room table with everything it needs to run on its own core
+class RoomPartition {
+public:
+    typedef std::unordered_map<int, PartitionRoom, std::hash<int>, std::equal_to<int>,
+                               PartitionAllocator<std::pair<const int, PartitionRoom>>> RoomMap;
+    typedef std::unordered_map<int, long, std::hash<int>, std::equal_to<int>,
+                               PartitionAllocator<std::pair<const int, long>>> HoldMap;
+
+    const int index;
+    SpscQueue<PartitionRequest> inbox;  // Router -> partition
+    SpscQueue<PartitionReply> outbox;   // Partition -> router
+
+private:
+    PartitionHeap heap;
+    RoomMap rooms;
+    HoldMap holds;          // Room -> group transaction holding it
+    RoomMap prepared;       // Rooms of held group bookings, built while preparing
+    HoldMap reserved;       // Room -> first night reserved for a future arrival
+    long business_date;
+    std::string journal_path;
+    std::string journal_buffer; // Lines since the last group commit to the journal
+    long processed;
+
+    void handle(PartitionRequest& req, PartitionReply& reply);
+    bool refuse(int r_no, long days, std::string& why) const;
+    void flush_journal();
+
+public:
+    RoomPartition(int idx, size_t arena_bytes, HugePageMode mode, long today)
+        : index(idx), inbox(1024), outbox(1024), heap(arena_bytes, mode),
+          rooms(64, std::hash<int>(), std::equal_to<int>(), RoomMap::allocator_type(&heap)),
+          holds(16, std::hash<int>(), std::equal_to<int>(), HoldMap::allocator_type(&heap)),
+          prepared(16, std::hash<int>(), std::equal_to<int>(), RoomMap::allocator_type(&heap)),
+          reserved(16, std::hash<int>(), std::equal_to<int>(), HoldMap::allocator_type(&heap)),
+          business_date(today), journal_path(partition_journal_file(idx)), processed(0) {}
+
+    // Seeds the partition from the room table before its thread starts
+    void load(const RoomData& room);
+    void reserve(int r_no, long from) { reserved[r_no] = from; }
+    void run(int cpu); // Thread body: serve the inbox until POP_STOP
+    std::string summary() const;
+};
+
+void RoomPartition::load(const RoomData& room) {
+    PartitionRoom copy(&heap);
+    copy.name = room.name.c_str();
+    copy.phone = room.phone.c_str();
+    copy.group_code = room.group_code.c_str();
+    copy.days = room.days;
+    copy.cost = room.cost;
+    copy.food_bill = room.food_bill;
+    rooms.emplace(room.room_no, std::move(copy));
+}
+
+// Function to check a new stay of days nights from today in a room; false
+// with the reason if the room is taken, held or reserved within the stay
+bool RoomPartition::refuse(int r_no, long days, std::string& why) const {
+    auto reservation = reserved.find(r_no);
+    if (rooms.count(r_no)) {
+        why = "room " + std::to_string(r_no) + " is already booked";
+    } else if (holds.count(r_no)) {
+        why = "room " + std::to_string(r_no) + " is held for a group booking";
+    } else if (reservation != reserved.end() && reservation->second < business_date + days) {
+        why = "room " + std::to_string(r_no) + " is reserved from " + format_date(reservation->second);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Function to append buffered journal lines in one write (group commit)
+void RoomPartition::flush_journal() {
+    if (journal_buffer.empty()) {
+        return;
+    }
+    std::ofstream jout(journal_path, std::ios::out | std::ios::app);
+    if (!jout.write(journal_buffer.data(), journal_buffer.size())) {
+        std::cerr << " Error: Could not write to " << journal_path << std::endl;
+    }
+    journal_buffer.clear();
+}
+
+void RoomPartition::run(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set); // Best effort: unpinned still works
+
+    int idle = 0;
+    PartitionRequest req;
+    for (;;) {
+        if (!inbox.try_pop(req)) {
+            flush_journal(); // Caught up: commit everything handled since the last flush
+            idle_backoff(idle);
+            continue;
+        }
+        idle = 0;
+        if (req.op == POP_STOP) {
+            break;
+        }
+        PartitionReply reply = {req.id, req.op, index, true, ""};
+        try {
+            handle(req, reply);
+        } catch (const std::bad_alloc&) {
+            // The arena is full: this request fails, the partition keeps serving
+            reply.ok = false;
+            reply.text = "partition " + std::to_string(index) + " is out of memory";
+        }
+        processed++;
+        if (req.op == POP_ABORT) {
+            continue; // The coordinator does not wait for abort acknowledgements
+        }
+        while (!outbox.try_push(reply)) {
+            std::this_thread::yield();
+        }
+    }
+    flush_journal();
+}
+
+void RoomPartition::handle(PartitionRequest& req, PartitionReply& reply) {
+    int r_no = req.rooms.empty() ? 0 : req.rooms[0];
+    std::string room_tag = "room " + std::to_string(r_no);
+    switch (req.op) {
+        case POP_BOOK: {
+            if (refuse(r_no, req.days, reply.text)) {
+                reply.ok = false;
+                return;
+            }
+            PartitionRoom room(&heap);
+            room.name = req.name.c_str();
+            room.phone = req.phone.c_str();
+            room.days = req.days;
+            room.cost = req.days * nightly_rate(r_no);
+            rooms.emplace(r_no, std::move(room));
+            journal_buffer += "BOOK " + std::to_string(r_no) + " " + std::to_string(req.days) + " " + req.phone + " " +
+                              req.name + "\n";
+            reply.text = room_tag + " booked for " + req.name + " (" + std::to_string(req.days) + " night(s))";
+            return;
+        }
+        case POP_ORDER: {
+            auto it = rooms.find(r_no);
+            if (it == rooms.end()) {
+                reply.ok = false;
+                reply.text = room_tag + " is vacant";
+                return;
+            }
+            it->second.food_bill += req.amount;
+            journal_buffer += "ORDER " + std::to_string(r_no) + " " + req.detail + " " + std::to_string(req.amount) + "\n";
+            reply.text = "Rs. " + std::to_string(req.amount) + " " + req.detail + " added to " + room_tag;
+            return;
+        }
+        case POP_CHECKOUT: {
+            auto it = rooms.find(r_no);
+            if (it == rooms.end()) {
+                reply.ok = false;
+                reply.text = room_tag + " is vacant";
+                return;
+            }
+            long bill = it->second.cost + it->second.food_bill;
+            rooms.erase(it);
+            journal_buffer += "CHECKOUT " + std::to_string(r_no) + " " + std::to_string(bill) + "\n";
+            reply.text = room_tag + " checked out, bill Rs. " + std::to_string(bill);
+            return;
+        }
+        case POP_SHOW: {
+            auto it = rooms.find(r_no);
+            if (it == rooms.end()) {
+                reply.ok = false;
+                reply.text = room_tag + (holds.count(r_no) ? " is held for a group booking" : " is vacant");
+                return;
+            }
+            const PartitionRoom& room = it->second;
+            reply.text = room_tag + ": " + std::string(room.name.c_str()) + " (" + room.phone.c_str() + "), " +
+                         std::to_string(room.days) + " night(s), room Rs. " + std::to_string(room.cost) +
+                         ", food Rs. " + std::to_string(room.food_bill) +
+                         (room.group_code.empty() ? "" : ", group " + std::string(room.group_code.c_str())) +
+                         " [partition " + std::to_string(index) + "]";
+            return;
+        }
+        case POP_PREPARE: {
+            for (int r : req.rooms) {
+                if (refuse(r, req.days, reply.text)) {
+                    reply.ok = false;
+                    return;
+                }
+            }
+            // Everything COMMIT needs is allocated here, so a partition that
+            // voted yes cannot run out of memory half way through the commit
+            rooms.reserve(rooms.size() + prepared.size() + req.rooms.size());
+            for (int r : req.rooms) {
+                PartitionRoom room(&heap);
+                room.name = req.name.c_str();
+                room.group_code = req.group_code.c_str();
+                room.days = req.days;
+                room.cost = req.days * nightly_rate(r);
+                prepared.emplace(r, std::move(room));
+                holds[r] = req.id;
+            }
+            return;
+        }
+        case POP_COMMIT: {
+            for (int r : req.rooms) {
+                holds.erase(r);
+                rooms.insert(prepared.extract(r));
+                journal_buffer += "GROUP " + req.group_code + " " + std::to_string(r) + " " +
+                                  std::to_string(req.days) + " " + req.name + "\n";
+            }
+            return;
+        }
+        case POP_ABORT: {
+            for (int r : req.rooms) {
+                auto it = holds.find(r);
+                if (it != holds.end() && it->second == req.id) {
+                    holds.erase(it);
+                    prepared.erase(r);
+                }
+            }
+            return;
+        }
+        case POP_STATS:
+            reply.text = summary();
+            return;
+    }
+}
+
+std::string RoomPartition::summary() const {
+    std::ostringstream out;
+    out << "partition " << index << ": " << rooms.size() << " room(s) booked, " << holds.size() << " held, "
+        << processed << " request(s), heap " << heap.live_bytes() << "/" << heap.carved_bytes() << " bytes live/carved ("
+        << HUGEPAGE_MODE_NAMES[heap.mode()] << ")";
+    return out.str();
+}
+
+// Router-side state of a request that fans out to several partitions
+struct PendingFanout {
+    int waiting;          // Replies still expected in the current phase
+    bool ok;
+    std::string text;
+    PartitionRequest request; // Group booking details, replayed as COMMIT/ABORT
+    std::vector<int> participants;
+};
+
+// Request classes in priority order. Checkouts and bookings are what the front
+// desk is waiting on; orders can wait a little and reports can be dropped.
+enum AdmissionClass {
+    CLASS_CHECKOUT,
+    CLASS_BOOKING,
+    CLASS_ORDER,
+    CLASS_REPORT,
+    ADMISSION_CLASS_COUNT
+};
+
+struct AdmissionPolicy {
+    const char* name;
+    size_t max_depth;   // Queue bound
+    bool critical;      // Full queue: stop reading input (true) or reject the arrival (false)
+    long deadline_ms;   // Queued longer than this and the request is shed (0 = never)
+};
+
+static const AdmissionPolicy ADMISSION_POLICIES[ADMISSION_CLASS_COUNT] = {
+    { "checkout", 1024, true,  0 },
+    { "booking",  1024, true,  0 },
+    { "order",    512,  false, 2000 },
+    { "report",   256,  false, 500 },
+};
+
+// Admission control in front of the router: one bounded FIFO per class,
+// priority dispatch into a bounded in-flight window, and shedding of
+// requests whose class deadline passed while they queued. Priority only
+// reorders requests for different rooms: requests naming the same room are
+// dispatched in arrival order, so a checkout queued behind a booking of its
+// room takes the booking along first. A full critical
+// queue pushes back on the input instead of dropping front-desk work; a full
+// low-priority queue rejects the arrival. Latency (arrival to reply) is
+// tracked per class in power-of-two microsecond buckets.
+class AdmissionController {
+public:
+    struct Ticket {
+        long id;
+        int cls;
+        std::chrono::steady_clock::time_point arrived;
+        std::string line;
+        std::vector<int> rooms; // Rooms the request names, in the order they must be kept
+    };
+
+private:
+    struct ClassMetrics {
+        long admitted;
+        long rejected;  // Queue full on arrival
+        long shed;      // Deadline passed in the queue
+        long completed;
+        long buckets[40]; // Latency histogram: bucket b holds [2^b, 2^(b+1)) microseconds
+        double max_ms;
+    };
+
+    std::deque<Ticket> queues[ADMISSION_CLASS_COUNT];
+    std::unordered_map<int, std::deque<long>> room_order; // Room -> ids of its queued requests, oldest first
+    ClassMetrics metrics[ADMISSION_CLASS_COUNT];
+    std::unordered_map<long, std::pair<int, std::chrono::steady_clock::time_point>> in_flight; // Id -> class, arrival
+
+    double percentile_ms(int cls, double fraction) const;
+    std::deque<Ticket>::iterator find_queued(long id, int& cls);
+    void unlink_rooms(const Ticket& ticket);
+
+public:
+    AdmissionController() : metrics() {}
+
+    static int classify(const std::string& verb); // -1 for an unknown verb
+    static std::vector<int> rooms_of(const std::string& line); // Rooms a request line names
+    bool full(int cls) const { return queues[cls].size() >= ADMISSION_POLICIES[cls].max_depth; }
+    // Queues a request; returns false (and counts a rejection) if its class is full
+    bool offer(Ticket& ticket);
+    // Takes the highest-priority request still within its deadline; expired
+    // requests met on the way are moved to shed
+    bool next(Ticket& ticket, std::chrono::steady_clock::time_point now, std::vector<Ticket>& shed);
+    void completed(long id, std::chrono::steady_clock::time_point now);
+    size_t queued() const;
+    std::string report(const std::string& indent) const;
+};
+
+int AdmissionController::classify(const std::string& verb) {
+    if (verb == "checkout") {
+        return CLASS_CHECKOUT;
+    } else if (verb == "book" || verb == "group") {
+        return CLASS_BOOKING;
+    } else if (verb == "order") {
+        return CLASS_ORDER;
+    } else if (verb == "show" || verb == "stats") {
+        return CLASS_REPORT;
+    }
+    return -1;
+}
+
+// Rooms are read loosely (book/order/checkout/show <room>, group <code> <days>
+// <room,room,...>); a malformed line names no room and is rejected by the router
+std::vector<int> AdmissionController::rooms_of(const std::string& line) {
+    std::istringstream in(line);
+    std::string verb, token;
+    std::vector<int> rooms;
+    in >> verb;
+    if (verb == "group") {
+        std::string code, days;
+        in >> code >> days;
+    }
+    if (in >> token) {
+        std::istringstream list(token);
+        std::string room;
+        while (std::getline(list, room, verb == "group" ? ',' : ' ')) {
+            int r_no = std::atoi(room.c_str());
+            if (r_no > 0 && std::find(rooms.begin(), rooms.end(), r_no) == rooms.end()) {
+                rooms.push_back(r_no);
+            }
+        }
+    }
+    return rooms;
+}
+
+bool AdmissionController::offer(Ticket& ticket) {
+    if (full(ticket.cls)) {
+        metrics[ticket.cls].rejected++;
+        return false;
+    }
+    metrics[ticket.cls].admitted++;
+    for (int r_no : ticket.rooms) {
+        room_order[r_no].push_back(ticket.id);
+    }
+    queues[ticket.cls].push_back(std::move(ticket));
+    return true;
+}
+
+// Function to find a queued request by id; cls is its class on entry if known (else -1) and on return
+std::deque<AdmissionController::Ticket>::iterator AdmissionController::find_queued(long id, int& cls) {
+    for (int c = cls < 0 ? 0 : cls; c < ADMISSION_CLASS_COUNT; ++c) {
+        for (auto it = queues[c].begin(); it != queues[c].end(); ++it) {
+            if (it->id == id) {
+                cls = c;
+                return it;
+            }
+        }
+    }
+    return queues[0].end();
+}
+
+void AdmissionController::unlink_rooms(const Ticket& ticket) {
+    for (int r_no : ticket.rooms) {
+        auto order = room_order.find(r_no);
+        if (order == room_order.end()) {
+            continue;
+        }
+        auto pos = std::find(order->second.begin(), order->second.end(), ticket.id);
+        if (pos != order->second.end()) {
+            order->second.erase(pos);
+        }
+        if (order->second.empty()) {
+            room_order.erase(order);
+        }
+    }
+}
+
+bool AdmissionController::next(Ticket& ticket, std::chrono::steady_clock::time_point now, std::vector<Ticket>& shed) {
+    for (int cls = 0; cls < ADMISSION_CLASS_COUNT; ++cls) {
+        std::deque<Ticket>& queue = queues[cls];
+        long deadline_ms = ADMISSION_POLICIES[cls].deadline_ms;
+        while (!queue.empty() && deadline_ms > 0 &&
+               now - queue.front().arrived > std::chrono::milliseconds(deadline_ms)) {
+            metrics[cls].shed++;
+            unlink_rooms(queue.front());
+            shed.push_back(std::move(queue.front()));
+            queue.pop_front();
+        }
+        if (queue.empty()) {
+            continue;
+        }
+        // An older request for one of its rooms goes first, wherever it is
+        // queued. Ids only decrease along the way, so this ends.
+        int from = cls;
+        auto it = queue.begin();
+        for (bool blocked = true; blocked;) {
+            blocked = false;
+            for (int r_no : it->rooms) {
+                long oldest = room_order[r_no].front();
+                if (oldest != it->id) {
+                    from = -1;
+                    it = find_queued(oldest, from);
+                    blocked = true;
+                    break;
+                }
+            }
+        }
+        ticket = std::move(*it);
+        queues[from].erase(it);
+        unlink_rooms(ticket);
+        in_flight[ticket.id] = {ticket.cls, ticket.arrived};
+        return true;
+    }
+    return false;
+}
+
+void AdmissionController::completed(long id, std::chrono::steady_clock::time_point now) {
+    auto it = in_flight.find(id);
+    if (it == in_flight.end()) {
+        return;
+    }
+    ClassMetrics& m = metrics[it->second.first];
+    double us = std::chrono::duration<double, std::micro>(now - it->second.second).count();
+    int bucket = 0;
+    while (bucket < 39 && us >= static_cast<double>(2L << bucket)) {
+        bucket++;
+    }
+    m.buckets[bucket]++;
+    m.completed++;
+    m.max_ms = std::max(m.max_ms, us / 1000);
+    in_flight.erase(it);
+}
+
+size_t AdmissionController::queued() const {
+    size_t total = 0;
+    for (const auto& queue : queues) {
+        total += queue.size();
+    }
+    return total;
+}
+
+// Upper bound of the histogram bucket holding the given fraction of completions
+double AdmissionController::percentile_ms(int cls, double fraction) const {
+    const ClassMetrics& m = metrics[cls];
+    long target = static_cast<long>(fraction * m.completed);
+    long seen = 0;
+    for (int b = 0; b < 40; ++b) {
+        seen += m.buckets[b];
+        if (seen > target) {
+            return static_cast<double>(2L << b) / 1000;
+        }
+    }
+    return m.max_ms;
+}
+
+std::string AdmissionController::report(const std::string& indent) const {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    for (int cls = 0; cls < ADMISSION_CLASS_COUNT; ++cls) {
+        const ClassMetrics& m = metrics[cls];
+        out << indent << std::left << std::setw(9) << ADMISSION_POLICIES[cls].name << std::right
+            << " admitted " << m.admitted << ", rejected " << m.rejected << ", shed " << m.shed
+            << ", queued " << queues[cls].size() << ", done " << m.completed;
+        if (m.completed > 0) {
+            out << ", p50 <" << percentile_ms(cls, 0.5) << " ms, p99 <" << percentile_ms(cls, 0.99)
+                << " ms, max " << m.max_ms << " ms";
+        }
+    }
+    return out.str();
+}
+
+// The router: owns the partitions, parses requests, runs 2PC for group
+// bookings and prints each reply, tagged "#<id>", as it completes (admission
+// priority and shedding mean that is not always request order)
+class PartitionRouter {
+private:
+    std::vector<std::unique_ptr<RoomPartition>> partitions;
+    std::vector<std::thread> threads;
+    int max_room;
+    long outstanding;
+    std::unordered_map<long, PendingFanout> fanouts;  // Group bookings and stats in flight
+    std::vector<std::pair<long, std::string>> completed; // Ids and replies since the last take_completed
+    const AdmissionController* admission;             // Appends its metrics to stats replies
+
+    void send(int partition, PartitionRequest& req);
+    void emit(long id, const std::string& text);
+    void drain_replies();
+    void on_reply(PartitionReply& reply);
+    bool parse_room(const std::string& token, int& r_no, std::string& error) const;
+
+public:
+    PartitionRouter(const HotelManager& hotel, int count, int rooms, size_t arena_bytes, HugePageMode mode,
+                    const AdmissionController* ac);
+    ~PartitionRouter();
+
+    void submit(const std::string& line, long id); // Parses and routes one request line
+    void reply(long id, const std::string& text);  // Answers a request that was never routed
+    long in_flight() const { return outstanding; }
+    void poll() { drain_replies(); }
+    void take_completed(std::vector<std::pair<long, std::string>>& replies) {
+        replies.swap(completed);
+        completed.clear();
+    }
+};
+
+PartitionRouter::PartitionRouter(const HotelManager& hotel, int count, int rooms, size_t arena_bytes,
+                                 HugePageMode mode, const AdmissionController* ac)
+    : max_room(rooms), outstanding(0), admission(ac) {
+    unsigned cores = std::max(1U, std::thread::hardware_concurrency());
+    for (int p = 0; p < count; ++p) {
+        partitions.emplace_back(new RoomPartition(p, arena_bytes, mode, hotel.today()));
+    }
+    // Each partition starts from its share of the room table, before its thread runs
+    for (int r_no = 1; r_no <= rooms; ++r_no) {
+        RoomPartition& partition = *partitions[partition_of(r_no, count)];
+        if (const RoomData* room = hotel.find_room(r_no)) {
+            partition.load(*room);
+        }
+        long reserved = hotel.reserved_from(r_no);
+        if (reserved >= 0) {
+            partition.reserve(r_no, reserved);
+        }
+    }
+    for (int p = 0; p < count; ++p) {
+        int cpu = static_cast<int>((p + 1) % cores); // Core 0 is left to the router
+        threads.emplace_back(&RoomPartition::run, partitions[p].get(), cpu);
+    }
+}
+
+PartitionRouter::~PartitionRouter() {
+    for (size_t p = 0; p < partitions.size(); ++p) {
+        PartitionRequest stop;
+        stop.id = 0;
+        stop.op = POP_STOP;
+        send(static_cast<int>(p), stop);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (const auto& partition : partitions) {
+        std::cerr << " " << partition->summary() << std::endl;
+    }
+}
+
+// Function to hand a request to a partition, draining replies while its ring is
+// full so neither side can wait on the other forever
+void PartitionRouter::send(int partition, PartitionRequest& req) {
+    int idle = 0;
+    while (!partitions[partition]->inbox.try_push(req)) {
+        drain_replies();
+        idle_backoff(idle);
+    }
+}
+
+// Function to print the reply of a routed request as soon as it completes
+void PartitionRouter::emit(long id, const std::string& text) {
+    outstanding--;
+    completed.emplace_back(id, text);
+    reply(id, text);
+}
+
+void PartitionRouter::reply(long id, const std::string& text) {
+    std::cout << "#" << id << " " << text << std::endl;
+}
+
+void PartitionRouter::drain_replies() {
+    PartitionReply reply;
+    for (auto& partition : partitions) {
+        while (partition->outbox.try_pop(reply)) {
+            on_reply(reply);
+        }
+    }
+}
+
+void PartitionRouter::on_reply(PartitionReply& reply) {
+    auto it = fanouts.find(reply.id);
+    if (it == fanouts.end()) {
+        emit(reply.id, std::string(reply.ok ? "OK " : "ERR ") + reply.text);
+        return;
+    }
+    PendingFanout& fan = it->second;
+    if (!reply.ok) {
+        fan.ok = false;
+        fan.text += (fan.text.empty() ? "" : "; ") + reply.text;
+    } else if (reply.op == POP_STATS) {
+        fan.text += "\n   " + reply.text;
+    }
+    if (--fan.waiting > 0) {
+        return;
+    }
+    if (reply.op == POP_STATS) {
+        std::string text = "OK " + std::to_string(partitions.size()) + " partition(s)" + fan.text;
+        if (admission != nullptr) {
+            text += admission->report("\n   ");
+        }
+        fanouts.erase(it);
+        emit(reply.id, text);
+        return;
+    }
+    if (reply.op == POP_PREPARE) {
+        // All votes are in: phase two
+        fan.request.op = fan.ok ? POP_COMMIT : POP_ABORT;
+        fan.waiting = fan.ok ? static_cast<int>(fan.participants.size()) : 0;
+        PartitionRequest full = fan.request;
+        for (int p : fan.participants) {
+            PartitionRequest part = full;
+            part.rooms.clear();
+            for (int r : full.rooms) {
+                if (partition_of(r, static_cast<int>(partitions.size())) == p) {
+                    part.rooms.push_back(r);
+                }
+            }
+            send(p, part);
+        }
+        if (fan.ok) {
+            return; // Wait for the commit acknowledgements
+        }
+    }
+    long id = reply.id;
+    std::string text = fan.ok ? "OK group " + fan.request.group_code + " booked " +
+                                    std::to_string(fan.request.rooms.size()) + " room(s) across " +
+                                    std::to_string(fan.participants.size()) + " partition(s)"
+                              : "ERR group " + fan.request.group_code + " not booked: " + fan.text;
+    fanouts.erase(id);
+    emit(id, text);
+}
+
+bool PartitionRouter::parse_room(const std::string& token, int& r_no, std::string& error) const {
+    char* end;
+    long value = std::strtol(token.c_str(), &end, 10);
+    if (token.empty() || *end != '\0' || value < 1 || value > max_room) {
+        error = "invalid room '" + token + "' (valid range 1-" + std::to_string(max_room) + ")";
+        return false;
+    }
+    r_no = static_cast<int>(value);
+    return true;
+}
+
+// Function to parse one request line and route it to its partition(s)
+void PartitionRouter::submit(const std::string& line, long id) {
+    std::istringstream in(line);
+    std::string verb;
+    in >> verb;
+    outstanding++;
+    PartitionRequest req;
+    req.id = id;
+    req.days = 0;
+    req.amount = 0;
+    std::string room_token, error;
+    int r_no = 0;
+    int count = static_cast<int>(partitions.size());
+
+    if (verb == "book") {
+        req.op = POP_BOOK;
+        if (!(in >> room_token >> req.days >> req.phone) || !parse_room(room_token, r_no, error) || req.days < 1) {
+            emit(id, "ERR usage: book <room> <days> <phone> <name>" + (error.empty() ? "" : ": " + error));
+            return;
+        }
+        std::getline(in >> std::ws, req.name);
+    } else if (verb == "order") {
+        req.op = POP_ORDER;
+        long people = 0;
+        int meal = -1;
+        if (in >> room_token >> req.detail >> people) {
+            for (int m = 0; m < 3; ++m) {
+                meal = req.detail == PARTITION_MEALS[m] ? m : meal;
+            }
+        }
+        if (!parse_room(room_token, r_no, error) || meal < 0 || people < 1) {
+            emit(id, "ERR usage: order <room> breakfast|lunch|dinner <people>" + (error.empty() ? "" : ": " + error));
+            return;
+        }
+        req.amount = PARTITION_MEAL_PRICES[meal] * people;
+    } else if (verb == "checkout" || verb == "show") {
+        req.op = verb == "checkout" ? POP_CHECKOUT : POP_SHOW;
+        if (!(in >> room_token) || !parse_room(room_token, r_no, error)) {
+            emit(id, "ERR usage: " + verb + " <room>" + (error.empty() ? "" : ": " + error));
+            return;
+        }
+    } else if (verb == "group") {
+        req.op = POP_PREPARE;
+        std::string room_list;
+        if (!(in >> req.group_code >> req.days >> room_list) || req.days < 1) {
+            emit(id, "ERR usage: group <code> <days> <room,room,...> <contact name>");
+            return;
+        }
+        std::getline(in >> std::ws, req.name);
+        std::istringstream rooms_in(room_list);
+        PendingFanout fan;
+        fan.ok = true;
+        std::vector<bool> involved(count, false);
+        while (std::getline(rooms_in, room_token, ',')) {
+            if (!parse_room(room_token, r_no, error)) {
+                emit(id, "ERR " + error);
+                return;
+            }
+            if (std::find(req.rooms.begin(), req.rooms.end(), r_no) != req.rooms.end()) {
+                emit(id, "ERR room " + std::to_string(r_no) + " is listed twice");
+                return;
+            }
+            req.rooms.push_back(r_no);
+            involved[partition_of(r_no, count)] = true;
+        }
+        for (int p = 0; p < count; ++p) {
+            if (involved[p]) {
+                fan.participants.push_back(p);
+            }
+        }
+        fan.waiting = static_cast<int>(fan.participants.size());
+        fan.request = req;
+        fanouts[id] = fan;
+        for (int p : fan.participants) {
+            PartitionRequest part = req;
+            part.rooms.clear();
+            for (int r : req.rooms) {
+                if (partition_of(r, count) == p) {
+                    part.rooms.push_back(r);
+                }
+            }
+            send(p, part);
+        }
+        return;
+    } else if (verb == "stats") {
+        PendingFanout fan;
+        fan.ok = true;
+        fan.waiting = count;
+        fanouts[id] = fan;
+        for (int p = 0; p < count; ++p) {
+            PartitionRequest part;
+            part.id = id;
+            part.op = POP_STATS;
+            send(p, part);
+        }
+        return;
+    } else {
+        emit(id, "ERR unknown request '" + verb + "'");
+        return;
+    }
+    req.rooms.push_back(r_no);
+    send(partition_of(r_no, count), req);
+}
+
+// Function to list the partition journals left in the working directory, in
+// partition order, with the given suffix after ".LOG"
+static std::vector<std::string> partition_journals(const std::string& suffix) {
+    std::vector<std::pair<long, std::string>> found;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(".", ec)) {
+        std::string name = entry.path().filename().string();
+        std::string tail = ".LOG" + suffix;
+        if (name.compare(0, 9, "Journal-p") != 0 || name.size() <= 9 + tail.size() ||
+            name.compare(name.size() - tail.size(), tail.size(), tail) != 0) {
+            continue;
+        }
+        std::string digits = name.substr(9, name.size() - 9 - tail.size());
+        if (digits.find_first_not_of("0123456789") == std::string::npos) {
+            found.emplace_back(std::atol(digits.c_str()), name);
+        }
+    }
+    std::sort(found.begin(), found.end());
+    std::vector<std::string> names;
+    for (const auto& f : found) {
+        names.push_back(f.second);
+    }
+    return names;
+}
+
+// Function to finish a fold that stopped after the journals were renamed to
+// .folded: the staged room table already holds their entries, so it is
+// published and the journals are dropped. If the staged table was already
+// published only the journals are left to remove.
+void HotelManager::recover_partition_fold() {
+    std::vector<std::string> folded = partition_journals(".folded");
+    if (folded.empty()) {
+        return;
+    }
+    std::string tmp = DATA_FILE + ".tmp";
+    if (std::filesystem::exists(tmp)) {
+        for (const auto& name : partition_journals("")) {
+            std::rename(name.c_str(), (name + ".folded").c_str());
+        }
+        if (std::rename(tmp.c_str(), DATA_FILE.c_str()) != 0) {
+            std::cerr << "\n Error: Could not publish the folded room table " << tmp << "." << std::endl;
+            return; // The .folded journals stay, so the next start tries again
+        }
+        folded = partition_journals(".folded");
+    }
+    for (const auto& name : folded) {
+        std::remove(name.c_str());
+    }
+    std::cerr << "\n Warning: Completed an interrupted fold of " << folded.size()
+              << " partition journal(s) into " << DATA_FILE << "." << std::endl;
+}
+
+// Function to replay one partition journal line through the front-desk steps
+bool HotelManager::apply_partition_entry(const std::string& entry) {
+    std::istringstream in(entry);
+    std::string verb;
+    int r_no = 0;
+    in >> verb;
+    if (verb == "BOOK" || verb == "GROUP") {
+        RoomData room;
+        if (verb == "GROUP") {
+            in >> room.group_code;
+        }
+        std::string phone;
+        if (!(in >> r_no >> room.days) || (verb == "BOOK" && !(in >> phone)) || room_type_of(r_no) < 0 ||
+            room.days < 1) {
+            return false;
+        }
+        std::string name;
+        std::getline(in >> std::ws, name);
+        room.room_no = r_no;
+        room.name = name.c_str();
+        room.phone = phone.c_str();
+        room.rtype = ROOM_TYPE_RANGES[room_type_of(r_no)].name;
+        room.cost = room.days * nightly_rate(r_no);
+        room.arrival_date = business_date;
+        room.arrived = true;
+        if (!room.group_code.empty()) {
+            // The server takes a contact name only: it names the company of a new group,
+            // and the company folio takes every charge
+            GroupAccount& account = group_accounts[to_std_string(room.group_code)];
+            if (account.company.empty()) {
+                account.company = name;
+            }
+            room.from_allotment = allotments.draw(to_std_string(room.group_code), room_type_of(r_no), business_date, room.days);
+            room.folios.push_back(Folio(account.company));
+            for (int c = 0; c < CHARGE_CATEGORY_COUNT; ++c) {
+                room.routing[c] = 1;
+            }
+        }
+        if (commit_booking(room)) {
+            return true;
+        }
+        if (room.from_allotment) {
+            allotments.restore(to_std_string(room.group_code), room_type_of(r_no), business_date, business_date + room.days);
+        }
+        return false;
+    } else if (verb == "ORDER") {
+        std::string meal;
+        long amount = 0;
+        if (!(in >> r_no >> meal >> amount)) {
+            return false;
+        }
+        for (int m = 0; m < 3; ++m) {
+            if (meal == PARTITION_MEALS[m] && amount > 0 && amount % PARTITION_MEAL_PRICES[m] == 0) {
+                return post_meal(r_no, m + 1, static_cast<int>(amount / PARTITION_MEAL_PRICES[m])) > 0;
+            }
+        }
+        return false;
+    } else if (verb == "CHECKOUT") {
+        return (in >> r_no) && check_out(r_no) >= 0;
+    }
+    return false;
+}
+
+// Function to fold the partition journals into the room table. The entries
+// are replayed in journal order (each room lives in one partition, so that is
+// its own order), the new table is staged in DATA_FILE.tmp, the journals are
+// renamed to .folded, and the table is published by rename before they are
+// removed. A crash at any point leaves either the journals or a table that
+// already holds them (see recover_partition_fold), never both.
+int HotelManager::fold_partition_journals() {
+    std::vector<std::string> journals = partition_journals("");
+    if (journals.empty()) {
+        return 0;
+    }
+    int replayed = 0;
+    for (const auto& name : journals) {
+        std::ifstream fin(name);
+        std::string entry;
+        int line_no = 0;
+        while (std::getline(fin, entry)) {
+            ++line_no;
+            if (entry.empty()) {
+                continue;
+            }
+            if (apply_partition_entry(entry)) {
+                ++replayed;
+            } else {
+                std::cerr << "\n Warning: " << name << " line " << line_no << " could not be applied: " << entry
+                          << std::endl;
+            }
+        }
+    }
+
+    // From here on the replayed entries are in memory only, so a failed fold must
+    // not be followed by a save at exit: the journals would be replayed twice
+    save_on_exit = false;
+    reap_bgsave(true);
+    std::string tmp = DATA_FILE + ".tmp";
+    bool ok;
+    {
+        std::ofstream fout(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+        write_room_table(fout);
+        fout.flush();
+        ok = static_cast<bool>(fout);
+    }
+    allotments.save(ALLOTMENT_FILE);
+    if (!ok) {
+        std::remove(tmp.c_str());
+        return -1;
+    }
+    for (const auto& name : journals) {
+        if (std::rename(name.c_str(), (name + ".folded").c_str()) != 0) {
+            for (const auto& undo : journals) { // Nothing is published yet: put them back
+                std::rename((undo + ".folded").c_str(), undo.c_str());
+            }
+            std::remove(tmp.c_str());
+            return -1;
+        }
+    }
+    if (std::rename(tmp.c_str(), DATA_FILE.c_str()) != 0) {
+        return -1; // recover_partition_fold finishes it on the next start
+    }
+    for (const auto& name : journals) {
+        std::remove((name + ".folded").c_str());
+    }
+    save_on_exit = true;
+    save_loyalty();
+    revenue.save(REVENUE_FILE);
+    cube.save(CUBE_FILE);
+    std::cerr << "\n Folded " << replayed << " partition journal entr" << (replayed == 1 ? "y" : "ies") << " from "
+              << journals.size() << " journal(s) into " << DATA_FILE << "." << std::endl;
+    return replayed;
+}
+
+// Function to run the partitioned server over stdin until end of input
+static int serve_partitioned(int partitions, int rooms) {
+    HugePageMode mode = hugepage_mode_from_env();
+    const char* arena_env = std::getenv("HMS_PARTITION_ARENA_MB");
+    size_t arena_bytes = static_cast<size_t>(arena_env ? std::atol(arena_env) : 64) << 20;
+    if (rooms < 1 || rooms > HotRoomTable::MAX_ROOMS) {
+        std::cerr << " The hotel has rooms 1-" << HotRoomTable::MAX_ROOMS << "; serving those" << std::endl;
+        rooms = HotRoomTable::MAX_ROOMS;
+    }
+
+    // The room table, with any journals a crashed run left folded in. The
+    // desk's own console output is kept off the reply stream.
+    std::streambuf* screen = std::cout.rdbuf();
+    std::ostringstream discarded;
+    std::cout.rdbuf(discarded.rdbuf());
+    std::unique_ptr<HotelManager> hotel(new HotelManager());
+    std::cout.rdbuf(screen);
+    if (!hotel->usable()) {
+        return 1;
+    }
+    std::cerr << " Serving rooms 1-" << rooms << " on " << partitions << " partition(s), "
+              << HUGEPAGE_MODE_NAMES[mode] << " requested" << std::endl;
+
+    // Lines are read on their own thread so the router never blocks on input
+    // while replies (or 2PC votes) are waiting
+    SpscQueue<std::string> lines(4096);
+    std::atomic<bool> input_done(false);
+    std::thread reader([&lines, &input_done]() {
+        std::string line;
+        while (std::getline(std::cin, line)) {
+            int idle = 0;
+            while (!lines.try_push(line)) {
+                idle_backoff(idle);
+            }
+        }
+        input_done = true;
+    });
+
+    const char* window_env = std::getenv("HMS_MAX_INFLIGHT");
+    long window = std::max(1L, window_env ? std::atol(window_env) : 64);
+    auto start = std::chrono::steady_clock::now();
+    long requests = 0;
+    {
+        AdmissionController admission;
+        PartitionRouter router(*hotel, partitions, rooms, arena_bytes, mode, &admission);
+        const int ADMIT_BATCH = 256; // Lines admitted per pass, so dispatch keeps up with a burst
+        std::string line;
+        AdmissionController::Ticket held; // Critical request waiting for room in its queue
+        held.id = 0;
+        std::vector<AdmissionController::Ticket> shed;
+        std::vector<std::pair<long, std::string>> completed;
+        // Results of keyed mutations, so a client retrying after a lost reply
+        // gets the original answer instead of a second booking or charge
+        IdempotencyTable results(65536, idempotency_ttl_from_env());
+        results.open("Requests-server.LOG");
+        std::unordered_map<long, std::string> keyed; // Request id -> key, while it runs
+        auto release_key = [&keyed, &results](long id) {
+            auto it = keyed.find(id);
+            if (it != keyed.end()) {
+                results.forget(it->second);
+                keyed.erase(it);
+            }
+        };
+        // Dispatch by priority while the in-flight window has room. It runs after
+        // every admission, so requests keep their arrival order until the window
+        // fills and the queues start to build; after that, requests for the
+        // same room still leave in arrival order.
+        auto dispatch = [&](std::chrono::steady_clock::time_point now) {
+            AdmissionController::Ticket ticket;
+            bool any = false;
+            while (router.in_flight() < window && admission.next(ticket, now, shed)) {
+                router.submit(ticket.line, ticket.id);
+                any = true;
+            }
+            return any;
+        };
+        int idle = 0;
+        for (;;) {
+            bool done = input_done.load(); // Read before the final pop so no line is missed
+            bool worked = false;
+            auto now = std::chrono::steady_clock::now();
+            if (held.id != 0 && !admission.full(held.cls)) {
+                admission.offer(held);
+                held.id = 0;
+                worked = true;
+            }
+            for (int n = 0; n < ADMIT_BATCH && held.id == 0 && lines.try_pop(line); ++n) {
+                worked = true;
+                std::istringstream in(line);
+                std::string verb;
+                if (!(in >> verb) || verb[0] == '#') {
+                    continue; // Blank line or comment
+                }
+                long id = ++requests;
+                std::string key;
+                if (verb[0] == '@') {
+                    key = verb.substr(1);
+                    std::string rest;
+                    if (key.empty() || !(in >> verb)) {
+                        router.reply(id, "ERR expected @<key> <request>");
+                        continue;
+                    }
+                    std::getline(in, rest);
+                    line = verb + rest;
+                }
+                int cls = AdmissionController::classify(verb);
+                if (cls < 0) {
+                    router.reply(id, "ERR unknown request '" + verb + "'");
+                    continue;
+                }
+                if (!key.empty() && cls != CLASS_REPORT) {
+                    std::string original;
+                    IdempotencyTable::Status status = results.lookup(key, original);
+                    if (status == IdempotencyTable::DONE) {
+                        router.reply(id, original + " (replayed)");
+                        continue;
+                    } else if (status == IdempotencyTable::PENDING) {
+                        router.reply(id, "ERR request @" + key + " is still in progress");
+                        continue;
+                    }
+                    results.begin(key);
+                    keyed[id] = key;
+                }
+                AdmissionController::Ticket ticket = {id, cls, now, line, AdmissionController::rooms_of(line)};
+                if (ADMISSION_POLICIES[cls].critical && admission.full(cls)) {
+                    held = std::move(ticket); // Stop reading until it fits
+                } else if (!admission.offer(ticket)) {
+                    router.reply(id, std::string("ERR overloaded: ") + ADMISSION_POLICIES[cls].name + " queue is full");
+                    release_key(id);
+                }
+                dispatch(now);
+            }
+            worked = dispatch(now) || worked;
+            for (const auto& dropped : shed) {
+                router.reply(dropped.id, std::string("ERR shed: ") + ADMISSION_POLICIES[dropped.cls].name +
+                                             " request queued past its " +
+                                             std::to_string(ADMISSION_POLICIES[dropped.cls].deadline_ms) + " ms deadline");
+                release_key(dropped.id);
+            }
+            shed.clear();
+            router.poll();
+            router.take_completed(completed);
+            now = std::chrono::steady_clock::now();
+            for (const auto& done_reply : completed) {
+                admission.completed(done_reply.first, now);
+                auto it = keyed.find(done_reply.first);
+                if (it != keyed.end()) {
+                    if (done_reply.second.compare(0, 3, "ERR") == 0) {
+                        results.forget(it->second); // Refused: nothing changed, so a retry runs again
+                    } else {
+                        results.complete(it->second, done_reply.second);
+                    }
+                    keyed.erase(it);
+                }
+            }
+            worked = worked || !completed.empty();
+            if (done && held.id == 0 && router.in_flight() == 0 && admission.queued() == 0 && !worked) {
+                break;
+            }
+            if (worked) {
+                idle = 0;
+            } else {
+                idle_backoff(idle);
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        IdempotencyTable::Stats keys = results.get_stats();
+        std::cerr << " " << requests << " request(s) in " << seconds << " s" << admission.report("\n   ")
+                  << "\n   request keys: " << keys.hits << " hit(s), " << keys.misses << " miss(es), " << keys.evictions
+                  << " eviction(s), " << keys.expirations << " expired (capacity " << results.capacity() << ")"
+                  << std::endl;
+    }
+    reader.join();
+    // The partitions have stopped and flushed their journals: fold them into
+    // Record.DAT, then save the rest of the hotel's files on the way out
+    std::cout.rdbuf(discarded.rdbuf());
+    int folded = hotel->fold_partition_journals();
+    hotel.reset();
+    std::cout.rdbuf(screen);
+    if (folded < 0) {
+        std::cerr << " Error: The partition journals could not be folded into Record.DAT; they are kept for"
+                  << " the next start." << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Reader side of the availability window for the booking site: one seqlocked
+// copy of the published matrix, then the requested nights. Returns an exit code.
+static int read_shared_availability(int nights) {
+    int fd = shm_open(SnapshotPublisher::SHM_NAME, O_RDONLY, 0);
+    if (fd < 0) {
+        std::cerr << "No room snapshot published (is HMS running?)" << std::endl;
+        return 1;
+    }
+    void* addr = mmap(nullptr, sizeof(SharedRoomSnapshot), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        std::cerr << "Could not map room snapshot: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    const SharedRoomSnapshot* snapshot = static_cast<const SharedRoomSnapshot*>(addr);
+    if (snapshot->magic != SharedRoomSnapshot::MAGIC) {
+        std::cerr << "Room snapshot has an unknown layout" << std::endl;
+        munmap(addr, sizeof(SharedRoomSnapshot));
+        return 1;
+    }
+    AvailabilityWindow window = seqlock_read(snapshot->sequence, snapshot->availability);
+    munmap(addr, sizeof(SharedRoomSnapshot));
+
+    nights = std::max(0, std::min(nights, AVAILABILITY_NIGHTS));
+    for (int n = 0; n < nights; ++n) {
+        std::cout << format_date(window.first_night + n);
+        for (int t = 0; t < ROOM_TYPE_COUNT; ++t) {
+            std::cout << " " << ROOM_TYPE_RANGES[t].name << "=" << window.free[n][t];
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
+
+// Main function to run the hotel management system
+int main(int argc, char* argv[]) {
+    // Read-only mode for sibling processes: HMS --snapshot-read [room_no]
+    if (argc > 1 && std::string(argv[1]) == "--snapshot-read") {
+        return read_shared_snapshot(argc > 2 ? std::atoi(argv[2]) : 0);
+    }
+    // Booking site availability: HMS --availability [nights]
+    if (argc > 1 && std::string(argv[1]) == "--availability") {
+        return read_shared_availability(argc > 2 ? std::atoi(argv[2]) : AVAILABILITY_NIGHTS);
+    }
+    // Cold-start report: HMS --startup-report [--budget-ms N] (or HMS_STARTUP_BUDGET_MS)
+    if (argc > 1 && std::string(argv[1]) == "--startup-report") {
+        const char* env_budget = std::getenv("HMS_STARTUP_BUDGET_MS");
+        double budget_ms = env_budget ? std::atof(env_budget) : 500.0;
+        if (argc > 3 && std::string(argv[2]) == "--budget-ms") {
+            budget_ms = std::atof(argv[3]);
+        }
+        StartupProfiler profiler;
+        bool within_budget;
+        {
+            HotelManager hotel_system(&profiler);
+            profiler.phase("first render");
+            std::ostringstream screen;
+            hotel_system.print_main_menu(screen);
+            within_budget = profiler.report(std::cout, budget_ms);
+        }
+        return within_budget ? 0 : 1;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--simulate") {
+        SimConfig cfg = {argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1, 12, 3};
+        int runs = argc > 3 ? std::atoi(argv[3]) : 1000;
+        if (argc > 4) {
+            cfg.tasks = std::atoi(argv[4]);
+        }
+        return simulate(cfg, runs);
+    }
+    if (argc > 2 && std::string(argv[1]) == "--replay") {
+        return replay_schedule(argv[2]);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-batch-lookup") {
+        return bench_batch_lookup(argc > 2 ? std::atol(argv[2]) : 1000000);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-hugepages") {
+        return bench_hugepages(argc > 2 ? std::atol(argv[2]) : 1000000, argc > 3 ? std::atol(argv[3]) : 20000000);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--serve-partitioned") {
+        int cores = static_cast<int>(std::thread::hardware_concurrency());
+        return serve_partitioned(argc > 2 ? std::max(1, std::atoi(argv[2])) : std::max(1, cores - 1),
+                                 argc > 3 ? std::max(1, std::atoi(argv[3])) : 100);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-seqlock") {
+        return bench_seqlock(argc > 2 ? std::atoi(argv[2]) : 4, argc > 3 ? std::atoi(argv[3]) : 1,
+                             argc > 4 ? std::atof(argv[4]) : 2.0);
+    }
+
+    HotelManager hotel_system; // Create an object of HotelManager class
+    if (!hotel_system.usable()) {
+        return 1;
+    }
+    hotel_system.main_menu();  // Call the main menu function
+    return 0;
+}